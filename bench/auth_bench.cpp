@@ -0,0 +1,159 @@
+// Compares the ways a signed request is authenticated: signature
+// verification against the (cached) scheduler key for each supported key
+// type, and the session HMAC issued at handshake.
+//
+//   auth_bench [iterations] [body bytes]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <unistd.h>
+#include "Codec.h"
+#include "SessionStore.h"
+#include "TrustStore.h"
+
+namespace {
+
+std::string publicKeyHex(EVP_PKEY* key) {
+    BIO* bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_PUBKEY(bio, key);
+    char* data = nullptr;
+    long length = BIO_get_mem_data(bio, &data);
+    std::string hex = Codec::hexEncode(data, static_cast<size_t>(length));
+    BIO_free(bio);
+    return hex;
+}
+
+EVP_PKEY* generate(int type) {
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(type, nullptr);
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_keygen_init(ctx);
+    if (type == EVP_PKEY_RSA) EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048);
+    if (type == EVP_PKEY_EC) EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(ctx, &key);
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+std::vector<char> sign(EVP_PKEY* key, const std::string& body) {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    size_t length = 0;
+    EVP_DigestSignInit(ctx, nullptr, EVP_PKEY_base_id(key) == EVP_PKEY_ED25519 ? nullptr : EVP_sha256(), nullptr, key);
+    EVP_DigestSign(ctx, nullptr, &length, reinterpret_cast<const unsigned char*>(body.data()), body.size());
+    std::vector<char> signature(length);
+    EVP_DigestSign(ctx, reinterpret_cast<unsigned char*>(signature.data()), &length,
+                   reinterpret_cast<const unsigned char*>(body.data()), body.size());
+    EVP_MD_CTX_free(ctx);
+    signature.resize(length);
+    return signature;
+}
+
+std::string unwrap(EVP_PKEY* key, const std::string& wrappedB64) {
+    std::vector<unsigned char> ciphertext(wrappedB64.size());
+    int length = EVP_DecodeBlock(ciphertext.data(), reinterpret_cast<const unsigned char*>(wrappedB64.data()),
+                                 static_cast<int>(wrappedB64.size()));
+    // EVP_DecodeBlock counts the bytes that stand for '=' padding as zeros.
+    size_t padding = wrappedB64.size() >= 2 ? (wrappedB64.end()[-1] == '=') + (wrappedB64.end()[-2] == '=') : 0;
+    ciphertext.resize(static_cast<size_t>(length) - padding);
+
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(key, nullptr);
+    size_t outLength = 0;
+    EVP_PKEY_decrypt_init(ctx);
+    EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_OAEP_PADDING);
+    EVP_PKEY_CTX_set_rsa_oaep_md(ctx, EVP_sha256());
+    EVP_PKEY_CTX_set_rsa_mgf1_md(ctx, EVP_sha256());
+    EVP_PKEY_decrypt(ctx, nullptr, &outLength, ciphertext.data(), ciphertext.size());
+    std::string plaintext(outLength, '\0');
+    if (EVP_PKEY_decrypt(ctx, reinterpret_cast<unsigned char*>(&plaintext[0]), &outLength, ciphertext.data(), ciphertext.size()) <= 0) {
+        plaintext.clear();
+    } else {
+        plaintext.resize(outLength);
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return plaintext;
+}
+
+template <typename F>
+double nanosPerOp(int iterations, F&& op) {
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        if (!op()) {
+            std::cerr << "authentication failed at iteration " << i << std::endl;
+            std::exit(1);
+        }
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+    size_t bodyBytes = argc > 2 ? static_cast<size_t>(std::atol(argv[2])) : 256;
+    if (iterations <= 0) {
+        std::cerr << "usage: auth_bench [iterations] [body bytes]" << std::endl;
+        return 1;
+    }
+
+    EVP_PKEY* schedulerKey = generate(EVP_PKEY_RSA);
+    EVP_PKEY* edKey = generate(EVP_PKEY_ED25519);
+    EVP_PKEY* ecKey = generate(EVP_PKEY_EC);
+
+    char directory[] = "/tmp/auth_bench.XXXXXX";
+    if (!mkdtemp(directory)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string keyPath = std::string(directory) + "/trusted_key.txt";
+    TrustStore trust(keyPath);
+    SessionStore sessions(trust);
+    std::string hex = publicKeyHex(schedulerKey);
+    trust.trust(hex);
+
+    std::string body(bodyBytes, 'x');
+    std::string error;
+    Json::Value session = sessions.issue(error);
+    std::string sessionKey = unwrap(schedulerKey, session["key"].asString());
+    if (sessionKey.size() != 32) {
+        std::cerr << "could not unwrap the session key: " << error << std::endl;
+        return 1;
+    }
+    std::string timestamp = std::to_string(std::time(nullptr));
+    // A GET, since a POST signature is only accepted once (replay protection)
+    std::string url = "/docker/list";
+    std::string mac = SessionStore::sign(sessionKey, "GET", url, timestamp, body);
+
+    std::printf("body %zu bytes, %d iterations\n", bodyBytes, iterations);
+    std::printf("  %-20s %10s %12s %10s\n", "method", "ns/op", "ops/s", "sig bytes");
+    double rsa = 0;
+    for (EVP_PKEY* key : {schedulerKey, edKey, ecKey}) {
+        std::string keyHex = publicKeyHex(key);
+        std::vector<char> signature = sign(key, body);
+        double nanos = nanosPerOp(iterations, [&] { return trust.verify(body, signature, keyHex); });
+        if (key == schedulerKey) rsa = nanos;
+        std::printf("  %-20s %10.0f %12.0f %10zu\n", TrustStore::algorithmName(TrustStore::algorithm(key)), nanos, 1e9 / nanos,
+                    signature.size());
+    }
+    double hmac = nanosPerOp(iterations * 10, [&] {
+        return sessions.authenticate(session["id"].asString(), timestamp, mac, "GET", url, body) == SessionStore::Result::Ok;
+    });
+    std::printf("  %-20s %10.0f %12.0f %10zu\n", "session-hmac-sha256", hmac, 1e9 / hmac, mac.size() / 2);
+    std::printf("  session hmac is %.1fx faster than rsa\n", rsa / hmac);
+
+    std::remove(keyPath.c_str());
+    rmdir(directory);
+    EVP_PKEY_free(schedulerKey);
+    EVP_PKEY_free(edKey);
+    EVP_PKEY_free(ecKey);
+    return 0;
+}
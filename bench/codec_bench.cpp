@@ -0,0 +1,199 @@
+// Compares Codec's base64 and hex decoders (scalar, SSE4.1, AVX2) with the
+// ones NodeController used before: a base64 decoder that filters into a
+// copy and logs as it goes, and a hex loop doing substr + stoul per byte.
+// The old decoders' stderr output goes to a null buffer, so their numbers
+// leave out terminal or journal I/O and are a lower bound.
+//
+//   codec_bench [iterations]
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "Codec.h"
+
+namespace {
+
+// NodeController's decoder before Codec, verbatim.
+std::vector<char> legacyBase64Decode(const std::string& input) {
+    static const unsigned char decode_table[] = {
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,
+        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
+        64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,
+        64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
+    };
+
+    std::vector<char> output;
+    std::string cleaned_input;
+    // Filter out invalid characters
+    for (char c : input) {
+        if (std::isalnum(c) || c == '+' || c == '/' || c == '=') {
+            cleaned_input += c;
+        } else {
+            std::cerr << "Filtered invalid base64 character '" << c << "' (ASCII " << (int)c << ")" << std::endl;
+        }
+    }
+    std::cerr << "Cleaned base64 input: " << cleaned_input << std::endl;
+
+    size_t input_len = cleaned_input.size();
+    // Validate length (must be multiple of 4)
+    if (input_len % 4 != 0) {
+        std::cerr << "Invalid base64 length: " << input_len << ", must be multiple of 4" << std::endl;
+        return {};
+    }
+
+    size_t i = 0;
+    while (i < input_len) {
+        if (cleaned_input[i] == '=') {
+            // Handle padding
+            if (i < input_len - 2 || (i == input_len - 2 && cleaned_input[i + 1] != '=')) {
+                std::cerr << "Invalid base64 padding at position " << i << std::endl;
+                return {};
+            }
+            break;
+        }
+
+        if (i + 3 >= input_len) {
+            std::cerr << "Incomplete base64 quartet at position " << i << std::endl;
+            return {};
+        }
+
+        unsigned char a = decode_table[static_cast<unsigned char>(cleaned_input[i])];
+        unsigned char b = decode_table[static_cast<unsigned char>(cleaned_input[i + 1])];
+        unsigned char c = decode_table[static_cast<unsigned char>(cleaned_input[i + 2])];
+        unsigned char d = decode_table[static_cast<unsigned char>(cleaned_input[i + 3])];
+
+        if (a == 64) {
+            std::cerr << "Invalid base64 character '" << cleaned_input[i] << "' at position " << i << std::endl;
+            return {};
+        }
+        if (b == 64) {
+            std::cerr << "Invalid base64 character '" << cleaned_input[i + 1] << "' at position " << i + 1 << std::endl;
+            return {};
+        }
+        if (c == 64 && cleaned_input[i + 2] != '=') {
+            std::cerr << "Invalid base64 character '" << cleaned_input[i + 2] << "' at position " << i + 2 << std::endl;
+            return {};
+        }
+        if (d == 64 && cleaned_input[i + 3] != '=') {
+            std::cerr << "Invalid base64 character '" << cleaned_input[i + 3] << "' at position " << i + 3 << std::endl;
+            return {};
+        }
+
+        output.push_back((a << 2) | (b >> 4));
+        if (cleaned_input[i + 2] != '=') {
+            output.push_back((b << 4) | (c >> 2));
+            if (cleaned_input[i + 3] != '=') {
+                output.push_back((c << 6) | d);
+            }
+        }
+
+        i += 4;
+    }
+
+    std::cerr << "Base64 decoded length: " << output.size() << std::endl;
+    return output;
+}
+
+std::vector<unsigned char> legacyHexDecode(const std::string& publicKeyHex) {
+    std::vector<unsigned char> keyData;
+    for (size_t i = 0; i < publicKeyHex.length(); i += 2) {
+        std::string byteString = publicKeyHex.substr(i, 2);
+        try {
+            unsigned char byte = (unsigned char)std::stoul(byteString, nullptr, 16);
+            keyData.push_back(byte);
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to decode hex at position " << i << ": " << e.what() << std::endl;
+            return {};
+        }
+    }
+    return keyData;
+}
+
+struct NullBuffer : std::streambuf {
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+std::string base64Encode(const std::string& raw) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < raw.size(); i += 3) {
+        uint32_t triple = static_cast<unsigned char>(raw[i]) << 16;
+        if (i + 1 < raw.size()) triple |= static_cast<unsigned char>(raw[i + 1]) << 8;
+        if (i + 2 < raw.size()) triple |= static_cast<unsigned char>(raw[i + 2]);
+        out += alphabet[triple >> 18 & 63];
+        out += alphabet[triple >> 12 & 63];
+        out += i + 1 < raw.size() ? alphabet[triple >> 6 & 63] : '=';
+        out += i + 2 < raw.size() ? alphabet[triple & 63] : '=';
+    }
+    return out;
+}
+
+template <typename F>
+void report(const char* name, size_t inputBytes, int iterations, F&& op) {
+    auto started = std::chrono::steady_clock::now();
+    size_t check = 0;
+    for (int i = 0; i < iterations; ++i) {
+        check += op();
+    }
+    double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / iterations;
+    std::printf("    %-10s %10.0f ns/op %9.2f GB/s   (%zu)\n", name, nanos, inputBytes / nanos, check / iterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+    if (iterations <= 0) {
+        std::cerr << "usage: codec_bench [iterations]" << std::endl;
+        return 1;
+    }
+    std::printf("best isa: %s\n", Codec::isaName(Codec::best()));
+
+    std::mt19937 rng(42);
+    NullBuffer null;
+    std::streambuf* stderrBuffer = std::cerr.rdbuf();
+    // An RSA-2048 signature, a hex-encoded PEM public key, and something large.
+    for (size_t rawBytes : {size_t(256), size_t(451), size_t(64 * 1024)}) {
+        std::string raw(rawBytes, '\0');
+        for (char& c : raw) c = static_cast<char>(rng());
+        std::string b64 = base64Encode(raw);
+        std::string hex = Codec::hexEncode(raw.data(), raw.size());
+        int rounds = rawBytes > 4096 ? std::max(1, iterations / 100) : iterations;
+        std::vector<char> out;
+
+        std::printf("base64, %zu chars\n", b64.size());
+        std::cerr.rdbuf(&null);
+        report("legacy", b64.size(), rounds, [&] { return legacyBase64Decode(b64).size(); });
+        std::cerr.rdbuf(stderrBuffer);
+        for (Codec::Isa isa : {Codec::Isa::Scalar, Codec::Isa::Sse41, Codec::Isa::Avx2}) {
+            report(Codec::isaName(isa), b64.size(), rounds, [&] { return Codec::base64Decode(b64, out, isa) ? out.size() : 0; });
+        }
+
+        std::printf("hex, %zu chars\n", hex.size());
+        std::cerr.rdbuf(&null);
+        report("legacy", hex.size(), rounds, [&] { return legacyHexDecode(hex).size(); });
+        std::cerr.rdbuf(stderrBuffer);
+        for (Codec::Isa isa : {Codec::Isa::Scalar, Codec::Isa::Sse41, Codec::Isa::Avx2}) {
+            report(Codec::isaName(isa), hex.size(), rounds, [&] { return Codec::hexDecode(hex, out, isa) ? out.size() : 0; });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "CapacityScorer.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+double envDouble(const char* name, double fallback, double min, double max) {
+    const char* value = std::getenv(name);
+    if (!value) {
+        return fallback;
+    }
+    char* end;
+    double parsed = std::strtod(value, &end);
+    if (end != value && *end == '\0' && parsed >= min && parsed <= max) {
+        return parsed;
+    }
+    LOG_WARN << "Invalid " << name << ": " << value << ", using default: " << fallback;
+    return fallback;
+}
+
+// Worst "some" avg10 stall for a resource across the system and the workload cgroup.
+double stall(const Json::Value& resources, const char* resource) {
+    return std::max(resources["pressure"][resource]["some_avg10"].asDouble(),
+                    resources["cgroup_pressure"][resource]["some_avg10"].asDouble());
+}
+
+} // namespace
+
+CapacityScorer::CapacityScorer()
+    : utilWeight_(envDouble("CAPACITY_UTIL_WEIGHT", 1.0, 0, 10)),
+      psiWeight_(envDouble("CAPACITY_PSI_WEIGHT", 5.0, 0, 100)),
+      busyBelow_(envDouble("CAPACITY_BUSY_BELOW", 20, 0, 100)),
+      activeAbove_(envDouble("CAPACITY_ACTIVE_ABOVE", 30, 0, 100)),
+      smoothing_(envDouble("CAPACITY_SMOOTHING_SECONDS", 30, 0, 3600)) {
+    if (activeAbove_ < busyBelow_) {
+        LOG_WARN << "CAPACITY_ACTIVE_ABOVE (" << activeAbove_ << ") is below CAPACITY_BUSY_BELOW (" << busyBelow_
+                 << "), using " << busyBelow_ << " for both";
+        activeAbove_ = busyBelow_;
+    }
+}
+
+CapacityScorer::Assessment CapacityScorer::assess(const Json::Value& resources) {
+    struct Load {
+        const char* resource;
+        double value;
+    };
+    double diskFull = resources["disk_usage"].asDouble();
+    for (const auto& fs : resources["filesystems"]) {
+        diskFull = std::max({diskFull, fs["used_percent"].asDouble(), fs["inodes_used_percent"].asDouble()});
+    }
+    double diskBusy = 0;
+    for (const auto& disk : resources["disks"]) {
+        diskBusy = std::max(diskBusy, disk["utilization_percent"].asDouble());
+    }
+    const Load loads[] = {
+        {"cpu", utilWeight_ * resources["cpu_usage"].asDouble() + psiWeight_ * stall(resources, "cpu")},
+        {"memory", utilWeight_ * resources["memory_usage"].asDouble() + psiWeight_ * stall(resources, "memory")},
+        {"io", utilWeight_ * diskBusy + psiWeight_ * stall(resources, "io")},
+        {"disk", diskFull},
+    };
+    const Load* worst = &loads[0];
+    for (const auto& load : loads) {
+        if (load.value > worst->value) worst = &load;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    Assessment next;
+    next.rawScore = std::min(100.0, std::max(0.0, 100.0 - worst->value));
+    next.limitedBy = worst->resource;
+    if (!haveLast_ || smoothing_.count() <= 0) {
+        next.score = next.rawScore;
+    } else {
+        // Time-based EWMA, so the smoothing is the same however often we are asked.
+        double alpha = 1.0 - std::exp(-std::chrono::duration<double>(now - lastAt_).count() / smoothing_.count());
+        next.score = last_.score + alpha * (next.rawScore - last_.score);
+    }
+
+    if (!haveLast_) {
+        next.status = next.score < busyBelow_ ? "busy" : "active";
+    } else if (last_.status == "active") {
+        next.status = next.score < busyBelow_ ? "busy" : "active";
+    } else {
+        next.status = next.score > activeAbove_ ? "active" : "busy";
+    }
+    if (haveLast_ && next.status != last_.status) {
+        ++transitionsTotal_;
+        LOG_INFO << "Node capacity now " << next.status << ": readiness " << next.score << " (limited by "
+                 << next.limitedBy << ")";
+    }
+
+    last_ = next;
+    lastAt_ = now;
+    haveLast_ = true;
+    return next;
+}
+
+CapacityScorer::Assessment CapacityScorer::last() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_;
+}
+
+void CapacityScorer::exportMetrics(MetricsRegistry& registry) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    registry.gauge("persys_node_readiness_score", "Smoothed readiness score (0-100) the node status is derived from", {}, last_.score);
+    registry.gauge("persys_node_readiness_raw_score", "Readiness score of the latest assessment before smoothing", {}, last_.rawScore);
+    registry.gauge("persys_node_busy", "1 while the node reports itself busy", {}, last_.status == "busy" ? 1 : 0);
+    registry.counter("persys_node_status_transitions_total", "Changes between active and busy", {}, static_cast<double>(transitionsTotal_));
+}
@@ -0,0 +1,57 @@
+#ifndef CAPACITY_SCORER_H
+#define CAPACITY_SCORER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <json/json.h>
+#include "MetricsRegistry.h"
+
+// Turns getSystemResources() output into a 0-100 readiness score and the
+// "active"/"busy" status central schedules on.
+//
+// Each resource gets a load: utilization scaled by CAPACITY_UTIL_WEIGHT plus
+// its pressure stall share (the worse of system-wide and workload cgroup
+// PSI, some avg10) scaled by CAPACITY_PSI_WEIGHT. Disk space is taken as is,
+// since a full filesystem stalls nothing until writes fail. The raw score
+// is 100 minus the highest load, so the scarcest resource decides. It is
+// smoothed exponentially over CAPACITY_SMOOTHING_SECONDS. The node turns
+// busy when the smoothed score drops below CAPACITY_BUSY_BELOW and active
+// again only once it rises above CAPACITY_ACTIVE_ABOVE, so it does not
+// flap around a single threshold. With the default weight of 1 and no
+// stall, utilization alone turns the node busy above 80%, as the plain
+// utilization thresholds did; pressure only brings that point forward.
+class CapacityScorer {
+public:
+    struct Assessment {
+        double score = 100;          // smoothed
+        double rawScore = 100;
+        std::string status = "active";
+        std::string limitedBy;       // cpu, memory, io or disk
+    };
+
+    CapacityScorer();
+
+    // Thread-safe; callers at any rate share one smoothed state.
+    Assessment assess(const Json::Value& resources);
+    Assessment last() const;
+
+    void exportMetrics(MetricsRegistry& registry) const;
+
+private:
+    double utilWeight_;
+    double psiWeight_;
+    double busyBelow_;
+    double activeAbove_;
+    std::chrono::duration<double> smoothing_;
+
+    mutable std::mutex mutex_;
+    Assessment last_;
+    bool haveLast_ = false;
+    std::chrono::steady_clock::time_point lastAt_;
+    uint64_t transitionsTotal_ = 0;
+};
+
+#endif // CAPACITY_SCORER_H
@@ -1,9 +1,9 @@
 #include "ComposeController.h"
-#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sys/stat.h>
 #include <algorithm>
+#include <chrono>
 
 std::string ComposeController::getRepoNameFromUrl(const std::string& repoUrl) const {
     // Extract the last part of the URL (e.g., "myrepo.git" from "https://github.com/user/myrepo.git")
@@ -34,54 +34,48 @@ bool ComposeController::hasDockerfile(const std::string& dir) const {
     if (fileExists(dockerfilePath)) return true;
 
     // Simple check for subdirectories (not recursive for simplicity)
-    std::string command = "find " + dir + " -maxdepth 2 -name Dockerfile";
-    std::string result = executeCommand(command);
+    std::string result = executeCommand({"find", dir, "-maxdepth", "2", "-name", "Dockerfile"});
     return !result.empty();
 }
 
-std::string ComposeController::executeCommand(const std::string& cmd) const {
-    std::array<char, 128> buffer;
-    std::string result;
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) return "";
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    pclose(pipe);
-    return result;
+std::string ComposeController::executeCommand(const std::vector<std::string>& argv) const {
+    CommandOptions options;
+    options.timeout = std::chrono::seconds(30);
+    return commands_.run(argv, options).out;
 }
 
 std::string ComposeController::cloneRepository(const std::string& repoUrl, const std::string& branch, const std::string& authToken) {
     std::string repoName = getRepoNameFromUrl(repoUrl);
     std::string repoDir = "./" + repoName;  // Use relative path with repo name
-    std::string command;
+    bool ok;
 
     if (directoryExists(repoDir)) {
         // Directory exists, perform git pull
-        command = "cd " + repoDir + " && git pull origin " + branch;
         if (!authToken.empty()) {
             // Rewrite URL with token for pull
             std::string authUrl = "https://" + authToken + "@" + repoUrl.substr(8);
-            command = "cd " + repoDir + " && git fetch " + authUrl + " " + branch + " && git reset --hard FETCH_HEAD";
+            ok = commands_.run({"git", "-C", repoDir, "fetch", authUrl, branch}).ok() &&
+                 commands_.run({"git", "-C", repoDir, "reset", "--hard", "FETCH_HEAD"}).ok();
+        } else {
+            ok = commands_.run({"git", "-C", repoDir, "pull", "origin", branch}).ok();
         }
     } else {
         // Directory doesn’t exist, clone the repo
-        command = "git clone --branch " + branch + " " + repoUrl + " " + repoDir;
+        std::string url = repoUrl;
         if (!authToken.empty()) {
-            std::string authUrl = "https://" + authToken + "@" + repoUrl.substr(8);
-            command = "git clone --branch " + branch + " " + authUrl + " " + repoDir;
+            url = "https://" + authToken + "@" + repoUrl.substr(8);
         }
+        ok = commands_.run({"git", "clone", "--branch", branch, url, repoDir}).ok();
     }
 
-    int result = std::system(command.c_str());
-    return result == 0 ? repoDir : "";
+    return ok ? repoDir : "";
 }
 
 std::string ComposeController::runCompose(const std::string& composeDir, const Json::Value& envVariables) {
-    std::string envCmd;
+    CommandOptions options;
     if (envVariables.isObject()) {
         for (const auto& key : envVariables.getMemberNames()) {
-            envCmd += key + "=" + envVariables[key].asString() + " ";
+            options.env.push_back(key + "=" + envVariables[key].asString());
         }
     }
 
@@ -95,10 +89,10 @@ std::string ComposeController::runCompose(const std::string& composeDir, const J
     }
 
     // Check if --build is needed
-    std::string buildOption = hasDockerfile(composeDir) ? "--build" : "";
-    std::string command = envCmd + "docker compose -f " + composeFile + " up -d " + buildOption;
-    int result = std::system(command.c_str());
-    return result == 0 ? "Compose started successfully" : "Failed to start compose";
+    std::vector<std::string> argv = {"docker", "compose", "-f", composeFile, "up", "-d"};
+    if (hasDockerfile(composeDir)) argv.push_back("--build");
+    bool ok = commands_.run(argv, options).ok();
+    return ok ? "Compose started successfully" : "Failed to start compose";
 }
 
 std::string ComposeController::stopCompose(const std::string& composeDir) {
@@ -111,7 +105,6 @@ std::string ComposeController::stopCompose(const std::string& composeDir) {
         }
     }
 
-    std::string command = "docker compose -f " + composeFile + " down";
-    int result = std::system(command.c_str());
-    return result == 0 ? "Compose stopped successfully" : "Failed to stop compose";
+    bool ok = commands_.run({"docker", "compose", "-f", composeFile, "down"}).ok();
+    return ok ? "Compose stopped successfully" : "Failed to stop compose";
 }
\ No newline at end of file
@@ -2,10 +2,14 @@
 #define COMPOSE_CONTROLLER_H
 
 #include <string>
+#include <vector>
 #include <json/json.h>
+#include "CommandRunner.h"
 
 class ComposeController {
 public:
+    explicit ComposeController(CommandRunner& commands) : commands_(commands) {}
+
     std::string cloneRepository(const std::string& repoUrl, const std::string& branch, const std::string& authToken);
     std::string runCompose(const std::string& composeDir, const Json::Value& envVariables);
     std::string stopCompose(const std::string& composeDir);
@@ -15,7 +19,9 @@ private:
     bool fileExists(const std::string& path) const;
     bool hasDockerfile(const std::string& dir) const;
     std::string getRepoNameFromUrl(const std::string& repoUrl) const;
-    std::string executeCommand(const std::string& cmd) const;  // Declaration added
+    std::string executeCommand(const std::vector<std::string>& argv) const;
+
+    CommandRunner& commands_;
 };
 
 #endif // COMPOSE_CONTROLLER_H
\ No newline at end of file
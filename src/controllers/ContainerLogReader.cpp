@@ -0,0 +1,541 @@
+#include "ContainerLogReader.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <json/json.h>
+
+namespace {
+
+constexpr size_t kBlockSize = 64 * 1024;
+constexpr size_t kMaxLineBytes = 4 * 1024 * 1024; // the daemon splits log lines at 16KB
+
+int64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// "1700000000.000000001", the form the Engine API takes for since/until.
+std::string formatUnix(int64_t nanos) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%lld.%09lld", static_cast<long long>(nanos / 1000000000),
+                  static_cast<long long>(nanos % 1000000000));
+    return buf;
+}
+
+bool parseDigits(const char* s, size_t n, int& out) {
+    out = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(s[i]))) return false;
+        out = out * 10 + (s[i] - '0');
+    }
+    return true;
+}
+
+// "YYYY-MM-DDTHH:MM:SS[.fraction](Z|+HH:MM|-HH:MM)"
+bool parseRfc3339(const char* s, size_t len, int64_t& nanos) {
+    int year, month, day, hour, minute, second;
+    if (len < 20 || !parseDigits(s, 4, year) || s[4] != '-' || !parseDigits(s + 5, 2, month) || s[7] != '-' ||
+        !parseDigits(s + 8, 2, day) || (s[10] != 'T' && s[10] != 't') || !parseDigits(s + 11, 2, hour) ||
+        s[13] != ':' || !parseDigits(s + 14, 2, minute) || s[16] != ':' || !parseDigits(s + 17, 2, second)) {
+        return false;
+    }
+    size_t pos = 19;
+    int64_t fraction = 0;
+    int fractionDigits = 0;
+    if (pos < len && s[pos] == '.') {
+        for (++pos; pos < len && std::isdigit(static_cast<unsigned char>(s[pos])); ++pos) {
+            if (fractionDigits < 9) {
+                fraction = fraction * 10 + (s[pos] - '0');
+                ++fractionDigits;
+            }
+        }
+    }
+    for (; fractionDigits < 9; ++fractionDigits) fraction *= 10;
+
+    int64_t offset = 0;
+    if (pos < len && (s[pos] == 'Z' || s[pos] == 'z')) {
+        ++pos;
+    } else if (pos + 6 <= len && (s[pos] == '+' || s[pos] == '-')) {
+        int offsetHours, offsetMinutes;
+        if (!parseDigits(s + pos + 1, 2, offsetHours) || s[pos + 3] != ':' || !parseDigits(s + pos + 4, 2, offsetMinutes)) {
+            return false;
+        }
+        offset = (offsetHours * 3600 + offsetMinutes * 60) * (s[pos] == '-' ? -1 : 1);
+        pos += 6;
+    } else {
+        return false;
+    }
+
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    nanos = (static_cast<int64_t>(timegm(&tm)) - offset) * 1000000000 + fraction;
+    return true;
+}
+
+// An open json-file log read with pread, so the offset stays ours.
+struct LogFile {
+    int fd = -1;
+    ino_t inode = 0;
+    off_t size = 0;
+
+    ~LogFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        return fd >= 0 && refresh();
+    }
+    bool refresh() {
+        struct stat info;
+        if (fstat(fd, &info) != 0) return false;
+        inode = info.st_ino;
+        size = info.st_size;
+        return true;
+    }
+    void close() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+};
+
+ino_t inodeOf(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_ino : 0;
+}
+
+// Start of the first line at or after pos.
+off_t nextLineStart(int fd, off_t pos, off_t end) {
+    if (pos <= 0) return 0;
+    char buf[8192];
+    off_t at = pos - 1;
+    while (at < end) {
+        ssize_t n = pread(fd, buf, static_cast<size_t>(std::min<off_t>(sizeof(buf), end - at)), at);
+        if (n <= 0) break;
+        const char* nl = static_cast<const char*>(std::memchr(buf, '\n', static_cast<size_t>(n)));
+        if (nl) return at + (nl - buf) + 1;
+        at += n;
+    }
+    return end;
+}
+
+bool readLine(int fd, off_t pos, off_t end, std::string& line) {
+    line.clear();
+    char buf[8192];
+    while (pos < end && line.size() < kMaxLineBytes) {
+        ssize_t n = pread(fd, buf, static_cast<size_t>(std::min<off_t>(sizeof(buf), end - pos)), pos);
+        if (n <= 0) break;
+        const char* nl = static_cast<const char*>(std::memchr(buf, '\n', static_cast<size_t>(n)));
+        if (nl) {
+            line.append(buf, nl - buf);
+            return true;
+        }
+        line.append(buf, static_cast<size_t>(n));
+        pos += n;
+    }
+    return !line.empty();
+}
+
+// Timestamp of a json-file record; "time" is the last field the daemon writes.
+int64_t lineTime(const std::string& line) {
+    size_t key = line.rfind("\"time\":\"");
+    if (key == std::string::npos) return 0;
+    size_t start = key + 8;
+    size_t end = line.find('"', start);
+    int64_t nanos = 0;
+    if (end == std::string::npos || !parseRfc3339(line.data() + start, end - start, nanos)) return 0;
+    return nanos;
+}
+
+// Binary search over line starts: first line in [lo, hi) stamped at or after t.
+off_t seekTime(int fd, off_t lo, off_t hi, int64_t t) {
+    std::string line;
+    while (lo < hi) {
+        off_t mid = nextLineStart(fd, lo + (hi - lo) / 2, hi);
+        if (mid <= lo || mid >= hi) {
+            // Only the line at lo is left to decide
+            if (!readLine(fd, lo, hi, line) || lineTime(line) >= t) return lo;
+            lo = nextLineStart(fd, lo + 1, hi);
+            continue;
+        }
+        if (!readLine(fd, mid, hi, line) || lineTime(line) >= t) {
+            hi = mid;
+        } else {
+            lo = nextLineStart(fd, mid + 1, hi);
+        }
+    }
+    return lo;
+}
+
+// Walks backward from end (a line start) over `lines` newlines.
+off_t seekTail(int fd, off_t begin, off_t end, int lines) {
+    if (lines <= 0) return end;
+    std::vector<char> buf(kBlockSize);
+    // The byte before end terminates the last line, not a line of its own.
+    off_t scanEnd = end - 1;
+    int seen = 0;
+    while (scanEnd > begin) {
+        off_t chunkStart = std::max(begin, scanEnd - static_cast<off_t>(kBlockSize));
+        ssize_t n = pread(fd, buf.data(), static_cast<size_t>(scanEnd - chunkStart), chunkStart);
+        if (n <= 0) break;
+        for (ssize_t i = n - 1; i >= 0; --i) {
+            if (buf[i] == '\n' && ++seen == lines) {
+                return chunkStart + i + 1;
+            }
+        }
+        scanEnd = chunkStart;
+    }
+    return begin;
+}
+
+// End of the last newline-terminated line; the daemon may be mid-write.
+off_t lastCompleteLineEnd(int fd, off_t size) {
+    char buf[8192];
+    off_t scanEnd = size;
+    while (scanEnd > 0) {
+        off_t chunkStart = std::max<off_t>(0, scanEnd - static_cast<off_t>(sizeof(buf)));
+        ssize_t n = pread(fd, buf, static_cast<size_t>(scanEnd - chunkStart), chunkStart);
+        if (n <= 0) break;
+        for (ssize_t i = n - 1; i >= 0; --i) {
+            if (buf[i] == '\n') return chunkStart + i + 1;
+        }
+        scanEnd = chunkStart;
+    }
+    return 0;
+}
+
+// Appends complete records from pos until EOF, the page cap or `until`.
+// pos is advanced past every consumed line.
+void emitLines(LogFile& file, off_t& pos, const LogQuery& query, Json::CharReader& reader,
+               LogPage& page, bool& untilReached) {
+    std::vector<char> buf(kBlockSize);
+    std::string pending;
+    off_t readPos = pos;
+    while (readPos < file.size) {
+        ssize_t n = pread(file.fd, buf.data(), static_cast<size_t>(std::min<off_t>(kBlockSize, file.size - readPos)), readPos);
+        if (n <= 0) return;
+        readPos += n;
+
+        size_t start = 0;
+        while (start < static_cast<size_t>(n)) {
+            const char* lineStart = buf.data() + start;
+            const char* nl = static_cast<const char*>(std::memchr(lineStart, '\n', static_cast<size_t>(n) - start));
+            if (!nl) {
+                pending.append(lineStart, static_cast<size_t>(n) - start);
+                break;
+            }
+            size_t len = static_cast<size_t>(nl - lineStart);
+            const char* begin = lineStart;
+            if (!pending.empty()) {
+                pending.append(lineStart, len);
+                begin = pending.data();
+                len = pending.size();
+            }
+
+            Json::Value entry;
+            std::string errs;
+            if (reader.parse(begin, begin + len, &entry, &errs)) {
+                std::string time = entry["time"].asString();
+                int64_t stamp = 0;
+                parseRfc3339(time.data(), time.size(), stamp);
+                if (query.untilNanos > 0 && stamp > query.untilNanos) {
+                    untilReached = true;
+                    return;
+                }
+                std::string log = entry["log"].asString();
+                size_t add = log.size() + (query.timestamps ? time.size() + 1 : 0);
+                if (!page.text.empty() && page.text.size() + add > query.maxBytes) {
+                    page.more = true;
+                    return;
+                }
+                if (query.timestamps) {
+                    page.text += time;
+                    page.text += ' ';
+                }
+                page.text += log;
+            }
+            pos += static_cast<off_t>(len) + 1;
+            start = static_cast<size_t>(nl - buf.data()) + 1;
+            pending.clear();
+        }
+        if (pending.size() > kMaxLineBytes) {
+            // Not a json-file record; skip it rather than buffer without bound.
+            pos += static_cast<off_t>(pending.size());
+            pending.clear();
+        }
+    }
+}
+
+// Waits until the file grows past pos or is rotated away. False on timeout.
+bool waitForGrowth(const std::string& path, LogFile& file, off_t pos, std::chrono::steady_clock::time_point deadline) {
+    int watch = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (watch >= 0 && inotify_add_watch(watch, path.c_str(), IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB) < 0) {
+        close(watch);
+        watch = -1;
+    }
+    bool grew = false;
+    for (;;) {
+        file.refresh();
+        if (file.size > pos || inodeOf(path) != file.inode) {
+            grew = true;
+            break;
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) break;
+        // Re-check at least every second in case inotify is unavailable
+        struct pollfd pfd = {watch, POLLIN, 0};
+        poll(watch >= 0 ? &pfd : nullptr, watch >= 0 ? 1 : 0, static_cast<int>(std::min<long long>(remaining, 1000)));
+        if (watch >= 0) {
+            char events[4096];
+            while (::read(watch, events, sizeof(events)) > 0) {
+            }
+        }
+    }
+    if (watch >= 0) close(watch);
+    return grew;
+}
+
+} // namespace
+
+ContainerLogReader::ContainerLogReader(DockerEngineClient& engine) : engine_(engine) {}
+
+bool ContainerLogReader::parseTime(const std::string& value, int64_t& nanos) {
+    if (value.empty()) return false;
+
+    char unit = value.back();
+    if ((unit == 's' || unit == 'm' || unit == 'h') && value.size() > 1 &&
+        std::all_of(value.begin(), value.end() - 1, [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+        int64_t amount = std::atoll(value.c_str());
+        int64_t scale = unit == 'h' ? 3600 : unit == 'm' ? 60 : 1;
+        nanos = nowNanos() - amount * scale * 1000000000;
+        return true;
+    }
+
+    if (std::all_of(value.begin(), value.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)) || c == '.'; })) {
+        size_t dot = value.find('.');
+        int64_t seconds = std::atoll(value.substr(0, dot).c_str());
+        std::string fraction = dot == std::string::npos ? "" : value.substr(dot + 1, 9);
+        fraction.resize(9, '0');
+        nanos = seconds * 1000000000 + std::atoll(fraction.c_str());
+        return true;
+    }
+
+    return parseRfc3339(value.data(), value.size(), nanos);
+}
+
+bool ContainerLogReader::inspect(const std::string& containerId, Target& target, LogPage& page) {
+    DockerEngineClient::Response res = engine_.get("/containers/" + DockerEngineClient::urlEncode(containerId) + "/json", 10000);
+    if (!res.ok()) {
+        page.error = res.errorMessage();
+        page.notFound = res.status == 404;
+        return false;
+    }
+    Json::Value c = res.json();
+    target.id = c["Id"].asString();
+    target.logPath = c["LogPath"].asString();
+    target.driver = c["HostConfig"]["LogConfig"]["Type"].asString();
+    target.tty = c["Config"]["Tty"].asBool();
+    target.running = c["State"]["Running"].asBool();
+    return true;
+}
+
+LogPage ContainerLogReader::read(const std::string& containerId, const LogQuery& query) {
+    LogPage page;
+    Target target;
+    if (!inspect(containerId, target, page)) {
+        return page;
+    }
+
+    bool apiCursor = query.cursor.compare(0, 2, "t:") == 0;
+    if (!apiCursor && target.driver == "json-file" && !target.logPath.empty()) {
+        page.source = "json-file";
+        if (readJsonFile(target, query, page)) {
+            return page;
+        }
+        // LogPath is not visible to us (e.g. the agent runs in a container
+        // without /var/lib/docker mounted); byte cursors mean nothing to the API.
+        page = LogPage();
+        LogQuery fresh = query;
+        fresh.cursor.clear();
+        readApi(target, fresh, page);
+        return page;
+    }
+    readApi(target, query, page);
+    return page;
+}
+
+bool ContainerLogReader::readJsonFile(const Target& target, const LogQuery& query, LogPage& page) {
+    LogFile file;
+    if (!file.open(target.logPath)) {
+        return false;
+    }
+
+    off_t pos = 0;
+    bool rotated = false; // reading the previous file after the daemon rotated the log
+    unsigned long long cursorInode = 0;
+    long long cursorOffset = 0;
+    if (std::sscanf(query.cursor.c_str(), "f:%llu:%lld", &cursorInode, &cursorOffset) == 2) {
+        if (cursorInode == file.inode && cursorOffset <= file.size) {
+            pos = cursorOffset;
+        } else if (cursorInode == inodeOf(target.logPath + ".1")) {
+            // Finish the file we were reading before it was rotated
+            LogFile previous;
+            if (previous.open(target.logPath + ".1")) {
+                std::swap(file.fd, previous.fd);
+                file.refresh();
+                pos = std::min<off_t>(cursorOffset, file.size);
+                rotated = true;
+            }
+        }
+    } else {
+        off_t end = lastCompleteLineEnd(file.fd, file.size);
+        off_t begin = 0;
+        if (query.sinceNanos > 0) {
+            begin = seekTime(file.fd, 0, end, query.sinceNanos);
+        }
+        if (query.untilNanos > 0) {
+            end = seekTime(file.fd, begin, end, query.untilNanos + 1);
+        }
+        pos = query.tail >= 0 ? std::max(begin, seekTail(file.fd, begin, end, query.tail)) : begin;
+    }
+
+    std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(query.waitMs);
+    bool untilReached = false;
+    for (;;) {
+        emitLines(file, pos, query, *reader, page, untilReached);
+        if (untilReached || page.more) {
+            break;
+        }
+        if (rotated) {
+            // Caught up with the rotated file; carry on in the live one
+            file.refresh();
+            if (pos < file.size) continue;
+            if (!file.open(target.logPath)) break;
+            pos = 0;
+            rotated = false;
+            continue;
+        }
+        if (!page.text.empty() || !query.follow || !target.running) {
+            break;
+        }
+        if (!waitForGrowth(target.logPath, file, pos, deadline)) {
+            break;
+        }
+        rotated = inodeOf(target.logPath) != file.inode;
+    }
+
+    page.cursor = "f:" + std::to_string(file.inode) + ":" + std::to_string(pos);
+    page.ended = untilReached || (!page.more && !rotated && !target.running && pos >= file.size);
+    return true;
+}
+
+void ContainerLogReader::readApi(const Target& target, const LogQuery& query, LogPage& page) {
+    page.source = "api";
+    const int64_t startedAt = nowNanos();
+    const std::string base = "/containers/" + DockerEngineClient::urlEncode(target.id) +
+                             "/logs?stdout=1&stderr=1&timestamps=1";
+
+    int64_t since = query.sinceNanos;
+    bool resumed = false;
+    if (query.cursor.compare(0, 2, "t:") == 0) {
+        since = std::atoll(query.cursor.c_str() + 2) + 1;
+        resumed = true;
+    }
+    std::string until = query.untilNanos > 0 ? "&until=" + formatUnix(query.untilNanos) : "";
+
+    int64_t lastStamp = 0;
+    bool full = false;
+    std::string frames;
+    std::string lines;
+    // Non-TTY output arrives in 8-byte framed records; every line starts with
+    // its timestamp since we always ask for them (they become the cursor).
+    auto consume = [&](const char* data, size_t len) {
+        if (target.tty) {
+            lines.append(data, len);
+        } else {
+            frames.append(data, len);
+            size_t at = 0;
+            while (frames.size() - at >= 8) {
+                const unsigned char* header = reinterpret_cast<const unsigned char*>(frames.data() + at);
+                size_t frameLen = (static_cast<size_t>(header[4]) << 24) | (static_cast<size_t>(header[5]) << 16) |
+                                  (static_cast<size_t>(header[6]) << 8) | static_cast<size_t>(header[7]);
+                if (frames.size() - at - 8 < frameLen) break;
+                lines.append(frames, at + 8, frameLen);
+                at += 8 + frameLen;
+            }
+            frames.erase(0, at);
+        }
+
+        size_t start = 0;
+        size_t nl;
+        while (!full && (nl = lines.find('\n', start)) != std::string::npos) {
+            size_t space = lines.find(' ', start);
+            if (space == std::string::npos || space > nl) space = start;
+            size_t textStart = query.timestamps || space == start ? start : space + 1;
+            size_t add = nl + 1 - textStart;
+            if (!page.text.empty() && page.text.size() + add > query.maxBytes) {
+                full = true;
+                page.more = true;
+                break;
+            }
+            int64_t stamp = 0;
+            if (space > start && parseRfc3339(lines.data() + start, space - start, stamp)) {
+                lastStamp = stamp;
+            }
+            page.text.append(lines, textStart, add);
+            start = nl + 1;
+        }
+        lines.erase(0, start);
+        return !full;
+    };
+
+    std::string backlog;
+    if (since > 0) backlog += "&since=" + formatUnix(since);
+    if (!resumed && query.tail >= 0) backlog += "&tail=" + std::to_string(query.tail);
+    DockerEngineClient::Response res = engine_.stream("GET", base + backlog + until, "", consume, 30000);
+    if (!res.ok() && !full) {
+        page.error = res.errorMessage();
+        page.notFound = res.status == 404;
+        return;
+    }
+
+    // waitMs 0 means "do not wait"; as a stream idle timeout it would mean forever.
+    if (page.text.empty() && query.follow && query.waitMs > 0 && target.running) {
+        // Caught up: hold the request until something new is logged.
+        std::string params = "&follow=1";
+        if (lastStamp > 0) params += "&since=" + formatUnix(lastStamp + 1);
+        else if (since > 0) params += "&since=" + formatUnix(since);
+        else params += "&since=" + formatUnix(startedAt);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(query.waitMs);
+        engine_.stream("GET", base + params + until, "", [&](const char* data, size_t len) {
+            consume(data, len);
+            return page.text.empty() && std::chrono::steady_clock::now() < deadline;
+        }, query.waitMs);
+    }
+
+    if (lastStamp > 0) {
+        page.cursor = "t:" + std::to_string(lastStamp);
+    } else {
+        // Nothing read: resume from where this request started looking
+        int64_t from = resumed || since > 0 ? since - 1 : startedAt - 1;
+        page.cursor = "t:" + std::to_string(from);
+    }
+    page.ended = (query.untilNanos > 0 && query.untilNanos < startedAt) || (!page.more && !target.running);
+}
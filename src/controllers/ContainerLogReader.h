@@ -0,0 +1,61 @@
+#ifndef CONTAINER_LOG_READER_H
+#define CONTAINER_LOG_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "DockerEngineClient.h"
+
+struct LogQuery {
+    int tail = -1;               // last N lines, -1 for all
+    int64_t sinceNanos = 0;      // unix time in ns, 0 for no lower bound
+    int64_t untilNanos = 0;      // unix time in ns, 0 for no upper bound
+    bool follow = false;         // wait for new output once caught up
+    bool timestamps = false;     // prefix each line with its RFC3339 timestamp
+    std::string cursor;          // resume point returned by a previous page
+    size_t maxBytes = 1 << 20;   // page size cap
+    int waitMs = 20000;          // how long a follow request waits for new output; 0 returns at once
+};
+
+struct LogPage {
+    std::string text;
+    std::string cursor;     // pass back as LogQuery::cursor to continue after this page
+    bool more = false;      // stopped at maxBytes; more output is available right away
+    bool ended = false;     // nothing more will come: container stopped or until reached
+    std::string source;     // "json-file", "api" or "cli"
+    std::string error;
+    bool notFound = false;
+};
+
+// Reads container logs one bounded page at a time. json-file logs are read
+// straight from disk: tail seeks backward from the end and since/until
+// binary-search the timestamped lines, so neither scans the whole file.
+// Other drivers (or an unreadable LogPath) go through the Engine API stream,
+// which is cut off at the page size. Memory use is O(maxBytes) either way.
+class ContainerLogReader {
+public:
+    explicit ContainerLogReader(DockerEngineClient& engine);
+
+    LogPage read(const std::string& containerId, const LogQuery& query);
+
+    // Accepts unix seconds ("1700000000.5"), RFC3339 ("2024-01-02T15:04:05Z")
+    // or a duration relative to now ("10m", "2h", "30s").
+    static bool parseTime(const std::string& value, int64_t& nanos);
+
+private:
+    struct Target {
+        std::string id;
+        std::string logPath;
+        std::string driver;
+        bool tty = false;
+        bool running = false;
+    };
+
+    bool inspect(const std::string& containerId, Target& target, LogPage& page);
+    bool readJsonFile(const Target& target, const LogQuery& query, LogPage& page);
+    void readApi(const Target& target, const LogQuery& query, LogPage& page);
+
+    DockerEngineClient& engine_;
+};
+
+#endif // CONTAINER_LOG_READER_H
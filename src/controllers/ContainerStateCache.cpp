@@ -0,0 +1,319 @@
+#include "ContainerStateCache.h"
+#include "Logger.h"
+#include <cstdlib>
+#include <set>
+#include <sstream>
+
+namespace {
+
+// Event actions that cannot change anything we track.
+const std::set<std::string> kIgnoredActions = {
+    "attach", "detach", "commit", "copy", "archive-path", "extract-to-dir", "export",
+    "resize", "top", "exec_create", "exec_start", "exec_detach", "exec_die", "health_status"};
+
+std::string formatPorts(const Json::Value& ports) {
+    std::string out;
+    for (const auto& key : ports.getMemberNames()) {
+        const Json::Value& bindings = ports[key];
+        if (!bindings.isArray() || bindings.empty()) {
+            if (!out.empty()) out += ", ";
+            out += key;
+            continue;
+        }
+        for (const auto& binding : bindings) {
+            if (!out.empty()) out += ", ";
+            out += binding["HostIp"].asString() + ":" + binding["HostPort"].asString() + "->" + key;
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+ContainerStateCache::ContainerStateCache(DockerEngineClient& engine)
+    : engine_(engine), resyncInterval_(60), snapshot_(std::make_shared<ContainerSnapshot>()) {
+    if (const char* interval = std::getenv("CONTAINER_RESYNC_SECONDS")) {
+        int seconds = std::atoi(interval);
+        if (seconds > 0) {
+            resyncInterval_ = std::chrono::seconds(seconds);
+        }
+    }
+}
+
+ContainerStateCache::~ContainerStateCache() {
+    stop();
+}
+
+void ContainerStateCache::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    resyncThread_ = std::thread(&ContainerStateCache::resyncLoop, this);
+    eventThread_ = std::thread(&ContainerStateCache::eventLoop, this);
+}
+
+void ContainerStateCache::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake_.notify_all();
+    // The event thread is usually parked in an idle read on /events.
+    engine_.cancelStreams(&running_);
+    if (resyncThread_.joinable()) resyncThread_.join();
+    if (eventThread_.joinable()) eventThread_.join();
+}
+
+std::shared_ptr<const ContainerSnapshot> ContainerStateCache::snapshot() const {
+    return std::atomic_load(&snapshot_);
+}
+
+bool ContainerStateCache::find(const std::string& idOrName, ContainerRecord& record) const {
+    if (idOrName.empty()) {
+        return false;
+    }
+    std::shared_ptr<const ContainerSnapshot> current = snapshot();
+    for (const auto& candidate : current->containers) {
+        if (candidate.name == idOrName || candidate.id.compare(0, idOrName.size(), idOrName) == 0) {
+            record = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+ContainerStateCache::Stats ContainerStateCache::stats() const {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return stats_;
+}
+
+bool ContainerStateCache::inspect(const std::string& id, ContainerRecord& record) {
+    DockerEngineClient::Response res = engine_.get("/containers/" + id + "/json", 10000);
+    if (!res.ok()) {
+        return false;
+    }
+    Json::Value c = res.json();
+    record.id = c["Id"].asString();
+    record.name = c["Name"].asString();
+    if (!record.name.empty() && record.name[0] == '/') record.name.erase(0, 1);
+    record.image = c["Config"]["Image"].asString();
+    record.state = c["State"]["Status"].asString();
+    record.error = c["State"]["Error"].asString();
+    record.pid = c["State"]["Pid"].asInt();
+    record.restartCount = c["RestartCount"].asInt();
+    record.ports = formatPorts(c["NetworkSettings"]["Ports"]);
+    record.labels.clear();
+    const Json::Value& labels = c["Config"]["Labels"];
+    if (labels.isObject()) {
+        for (const auto& key : labels.getMemberNames()) {
+            record.labels[key] = labels[key].asString();
+        }
+    }
+    return true;
+}
+
+// Must be called with tableMutex_ held.
+void ContainerStateCache::publish() {
+    auto next = std::make_shared<ContainerSnapshot>();
+    next->version = version_;
+    next->syncedAt = std::chrono::system_clock::now();
+    next->containers.reserve(table_.size());
+    for (const auto& entry : table_) {
+        next->containers.push_back(entry.second);
+    }
+    std::atomic_store(&snapshot_, std::shared_ptr<const ContainerSnapshot>(std::move(next)));
+}
+
+void ContainerStateCache::handleEvent(const Json::Value& event) {
+    // ?since= has one-second resolution, so every reconnect replays the
+    // events of the last second we already applied; skip those.
+    int64_t timeNano = event["timeNano"].asInt64();
+    if (timeNano > 0 && timeNano <= lastEventNano_) {
+        return;
+    }
+    std::string action = event["Action"].asString();
+    std::string id = event["Actor"]["ID"].asString();
+    if (id.empty()) {
+        return;
+    }
+    // "exec_start: sh -c ..." style actions carry a suffix.
+    std::string baseAction = action.substr(0, action.find(':'));
+    if (kIgnoredActions.count(baseAction)) {
+        return;
+    }
+
+    if (baseAction == "destroy") {
+        std::lock_guard<std::mutex> lock(tableMutex_);
+        // Tombstoned even if we never saw the container, so a resync that
+        // inspected it just before it went away does not bring it back.
+        destroyed_[id] = ++version_;
+        if (table_.erase(id)) {
+            publish();
+        }
+    } else {
+        ContainerRecord record;
+        if (inspect(id, record)) {
+            std::lock_guard<std::mutex> lock(tableMutex_);
+            record.version = ++version_;
+            table_[id] = record;
+            publish();
+        }
+    }
+
+    if (timeNano > 0) {
+        lastEventNano_ = timeNano;
+    }
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    ++stats_.eventsTotal;
+    if (timeNano > 0) {
+        stats_.lastEventLagSeconds = static_cast<double>(now - timeNano) / 1e9;
+    }
+}
+
+void ContainerStateCache::eventLoop() {
+    const std::string filters = DockerEngineClient::urlEncode("{\"type\":[\"container\"]}");
+    bool reconnecting = false;
+
+    while (running_) {
+        if (!engine_.useApi()) {
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait_for(lock, std::chrono::seconds(10), [this] { return !running_; });
+            continue;
+        }
+
+        std::string path = "/events?filters=" + filters;
+        if (lastEventNano_ > 0) {
+            // Replays anything that happened while we were disconnected.
+            path += "&since=" + std::to_string(lastEventNano_ / 1000000000);
+        }
+        if (reconnecting) {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            ++stats_.streamReconnectsTotal;
+        }
+
+        std::string pending;
+        bool connected = false;
+        // The daemon sends nothing while idle, so the stream is re-opened
+        // (with ?since=) every 30s of silence; stop() cancels it directly.
+        DockerEngineClient::Response res = engine_.stream("GET", path, "", [&](const char* data, size_t len) {
+            if (!connected) {
+                connected = true;
+                std::lock_guard<std::mutex> lock(statsMutex_);
+                stats_.streamConnected = true;
+            }
+            pending.append(data, len);
+            size_t nl;
+            while ((nl = pending.find('\n')) != std::string::npos) {
+                Json::Value event;
+                Json::CharReaderBuilder builder;
+                std::string errs;
+                std::istringstream line(pending.substr(0, nl));
+                pending.erase(0, nl + 1);
+                if (Json::parseFromStream(builder, line, &event, &errs)) {
+                    handleEvent(event);
+                }
+            }
+            return running_.load();
+        }, 30000, {}, &running_);
+
+        bool idleTimeout = res.status == 200 && res.error.find("Timed out") != std::string::npos;
+        reconnecting = !idleTimeout;
+        if (idleTimeout) {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            stats_.streamConnected = true;
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(statsMutex_);
+                stats_.streamConnected = false;
+            }
+            if (running_ && !res.ok()) {
+                LOG_WARN << "Docker event stream failed: " << res.errorMessage();
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait_for(lock, std::chrono::seconds(2), [this] { return !running_; });
+        }
+    }
+}
+
+void ContainerStateCache::resyncLoop() {
+    while (running_) {
+        if (engine_.useApi()) {
+            resync();
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait_for(lock, ready_ ? resyncInterval_ : std::chrono::seconds(5), [this] { return !running_; });
+    }
+}
+
+void ContainerStateCache::resync() {
+    uint64_t startVersion;
+    std::map<std::string, std::string> knownStates;
+    {
+        std::lock_guard<std::mutex> lock(tableMutex_);
+        startVersion = version_;
+        for (const auto& entry : table_) {
+            knownStates[entry.first] = entry.second.state;
+        }
+    }
+
+    DockerEngineClient::Response res = engine_.get("/containers/json?all=1");
+    if (!res.ok()) {
+        LOG_WARN << "Container resync failed: " << res.errorMessage();
+        return;
+    }
+
+    // Only containers that are new or whose state drifted need an inspect.
+    std::set<std::string> listed;
+    std::vector<ContainerRecord> refreshed;
+    for (const auto& item : res.json()) {
+        std::string id = item["Id"].asString();
+        listed.insert(id);
+        auto known = knownStates.find(id);
+        if (known != knownStates.end() && known->second == item["State"].asString()) {
+            continue;
+        }
+        ContainerRecord record;
+        if (inspect(id, record)) {
+            refreshed.push_back(record);
+        }
+    }
+
+    uint64_t corrections = 0;
+    {
+        std::lock_guard<std::mutex> lock(tableMutex_);
+        // Records touched or destroyed by an event after the listing started
+        // are newer than what the resync saw, so they win.
+        for (auto& record : refreshed) {
+            auto it = table_.find(record.id);
+            if (it != table_.end() && it->second.version > startVersion) continue;
+            auto tombstone = destroyed_.find(record.id);
+            if (tombstone != destroyed_.end() && tombstone->second > startVersion) continue;
+            record.version = ++version_;
+            table_[record.id] = record;
+            ++corrections;
+        }
+        for (auto it = table_.begin(); it != table_.end();) {
+            if (!listed.count(it->first) && it->second.version <= startVersion) {
+                it = table_.erase(it);
+                ++version_;
+                ++corrections;
+            } else {
+                ++it;
+            }
+        }
+        // Later resyncs start after this point, so no tombstone can matter to them.
+        destroyed_.clear();
+        publish();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        ++stats_.resyncsTotal;
+        // The first sync populates an empty table; that is not drift.
+        if (ready_) {
+            stats_.resyncCorrectionsTotal += corrections;
+        }
+    }
+    ready_ = true;
+}
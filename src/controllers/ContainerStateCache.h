@@ -0,0 +1,93 @@
+#ifndef CONTAINER_STATE_CACHE_H
+#define CONTAINER_STATE_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <json/json.h>
+#include "DockerEngineClient.h"
+
+struct ContainerRecord {
+    std::string id;        // full container ID
+    std::string name;      // without the leading '/'
+    std::string image;
+    std::string state;     // engine State.Status: created, running, exited, ...
+    std::string error;     // State.Error, e.g. image pull or runtime failures
+    std::string ports;     // CLI-style "0.0.0.0:8080->80/tcp, ..."
+    std::map<std::string, std::string> labels;
+    int pid = 0;           // init PID on the host, 0 when not running
+    int restartCount = 0;
+    uint64_t version = 0;  // cache version at which this record last changed
+};
+
+// Immutable view of the container table handed to readers.
+struct ContainerSnapshot {
+    uint64_t version = 0;
+    std::chrono::system_clock::time_point syncedAt;
+    std::vector<ContainerRecord> containers;
+};
+
+// Keeps an in-memory container table current by following the daemon's
+// /events stream, with a periodic full resync to repair missed events.
+// Readers get a shared immutable snapshot and never touch the daemon.
+class ContainerStateCache {
+public:
+    struct Stats {
+        uint64_t eventsTotal = 0;
+        uint64_t resyncsTotal = 0;
+        uint64_t resyncCorrectionsTotal = 0; // records fixed by a resync, i.e. missed events
+        uint64_t streamReconnectsTotal = 0;
+        double lastEventLagSeconds = 0;      // daemon event time -> applied to the table
+        bool streamConnected = false;
+    };
+
+    explicit ContainerStateCache(DockerEngineClient& engine);
+    ~ContainerStateCache();
+
+    void start();
+    void stop();
+
+    // True once the first full sync has completed.
+    bool ready() const { return ready_.load(); }
+    std::shared_ptr<const ContainerSnapshot> snapshot() const;
+    // Looks a container up by full ID, ID prefix or name in the current snapshot.
+    bool find(const std::string& idOrName, ContainerRecord& record) const;
+    Stats stats() const;
+
+private:
+    void eventLoop();
+    void resyncLoop();
+    void resync();
+    void handleEvent(const Json::Value& event);
+    bool inspect(const std::string& id, ContainerRecord& record);
+    void publish();
+
+    DockerEngineClient& engine_;
+    std::chrono::seconds resyncInterval_;
+
+    mutable std::mutex tableMutex_;
+    std::map<std::string, ContainerRecord> table_;
+    uint64_t version_ = 0;
+    std::map<std::string, uint64_t> destroyed_; // id -> version of its destroy event, since the last resync
+    std::shared_ptr<const ContainerSnapshot> snapshot_;
+
+    std::atomic<bool> running_{false};
+    std::atomic<bool> ready_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::thread eventThread_;
+    std::thread resyncThread_;
+    int64_t lastEventNano_ = 0; // timeNano of the last applied event, for ?since= on reconnect and replay dedup
+
+    mutable std::mutex statsMutex_;
+    Stats stats_;
+};
+
+#endif // CONTAINER_STATE_CACHE_H
@@ -1,17 +1,15 @@
 #include "CronController.h"
-#include <array>
 #include <iostream>
 #include <sstream>
-#include <fstream>
-#include <cstdlib>
+#include <stdexcept>
 
-CronController::CronController() {}
+CronController::CronController(CommandRunner &commands) : commands_(commands) {}
 
 CronController::~CronController() {}
 
 std::vector<std::string> CronController::listCronJobs() {
     std::vector<std::string> jobs;
-    std::string result = executeCronCommand("crontab -l");
+    std::string result = executeCronCommand({"crontab", "-l"});
 
     std::istringstream stream(result);
     std::string line;
@@ -22,29 +20,34 @@ std::vector<std::string> CronController::listCronJobs() {
     return jobs;
 }
 
+// Both edits rewrite the whole crontab through `crontab -` on stdin, so no
+// temp file is shared between concurrent requests and nothing goes through a shell.
 std::string CronController::addCronJob(const std::string &schedule, const std::string &command) {
     std::string newJob = schedule + " " + command;
-    std::string tmpFile = "/tmp/cronjobs.txt";
-
-    executeCronCommand("crontab -l > " + tmpFile);
-    executeCronCommand("echo \"" + newJob + "\" >> " + tmpFile);
-    return executeCronCommand("crontab " + tmpFile);
+    std::string crontab = executeCronCommand({"crontab", "-l"});
+    if (!crontab.empty() && crontab.back() != '\n') crontab += '\n';
+    crontab += newJob + "\n";
+    return executeCronCommand({"crontab", "-"}, crontab);
 }
 
 std::string CronController::removeCronJob(const std::string &jobId) {
-    std::string tmpFile = "/tmp/cronjobs.txt";
-    executeCronCommand("crontab -l | grep -v \"" + jobId + "\" > " + tmpFile);
-    return executeCronCommand("crontab " + tmpFile);
+    std::istringstream current(executeCronCommand({"crontab", "-l"}));
+    std::string crontab;
+    std::string line;
+    while (std::getline(current, line)) {
+        if (line.find(jobId) == std::string::npos) {
+            crontab += line + "\n";
+        }
+    }
+    return executeCronCommand({"crontab", "-"}, crontab);
 }
 
-std::string CronController::executeCronCommand(const std::string &command) {
-    std::array<char, 128> buffer;
-    std::string result;
-    FILE *pipe = popen(command.c_str(), "r");
-    if (!pipe) throw std::runtime_error("Failed to run command");
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    pclose(pipe);
-    return result;
+std::string CronController::executeCronCommand(const std::vector<std::string> &argv, const std::string &input) {
+    CommandOptions options;
+    options.input = input;
+    options.timeout = std::chrono::seconds(30);
+    CommandResult result = commands_.run(argv, options);
+    if (!result.started) throw std::runtime_error("Failed to run command: " + result.error);
+    // `crontab -l` with no crontab prints "no crontab for <user>" on stderr only.
+    return result.out;
 }
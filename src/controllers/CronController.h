@@ -3,10 +3,11 @@
 
 #include <string>
 #include <vector>
+#include "CommandRunner.h"
 
 class CronController {
 public:
-    CronController();
+    explicit CronController(CommandRunner &commands);
     ~CronController();
 
     std::vector<std::string> listCronJobs();
@@ -14,7 +15,9 @@ public:
     std::string removeCronJob(const std::string &jobId);
     
 private:
-    std::string executeCronCommand(const std::string &command);
+    std::string executeCronCommand(const std::vector<std::string> &argv, const std::string &input = "");
+
+    CommandRunner &commands_;
 };
 
 #endif
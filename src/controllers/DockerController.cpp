@@ -1,32 +1,189 @@
 #include "DockerController.h"
+#include "Logger.h"
 #include <array>
 #include <cstdio>
-#include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <set> // Added for std::set
 #include <ctime> // Added for time functions
 #include <map>
 #include <mutex>
-#include <sys/types.h>
-#include <signal.h>
-#include <unistd.h>
+#include <openssl/evp.h>
+#include "NetDevReader.h"
+
+namespace {
+
+// Splits a command string into argv the way a POSIX shell would for simple
+// quoting, so API-created containers get the same Cmd as `docker run ... cmd`.
+std::vector<std::string> splitCommandLine(const std::string &command) {
+    std::vector<std::string> args;
+    std::string current;
+    bool inArg = false;
+    char quote = 0;
+    for (size_t i = 0; i < command.size(); ++i) {
+        char c = command[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            } else if (c == '\\' && quote == '"' && i + 1 < command.size()) {
+                current += command[++i];
+            } else {
+                current += c;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            inArg = true;
+        } else if (c == '\\' && i + 1 < command.size()) {
+            current += command[++i];
+            inArg = true;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (inArg) {
+                args.push_back(current);
+                current.clear();
+                inArg = false;
+            }
+        } else {
+            current += c;
+            inArg = true;
+        }
+    }
+    if (inArg) args.push_back(current);
+    return args;
+}
 
-DockerController::DockerController() {}
+// Splits an image reference into the fromImage/tag pair the API expects.
+// Without an explicit tag the API would pull every tag of the repository.
+void splitImageReference(const std::string &image, std::string &repository, std::string &tag) {
+    size_t at = image.find('@');
+    if (at != std::string::npos) {
+        repository = image.substr(0, at);
+        tag = image.substr(at + 1);
+        return;
+    }
+    size_t slash = image.rfind('/');
+    size_t colon = image.rfind(':');
+    if (colon != std::string::npos && (slash == std::string::npos || colon > slash)) {
+        repository = image.substr(0, colon);
+        tag = image.substr(colon + 1);
+    } else {
+        repository = image;
+        tag = "latest";
+    }
+}
 
-DockerController::~DockerController() {}
+std::string registryOf(const std::string &image) {
+    size_t slash = image.find('/');
+    if (slash != std::string::npos) {
+        std::string first = image.substr(0, slash);
+        if (first.find('.') != std::string::npos || first.find(':') != std::string::npos || first == "localhost") {
+            return first;
+        }
+    }
+    return "docker.io";
+}
 
-std::string DockerController::executeDockerCommand(const std::string &command) {
-    std::string fullCommand = "docker " + command + " 2>&1";
-    std::array<char, 128> buffer;
-    std::string result;
-    FILE *pipe = popen(fullCommand.c_str(), "r");
-    if (!pipe) throw std::runtime_error("Failed to run command");
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
+// "https://index.docker.io/v1/" -> "docker.io", "reg.example.com:5000/" -> "reg.example.com:5000"
+std::string normalizeRegistry(std::string registry) {
+    size_t scheme = registry.find("://");
+    if (scheme != std::string::npos) registry.erase(0, scheme + 3);
+    size_t slash = registry.find('/');
+    if (slash != std::string::npos) registry.erase(slash);
+    if (registry.empty() || registry == "index.docker.io" || registry == "registry-1.docker.io") {
+        return "docker.io";
     }
-    pclose(pipe);
-    return result;
+    return registry;
+}
+
+// Same rounding as the docker CLI (units.HumanSize): decimal units, 3 significant digits.
+std::string humanSize(double size) {
+    static const char *units[] = {"B", "kB", "MB", "GB", "TB", "PB"};
+    int i = 0;
+    while (size >= 1000.0 && i < 5) {
+        size /= 1000.0;
+        ++i;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3g%s", size, units[i]);
+    return buf;
+}
+
+// "8080:80", "127.0.0.1:8080:80/udp" or "80" -> ExposedPorts / PortBindings entries.
+void addPortBinding(const std::string &spec, Json::Value &exposed, Json::Value &bindings) {
+    std::vector<std::string> parts;
+    std::istringstream ss(spec);
+    std::string part;
+    while (std::getline(ss, part, ':')) parts.push_back(part);
+    if (parts.empty()) return;
+    std::string containerPort = parts.back();
+    if (containerPort.find('/') == std::string::npos) containerPort += "/tcp";
+    Json::Value binding;
+    binding["HostIp"] = parts.size() >= 3 ? parts[0] : "";
+    binding["HostPort"] = parts.size() >= 2 ? parts[parts.size() - 2] : "";
+    exposed[containerPort] = Json::Value(Json::objectValue);
+    bindings[containerPort].append(binding);
+}
+
+// Non-TTY containers multiplex stdout/stderr in 8-byte framed records.
+std::string demuxLogStream(const DockerEngineClient::Response &res) {
+    const std::string &raw = res.body;
+    auto contentType = res.headers.find("content-type");
+    bool multiplexed = contentType != res.headers.end() &&
+                       contentType->second.find("multiplexed") != std::string::npos;
+    if (!multiplexed) {
+        multiplexed = raw.size() >= 8 && static_cast<unsigned char>(raw[0]) <= 2 &&
+                      raw[1] == 0 && raw[2] == 0 && raw[3] == 0;
+    }
+    if (!multiplexed) return raw;
+
+    std::string out;
+    out.reserve(raw.size());
+    size_t pos = 0;
+    while (pos + 8 <= raw.size()) {
+        uint32_t len = (static_cast<uint32_t>(static_cast<unsigned char>(raw[pos + 4])) << 24) |
+                       (static_cast<uint32_t>(static_cast<unsigned char>(raw[pos + 5])) << 16) |
+                       (static_cast<uint32_t>(static_cast<unsigned char>(raw[pos + 6])) << 8) |
+                       static_cast<uint32_t>(static_cast<unsigned char>(raw[pos + 7]));
+        pos += 8;
+        size_t take = std::min<size_t>(len, raw.size() - pos);
+        out.append(raw, pos, take);
+        pos += take;
+    }
+    return out;
+}
+
+// Maps the engine's State.Status to the workload status vocabulary used by central.
+std::string workloadStatusFromState(const std::string &st) {
+    if (st == "running") return "Running";
+    if (st == "paused") return "Paused";
+    if (st == "restarting") return "Restarting";
+    if (st == "dead") return "Dead";
+    if (st == "created") return "ContainerCreating";
+    if (st == "exited") return "Exited";
+    if (st == "removing") return "Removing";
+    return "";
+}
+
+} // namespace
+
+DockerController::DockerController(DockerEngineClient& engine, ContainerStateCache& stateCache,
+                                   CommandRunner& commands, WorkloadStore& workloads)
+    : engine_(engine), stateCache_(stateCache), commands_(commands), workloads_(workloads), logReader_(engine),
+      imagePulls_([this](const std::string &image, const ImagePullManager::ProgressCallback &onProgress) {
+          return pullImageDirect(image, onProgress);
+      }) {}
+
+DockerController::~DockerController() {}
+
+std::string DockerController::executeDockerCommand(const std::vector<std::string> &args, const std::string &tag) {
+    std::vector<std::string> argv;
+    argv.reserve(args.size() + 1);
+    argv.push_back("docker");
+    argv.insert(argv.end(), args.begin(), args.end());
+    CommandOptions options;
+    options.tag = tag;
+    CommandResult result = commands_.run(argv, options);
+    if (!result.started) throw std::runtime_error(result.error);
+    return result.combined();
 }
 
 std::string DockerController::startContainer(const std::string &image, 
@@ -38,67 +195,224 @@ std::string DockerController::startContainer(const std::string &image,
                                              const std::string &network, 
                                              const std::string &restartPolicy, 
                                              bool detach,
-                                             const std::string &command) {
-    std::ostringstream cmd;
-    cmd << "run ";
+                                             const std::string &command,
+                                             const PhaseCallback &onPhase) {
+    if (engine_.useApi()) {
+        return startContainerApi(image, name, ports, envVars, volumes, labels, network, restartPolicy, detach, command, onPhase);
+    }
+    // Pull missing images through the pull manager so concurrent launches
+    // of the same image share one download instead of one per `docker run`.
+    if (executeDockerCommand({"image", "inspect", "--format", "{{.Id}}", image}).find("Error") != std::string::npos) {
+        if (onPhase) onPhase("pulling");
+        std::string pullResult = imagePulls_.pull(image);
+        if (pullResult.find("Error") != std::string::npos) {
+            return pullResult;
+        }
+    }
+    if (onPhase) onPhase("creating");
+
+    std::vector<std::string> args = {"run"};
 
-    if (detach) cmd << "-d ";
-    if (!name.empty()) cmd << "--name " << name << " ";
-    if (!network.empty()) cmd << "--network " << network << " ";
-    cmd << "--restart=" << restartPolicy << " ";
+    if (detach) args.push_back("-d");
+    if (!name.empty()) args.insert(args.end(), {"--name", name});
+    if (!network.empty()) args.insert(args.end(), {"--network", network});
+    args.push_back("--restart=" + restartPolicy);
 
     for (const auto &port : ports) {
-        cmd << "-p " << port << " ";
+        args.insert(args.end(), {"-p", port});
     }
-    
+
     for (const auto &env : envVars) {
-        cmd << "-e \"" << env << "\" ";
+        args.insert(args.end(), {"-e", env});
     }
 
     for (const auto &volume : volumes) {
-        cmd << "-v " << volume << " ";
+        args.insert(args.end(), {"-v", volume});
     }
 
     for (const auto &label : labels) {
-        cmd << "--label " << label << " ";
+        args.insert(args.end(), {"--label", label});
     }
 
-    cmd << image << " ";
+    args.push_back(image);
+    for (const auto &arg : splitCommandLine(command)) {
+        args.push_back(arg);
+    }
+    LOG_INFO << "Docker Command: docker run " << (name.empty() ? image : name);
+    return executeDockerCommand(args, name);
+}
+
+std::string DockerController::startContainerApi(const std::string &image,
+                                                const std::string &name,
+                                                const std::vector<std::string> &ports,
+                                                const std::vector<std::string> &envVars,
+                                                const std::vector<std::string> &volumes,
+                                                const std::vector<std::string> &labels,
+                                                const std::string &network,
+                                                const std::string &restartPolicy,
+                                                bool detach,
+                                                const std::string &command,
+                                                const PhaseCallback &onPhase) {
+    Json::Value spec;
+    spec["Image"] = image;
+    spec["Env"] = Json::Value(Json::arrayValue);
+    for (const auto &env : envVars) {
+        spec["Env"].append(env);
+    }
+    spec["Labels"] = Json::Value(Json::objectValue);
+    for (const auto &label : labels) {
+        size_t eq = label.find('=');
+        spec["Labels"][label.substr(0, eq)] = eq == std::string::npos ? "" : label.substr(eq + 1);
+    }
     if (!command.empty()) {
-        cmd << command;
+        spec["Cmd"] = Json::Value(Json::arrayValue);
+        for (const auto &arg : splitCommandLine(command)) {
+            spec["Cmd"].append(arg);
+        }
     }
-    printf("Docker Command: %s", cmd.str().c_str());
-    return executeDockerCommand(cmd.str());
+
+    Json::Value &hostConfig = spec["HostConfig"];
+    spec["ExposedPorts"] = Json::Value(Json::objectValue);
+    hostConfig["PortBindings"] = Json::Value(Json::objectValue);
+    for (const auto &port : ports) {
+        addPortBinding(port, spec["ExposedPorts"], hostConfig["PortBindings"]);
+    }
+    hostConfig["Binds"] = Json::Value(Json::arrayValue);
+    for (const auto &volume : volumes) {
+        hostConfig["Binds"].append(volume);
+    }
+    if (!network.empty()) {
+        hostConfig["NetworkMode"] = network;
+    }
+    std::string policy = restartPolicy.empty() ? "no" : restartPolicy;
+    size_t colon = policy.find(':');
+    hostConfig["RestartPolicy"]["Name"] = policy.substr(0, colon);
+    if (colon != std::string::npos) {
+        hostConfig["RestartPolicy"]["MaximumRetryCount"] = std::atoi(policy.c_str() + colon + 1);
+    }
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    std::string body = Json::writeString(writer, spec);
+    std::string createPath = "/containers/create";
+    if (!name.empty()) {
+        createPath += "?name=" + DockerEngineClient::urlEncode(name);
+    }
+
+    if (onPhase) onPhase("creating");
+    DockerEngineClient::Response created = engine_.post(createPath, body);
+    if (created.status == 404) {
+        // Same behaviour as `docker run`: pull the missing image, then retry.
+        if (onPhase) onPhase("pulling");
+        std::string pullResult = imagePulls_.pull(image);
+        if (pullResult.find("Error") != std::string::npos) {
+            return pullResult;
+        }
+        if (onPhase) onPhase("creating");
+        created = engine_.post(createPath, body);
+    }
+    if (!created.ok()) {
+        return created.errorMessage();
+    }
+    std::string id = created.json()["Id"].asString();
+
+    DockerEngineClient::Response started = engine_.post("/containers/" + id + "/start");
+    if (!started.ok() && started.status != 304) {
+        return started.errorMessage();
+    }
+
+    if (!detach) {
+        engine_.post("/containers/" + id + "/wait", "", 24 * 60 * 60 * 1000);
+        return getContainerLogs(id);
+    }
+    return id + "\n";
 }
 
 std::string DockerController::stopContainer(const std::string &containerId) {
-    return executeDockerCommand("stop " + containerId);
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.post("/containers/" + DockerEngineClient::urlEncode(containerId) + "/stop", "", 60000);
+        return res.ok() || res.status == 304 ? containerId + "\n" : res.errorMessage();
+    }
+    return executeDockerCommand({"stop", containerId});
 }
 
-// Add a struct to track state for each workload/container
-struct WorkloadState {
-    std::string status; // e.g., Pulling, ImagePullBackOff, ContainerCreating, Running, Failed
-    std::string reason; // e.g., network error, auth error, etc.
-    time_t lastUpdate;
-};
+Json::Value DockerController::listContainersApi(bool all) {
+    Json::Value containers(Json::arrayValue);
+    DockerEngineClient::Response res = engine_.get(std::string("/containers/json") + (all ? "?all=1" : ""));
+    if (!res.ok()) {
+        LOG_ERROR << "Failed to list containers: " << res.errorMessage();
+        return containers;
+    }
 
-static std::map<std::string, WorkloadState> workloadStates;
-static std::mutex workloadStatesMutex;
+    for (const auto &item : res.json()) {
+        Json::Value container;
+        std::string name = item["Names"].size() > 0 ? item["Names"][0].asString() : "";
+        if (!name.empty() && name[0] == '/') name.erase(0, 1);
+        container["id"] = item["Id"].asString().substr(0, 12);
+        container["names"] = name;
+        container["image"] = item["Image"].asString();
+        container["status"] = item["Status"].asString();
+
+        std::string ports;
+        for (const auto &port : item["Ports"]) {
+            if (!ports.empty()) ports += ", ";
+            std::string privatePort = std::to_string(port["PrivatePort"].asInt()) + "/" + port["Type"].asString();
+            if (port.isMember("PublicPort")) {
+                ports += port["IP"].asString() + ":" + std::to_string(port["PublicPort"].asInt()) + "->" + privatePort;
+            } else {
+                ports += privatePort;
+            }
+        }
+        container["ports"] = ports;
 
-std::map<std::string, time_t> pendingWorkloads; // workloadID -> launch time
-std::mutex pendingWorkloadsMutex;
+        std::string state = item["State"].asString();
+        std::string mapped = workloadStatusFromState(state);
+        if (!mapped.empty()) {
+            container["status"] = mapped;
+        }
+        // The list endpoint carries no State.Error; only stopped containers can have one.
+        if (state != "running" && state != "paused" && state != "restarting") {
+            Json::Value inspected = engine_.get("/containers/" + item["Id"].asString() + "/json").json();
+            std::string error = inspected["State"]["Error"].asString();
+            if (!error.empty()) {
+                container["status"] = "ImagePullBackOff";
+                container["reason"] = error;
+            }
+        }
+        containers.append(container);
+    }
+    return containers;
+}
 
-std::map<pid_t, std::string> runningDockerRuns; // pid -> workloadId
-std::mutex runningDockerRunsMutex;
+// Served from the event-fed state cache: no daemon round-trip at all.
+Json::Value DockerController::listContainersCached(bool all) {
+    Json::Value containers(Json::arrayValue);
+    std::shared_ptr<const ContainerSnapshot> snapshot = stateCache_.snapshot();
+    for (const auto &record : snapshot->containers) {
+        if (!all && record.state != "running") continue;
+        Json::Value container;
+        container["id"] = record.id.substr(0, 12);
+        container["names"] = record.name;
+        container["image"] = record.image;
+        std::string mapped = workloadStatusFromState(record.state);
+        container["status"] = mapped.empty() ? record.state : mapped;
+        container["ports"] = record.ports;
+        if (!record.error.empty() && record.state != "running") {
+            container["status"] = "ImagePullBackOff";
+            container["reason"] = record.error;
+        }
+        containers.append(container);
+    }
+    return containers;
+}
 
-Json::Value DockerController::listContainers(bool all) {
+Json::Value DockerController::listContainersCli(bool all) {
     // Use --format to get structured output, one line per container
-    std::string format = "--format '{{.ID}}\t{{.Names}}\t{{.Image}}\t{{.Status}}\t{{.Ports}}'";
-    std::string cmd = "ps " + std::string(all ? "-a" : "") + " " + format;
-    std::string rawOutput = executeDockerCommand(cmd);
+    std::vector<std::string> args = {"ps", "--format", "{{.ID}}\\t{{.Names}}\\t{{.Image}}\\t{{.Status}}\\t{{.Ports}}"};
+    if (all) args.push_back("-a");
+    std::string rawOutput = executeDockerCommand(args);
 
     Json::Value containers(Json::arrayValue);
-    std::set<std::string> knownNames;
     if (!rawOutput.empty()) {
         std::istringstream iss(rawOutput);
         std::string line;
@@ -117,186 +431,70 @@ Json::Value DockerController::listContainers(bool all) {
             container["image"] = image;
             container["status"] = status;
             container["ports"] = ports;
-            // Add reason if tracked
-            {
-                std::lock_guard<std::mutex> lock(workloadStatesMutex);
-                if (workloadStates.count(names)) {
-                    container["reason"] = workloadStates[names].reason;
-                }
-            }
             containers.append(container);
-            knownNames.insert(names);
         }
     }
+    return containers;
+}
 
-    // --- Pending workloads: check for running docker run processes ---
-    {
-        std::lock_guard<std::mutex> lock(pendingWorkloadsMutex);
-        for (auto it = pendingWorkloads.begin(); it != pendingWorkloads.end(); ) {
-            const std::string& workloadId = it->first;
-            time_t launchTime = it->second;
-            bool found = false;
-            for (const auto& c : containers) {
-                if (c["names"].asString() == workloadId) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                // Check for running docker run process
-                std::string psOutput;
-                std::array<char, 256> buffer;
-                std::string grepCmd = "ps aux | grep 'docker run' | grep -- '" + workloadId + "' | grep -v grep";
-                FILE* pipe = popen(grepCmd.c_str(), "r");
-                if (pipe) {
-                    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-                        psOutput += buffer.data();
-                    }
-                    pclose(pipe);
-                }
-                double minutes = difftime(time(nullptr), launchTime) / 60.0;
-                if (!psOutput.empty()) {
-                    Json::Value synthetic;
-                    synthetic["id"] = "";
-                    synthetic["names"] = workloadId;
-                    synthetic["image"] = "";
-                    synthetic["status"] = "Pulling";
-                    synthetic["reason"] = "docker run in progress";
-                    synthetic["sinceMinutes"] = minutes;
-                    synthetic["ports"] = "";
-                    containers.append(synthetic);
-                    std::cout << "[Agent] Workload " << workloadId << " is being pulled/created (" << minutes << " min)" << std::endl;
-                    ++it;
-                } else if (minutes > 35) { // 35 min grace period
-                    std::cout << "[Agent] Workload " << workloadId << " pending for " << minutes << " min, removing from pendingWorkloads" << std::endl;
-                    it = pendingWorkloads.erase(it);
-                } else {
-                    ++it;
-                }
-            } else {
-                // Container is now visible, remove from pending
-                it = pendingWorkloads.erase(it);
-            }
-        }
+Json::Value DockerController::listContainers(bool all) {
+    bool useApi = engine_.useApi();
+    Json::Value containers;
+    if (useApi && stateCache_.ready()) {
+        containers = listContainersCached(all);
+    } else {
+        containers = useApi ? listContainersApi(all) : listContainersCli(all);
     }
 
-    // After collecting containers from docker ps, enhance with docker inspect
-    for (Json::Value& c : containers) {
-        std::string name = c["names"].asString();
-        if (name.empty()) continue;
-        std::string inspectCmd = "inspect " + name + " --format '{{json .State}}'";
-        std::string inspectOut = executeDockerCommand(inspectCmd);
-        if (!inspectOut.empty()) {
-            Json::Value state;
-            Json::CharReaderBuilder builder;
-            std::string errs;
-            std::istringstream s(inspectOut);
-            if (Json::parseFromStream(builder, s, &state, &errs)) {
-                // Use .State fields for more accurate status
-                if (state.isMember("Running") && state["Running"].asBool()) {
-                    c["status"] = "Running";
-                } else if (state.isMember("Paused") && state["Paused"].asBool()) {
-                    c["status"] = "Paused";
-                } else if (state.isMember("Restarting") && state["Restarting"].asBool()) {
-                    c["status"] = "Restarting";
-                } else if (state.isMember("Dead") && state["Dead"].asBool()) {
-                    c["status"] = "Dead";
-                } else if (state.isMember("Status")) {
-                    std::string st = state["Status"].asString();
-                    if (st == "created") {
-                        c["status"] = "ContainerCreating";
-                    } else if (st == "exited") {
-                        c["status"] = "Exited";
-                    } else if (st == "removing") {
-                        c["status"] = "Removing";
-                    } else if (st == "dead") {
-                        c["status"] = "Dead";
-                    } else if (st == "running") {
-                        c["status"] = "Running";
-                    }
-                }
-                if (state.isMember("Error") && !state["Error"].asString().empty()) {
-                    c["status"] = "ImagePullBackOff";
-                    c["reason"] = state["Error"].asString();
-                }
-            }
+    // Add reason if tracked
+    for (Json::Value &container : containers) {
+        WorkloadRecord record;
+        if (!container.isMember("reason") && workloads_.get(container["names"].asString(), record) && !record.reason.empty()) {
+            container["reason"] = record.reason;
         }
     }
 
-    // --- Track running docker run processes ---
-    {
-        std::lock_guard<std::mutex> lock(runningDockerRunsMutex);
-        for (auto it = runningDockerRuns.begin(); it != runningDockerRuns.end(); ) {
-            pid_t pid = it->first;
-            const std::string& workloadId = it->second;
-            // Check if process is still running
-            if (kill(pid, 0) == 0) { // process exists
-                // Only add if not already in containers
-                bool found = false;
-                for (const auto& c : containers) {
-                    if (c["names"].asString() == workloadId) {
-                        found = true;
-                        break;
+    // After collecting containers from docker ps, enhance with docker inspect.
+    // The API listing already carries the state, so this is CLI-only.
+    if (!useApi) {
+        for (Json::Value& c : containers) {
+            std::string name = c["names"].asString();
+            if (name.empty()) continue;
+            std::string inspectOut = executeDockerCommand({"inspect", name, "--format", "{{json .State}}"});
+            if (!inspectOut.empty()) {
+                Json::Value state;
+                Json::CharReaderBuilder builder;
+                std::string errs;
+                std::istringstream s(inspectOut);
+                if (Json::parseFromStream(builder, s, &state, &errs)) {
+                    // Use .State fields for more accurate status
+                    if (state.isMember("Running") && state["Running"].asBool()) {
+                        c["status"] = "Running";
+                    } else if (state.isMember("Paused") && state["Paused"].asBool()) {
+                        c["status"] = "Paused";
+                    } else if (state.isMember("Restarting") && state["Restarting"].asBool()) {
+                        c["status"] = "Restarting";
+                    } else if (state.isMember("Dead") && state["Dead"].asBool()) {
+                        c["status"] = "Dead";
+                    } else if (state.isMember("Status")) {
+                        std::string st = state["Status"].asString();
+                        if (st == "created") {
+                            c["status"] = "ContainerCreating";
+                        } else if (st == "exited") {
+                            c["status"] = "Exited";
+                        } else if (st == "removing") {
+                            c["status"] = "Removing";
+                        } else if (st == "dead") {
+                            c["status"] = "Dead";
+                        } else if (st == "running") {
+                            c["status"] = "Running";
+                        }
                     }
-                }
-                if (!found) {
-                    Json::Value synthetic;
-                    synthetic["id"] = "";
-                    synthetic["names"] = workloadId;
-                    synthetic["image"] = "";
-                    synthetic["status"] = "Pulling";
-                    synthetic["reason"] = "docker run in progress (tracked by PID)";
-                    synthetic["ports"] = "";
-                    containers.append(synthetic);
-                    std::cout << "[Agent] Workload " << workloadId << " is being pulled/created (PID " << pid << ")" << std::endl;
-                }
-                ++it;
-            } else {
-                // Process is gone, remove from map
-                it = runningDockerRuns.erase(it);
-            }
-        }
-    }
-
-    // Fallback: For any docker run process in ps aux, parse --name and match to a workload
-    std::string psOutput;
-    {
-        std::array<char, 256> buffer;
-        FILE* pipe = popen("ps aux | grep 'docker run' | grep -v grep", "r");
-        if (pipe) {
-            while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-                psOutput += buffer.data();
-            }
-            pclose(pipe);
-        }
-    }
-    std::istringstream psStream(psOutput);
-    std::string psLine;
-    while (std::getline(psStream, psLine)) {
-        size_t namePos = psLine.find("--name");
-        if (namePos != std::string::npos) {
-            std::istringstream iss(psLine.substr(namePos));
-            std::string dummy, containerName;
-            iss >> dummy >> containerName;
-            if (!containerName.empty()) {
-                bool found = false;
-                for (const auto& c : containers) {
-                    if (c["names"].asString() == containerName) {
-                        found = true;
-                        break;
+                    if (state.isMember("Error") && !state["Error"].asString().empty()) {
+                        c["status"] = "ImagePullBackOff";
+                        c["reason"] = state["Error"].asString();
                     }
                 }
-                if (!found) {
-                    Json::Value synthetic;
-                    synthetic["id"] = "";
-                    synthetic["names"] = containerName;
-                    synthetic["image"] = "";
-                    synthetic["status"] = "Pulling";
-                    synthetic["reason"] = "docker run in progress (ps aux fallback)";
-                    synthetic["ports"] = "";
-                    containers.append(synthetic);
-                    std::cout << "[Agent] Container " << containerName << " is being pulled/created (ps aux fallback)" << std::endl;
-                }
             }
         }
     }
@@ -305,17 +503,124 @@ Json::Value DockerController::listContainers(bool all) {
 }
 
 std::string DockerController::removeContainer(const std::string &containerId) {
-    return executeDockerCommand("rm " + containerId);
+    // Accepts a name or an ID; the workload store is keyed by name.
+    ContainerRecord record;
+    std::string name = stateCache_.find(containerId, record) ? record.name : containerId;
+    std::string result;
+    bool missing = false;
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.del("/containers/" + DockerEngineClient::urlEncode(containerId));
+        missing = res.status == 404;
+        result = res.ok() ? containerId + "\n" : res.errorMessage();
+    } else {
+        result = executeDockerCommand({"rm", containerId});
+        missing = result.find("No such container") != std::string::npos;
+    }
+    if (missing) {
+        // A launch that failed before creating its container only exists in
+        // the workload store; removing it is how the record gets cleared.
+        WorkloadRecord workload;
+        if (workloads_.get(name, workload)) {
+            workloads_.remove(name);
+            return name + "\n";
+        }
+        return result;
+    }
+    if (result.find("Error") != std::string::npos) {
+        return result;
+    }
+    workloads_.remove(name);
+    return result;
 }
 
 std::string DockerController::getContainerLogs(const std::string &containerId) {
-    return executeDockerCommand("logs " + containerId);
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.get("/containers/" + DockerEngineClient::urlEncode(containerId) + "/logs?stdout=1&stderr=1");
+        return res.ok() ? demuxLogStream(res) : res.errorMessage();
+    }
+    return executeDockerCommand({"logs", containerId});
+}
+
+bool DockerController::containerExited(const std::string &containerId, int &exitCode) {
+    exitCode = -1;
+    std::string status;
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.get("/containers/" + DockerEngineClient::urlEncode(containerId) + "/json");
+        if (res.status == 404) {
+            return true;
+        }
+        if (!res.ok()) {
+            return false;
+        }
+        Json::Value state = res.json()["State"];
+        status = state["Status"].asString();
+        exitCode = state["ExitCode"].asInt();
+    } else {
+        std::istringstream out(executeDockerCommand({"inspect", "--format", "{{.State.Status}} {{.State.ExitCode}}", containerId}));
+        if (!(out >> status >> exitCode)) {
+            exitCode = -1;
+            return out.str().find("No such") != std::string::npos;
+        }
+    }
+    return status == "exited" || status == "dead";
+}
+
+LogPage DockerController::readContainerLogs(const std::string &containerId, const LogQuery &query) {
+    if (engine_.useApi()) {
+        return logReader_.read(containerId, query);
+    }
+
+    // The CLI has no cursor or follow; --tail keeps the common case small.
+    LogPage page;
+    page.source = "cli";
+    std::vector<std::string> args = {"logs"};
+    if (query.tail >= 0) args.insert(args.end(), {"--tail", std::to_string(query.tail)});
+    if (query.sinceNanos > 0) args.insert(args.end(), {"--since", std::to_string(query.sinceNanos / 1000000000)});
+    if (query.untilNanos > 0) args.insert(args.end(), {"--until", std::to_string((query.untilNanos + 999999999) / 1000000000)});
+    if (query.timestamps) args.push_back("--timestamps");
+    args.push_back(containerId);
+    page.text = executeDockerCommand(args);
+    if (page.text.size() > query.maxBytes) {
+        page.text.resize(query.maxBytes);
+        page.more = true;
+    }
+    page.ended = !page.more;
+    return page;
 }
 
 Json::Value DockerController::listImages(bool all) {
-    std::string format = "--format '{{.ID}}\t{{.Repository}}\t{{.Tag}}\t{{.Size}}'";
-    std::string cmd = "images " + std::string(all ? "-a" : "") + " " + format;
-    std::string rawOutput = executeDockerCommand(cmd);
+    if (engine_.useApi()) {
+        Json::Value images(Json::arrayValue);
+        DockerEngineClient::Response res = engine_.get(std::string("/images/json") + (all ? "?all=1" : ""));
+        if (!res.ok()) {
+            LOG_ERROR << "Failed to list images: " << res.errorMessage();
+            return images;
+        }
+        for (const auto &item : res.json()) {
+            std::string id = item["Id"].asString();
+            if (id.compare(0, 7, "sha256:") == 0) id.erase(0, 7);
+            Json::Value tags = item["RepoTags"];
+            if (!tags.isArray() || tags.empty()) {
+                tags = Json::Value(Json::arrayValue);
+                tags.append("<none>:<none>");
+            }
+            for (const auto &repoTag : tags) {
+                std::string ref = repoTag.asString();
+                size_t colon = ref.rfind(':');
+                Json::Value image;
+                image["id"] = id.substr(0, 12);
+                image["repository"] = ref.substr(0, colon);
+                image["tag"] = colon == std::string::npos ? "" : ref.substr(colon + 1);
+                image["size"] = humanSize(item["Size"].asDouble());
+                images.append(image);
+            }
+        }
+        return images;
+    }
+
+    std::vector<std::string> args = {"images", "--format", "{{.ID}}\\t{{.Repository}}\\t{{.Tag}}\\t{{.Size}}"};
+    if (all) args.push_back("-a");
+    std::string rawOutput = executeDockerCommand(args);
 
     Json::Value images(Json::arrayValue);
     if (rawOutput.empty()) {
@@ -350,20 +655,112 @@ std::string DockerController::pullImage(const std::string &image) {
     if (image.empty()) {
         return "Error: Image name cannot be empty";
     }
-    std::string cmd = "pull " + image;
-    std::string result = executeDockerCommand(cmd);
+    return imagePulls_.pull(image);
+}
+
+bool DockerController::hasImage(const std::string &image) {
+    if (engine_.useApi()) {
+        // Image references never need escaping, and the daemon expects the slashes as-is.
+        return engine_.get("/images/" + image + "/json").ok();
+    }
+    return executeDockerCommand({"image", "inspect", "--format", "{{.Id}}", image}).find("Error") == std::string::npos;
+}
+
+// Runs one pull for the pull manager, which handles coalescing.
+std::string DockerController::pullImageDirect(const std::string &image, const ImagePullManager::ProgressCallback &onProgress) {
+    if (engine_.useApi()) {
+        return pullImageApi(image, onProgress);
+    }
+    std::string result = executeDockerCommand({"pull", image});
     return result.find("Error") == std::string::npos ? "Image pulled successfully" : result;
 }
 
+std::string DockerController::pullImageApi(const std::string &image, const ImagePullManager::ProgressCallback &onProgress) {
+    std::string repository, tag;
+    splitImageReference(image, repository, tag);
+    std::string path = "/images/create?fromImage=" + DockerEngineClient::urlEncode(repository) +
+                       "&tag=" + DockerEngineClient::urlEncode(tag);
+    std::vector<std::string> headers;
+    std::string auth = registryAuthHeader(image);
+    if (!auth.empty()) {
+        headers.push_back("X-Registry-Auth: " + auth);
+    }
+
+    // Progress arrives as one JSON object per line; failures are reported
+    // in-band as {"error": ...} with a 200 status.
+    std::string pending, error;
+    DockerEngineClient::Response res = engine_.stream("POST", path, "", [&](const char *data, size_t len) {
+        pending.append(data, len);
+        size_t nl;
+        while ((nl = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, nl);
+            pending.erase(0, nl + 1);
+            if (!onProgress && line.find("\"error\"") == std::string::npos) continue;
+            Json::Value progress;
+            Json::CharReaderBuilder builder;
+            std::string errs;
+            std::istringstream ls(line);
+            if (!Json::parseFromStream(builder, ls, &progress, &errs)) continue;
+            if (progress.isMember("error")) {
+                error = progress["error"].asString();
+            } else if (onProgress) {
+                onProgress(progress);
+            }
+        }
+        return true;
+    }, 5 * 60 * 1000, headers);
+
+    if (!error.empty()) {
+        return "Error: " + error;
+    }
+    if (!res.ok()) {
+        return res.errorMessage();
+    }
+    return "Image pulled successfully";
+}
+
+std::string DockerController::registryAuthHeader(const std::string &image) {
+    std::lock_guard<std::mutex> lock(registryAuthMutex_);
+    auto it = registryAuth_.find(registryOf(image));
+    return it == registryAuth_.end() ? "" : it->second;
+}
+
 std::string DockerController::loginToRegistry(const std::string &registry, 
                                               const std::string &username, 
                                               const std::string &password) {
     if (registry.empty() || username.empty() || password.empty()) {
         return "Error: Registry, username, and password are required";
     }
-    std::ostringstream cmd;
-    cmd << "login " << registry << " -u " << username << " -p " << password;
-    std::string result = executeDockerCommand(cmd.str());
+    if (engine_.useApi()) {
+        Json::Value authConfig;
+        authConfig["username"] = username;
+        authConfig["password"] = password;
+        authConfig["serveraddress"] = registry;
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        std::string body = Json::writeString(writer, authConfig);
+        DockerEngineClient::Response res = engine_.post("/auth", body);
+        if (!res.ok()) {
+            return res.errorMessage();
+        }
+        // The daemon does not persist credentials like the CLI's config.json
+        // does, so keep them for subsequent pulls from this registry.
+        std::string encoded(4 * ((body.size() + 2) / 3), '\0');
+        EVP_EncodeBlock(reinterpret_cast<unsigned char *>(&encoded[0]),
+                        reinterpret_cast<const unsigned char *>(body.data()), static_cast<int>(body.size()));
+        for (char &c : encoded) {
+            if (c == '+') c = '-';
+            else if (c == '/') c = '_';
+        }
+        std::lock_guard<std::mutex> lock(registryAuthMutex_);
+        registryAuth_[normalizeRegistry(registry)] = encoded;
+        return "Login successful";
+    }
+    // --password-stdin keeps the password out of the process table.
+    std::vector<std::string> argv = {"docker", "login", registry, "-u", username, "--password-stdin"};
+    CommandOptions options;
+    options.input = password;
+    std::string result = commands_.run(argv, options).combined();
     return result.find("Login Succeeded") != std::string::npos ? "Login successful" : result;
 }
 
@@ -383,11 +780,90 @@ std::string DockerController::pullPrivateImage(const std::string &image,
     return pullResult;
 }
 
-Json::Value DockerController::getContainerStats(const std::string &containerId) {
+Json::Value DockerController::getContainerStatsApi(const std::string &containerId) {
+    Json::Value stats;
+    DockerEngineClient::Response res = engine_.get("/containers/" + DockerEngineClient::urlEncode(containerId) + "/stats?stream=false", 10000);
+    if (!res.ok()) {
+        return stats;
+    }
+    Json::Value raw = res.json();
+    const Json::Value &cpu = raw["cpu_stats"];
+    const Json::Value &precpu = raw["precpu_stats"];
+    double cpuDelta = cpu["cpu_usage"]["total_usage"].asDouble() - precpu["cpu_usage"]["total_usage"].asDouble();
+    double systemDelta = cpu["system_cpu_usage"].asDouble() - precpu["system_cpu_usage"].asDouble();
+    double onlineCpus = cpu["online_cpus"].asDouble();
+    if (onlineCpus == 0) onlineCpus = cpu["cpu_usage"]["percpu_usage"].size();
+    stats["cpu_percent"] = cpuDelta > 0 && systemDelta > 0 ? cpuDelta / systemDelta * onlineCpus * 100.0 : 0.0;
+
+    // Same accounting as the CLI: page cache that can be reclaimed is not "used".
+    const Json::Value &memory = raw["memory_stats"];
+    int64_t usage = memory["usage"].asInt64();
+    int64_t inactiveFile = memory["stats"].isMember("inactive_file") ? memory["stats"]["inactive_file"].asInt64()
+                                                                       : memory["stats"]["total_inactive_file"].asInt64();
+    stats["memory_usage"] = static_cast<Json::Int64>(usage > inactiveFile ? usage - inactiveFile : usage);
+    stats["memory_limit"] = memory["limit"].asInt64();
+
+    int64_t rx = 0, tx = 0;
+    Json::Value networks(Json::objectValue);
+    for (const auto &name : raw["networks"].getMemberNames()) {
+        const Json::Value &iface = raw["networks"][name];
+        rx += iface["rx_bytes"].asInt64();
+        tx += iface["tx_bytes"].asInt64();
+        for (const char *key : {"rx_bytes", "rx_packets", "rx_errors", "rx_dropped",
+                                "tx_bytes", "tx_packets", "tx_errors", "tx_dropped"}) {
+            networks[name][key] = iface[key].asUInt64();
+        }
+    }
+    stats["net_rx_bytes"] = static_cast<Json::Int64>(rx);
+    stats["net_tx_bytes"] = static_cast<Json::Int64>(tx);
+    stats["networks"] = networks;
+    return stats;
+}
+
+void DockerController::addNetworkStatsApi(const std::string &containerId, Json::Value &stats) {
+    int64_t rx = 0, tx = 0;
+    // one-shot skips the daemon's second sample, so this returns immediately.
+    DockerEngineClient::Response res = engine_.get("/containers/" + containerId + "/stats?stream=false&one-shot=true", 5000);
+    if (res.ok()) {
+        for (const auto &iface : res.json()["networks"]) {
+            rx += iface["rx_bytes"].asInt64();
+            tx += iface["tx_bytes"].asInt64();
+        }
+    }
+    stats["net_rx_bytes"] = static_cast<Json::Int64>(rx);
+    stats["net_tx_bytes"] = static_cast<Json::Int64>(tx);
+}
+
+void DockerController::pruneContainerStats() {
+    if (!stateCache_.ready()) {
+        return; // an empty table would drop every baseline
+    }
+    std::shared_ptr<const ContainerSnapshot> snapshot = stateCache_.snapshot();
+    std::set<std::string> live;
+    for (const auto &record : snapshot->containers) {
+        live.insert(record.id);
+    }
+    cgroupStats_.retain(live);
+}
+
+Json::Value DockerController::getContainerStats(const std::string &containerId, const std::string &consumer) {
+    // Fast path: read the container's cgroup v2 files directly.
+    ContainerRecord record;
+    if (cgroupStats_.available() && stateCache_.find(containerId, record) && record.state == "running") {
+        Json::Value stats;
+        if (cgroupStats_.read(record.id, record.pid, stats, consumer)) {
+            // Exact per-interface counters from the container's network namespace.
+            if (!NetDevReader::addToStats(record.pid, stats) && engine_.useApi()) {
+                addNetworkStatsApi(record.id, stats);
+            }
+            return stats;
+        }
+    }
+    if (engine_.useApi()) {
+        return getContainerStatsApi(containerId);
+    }
     // Use docker stats --no-stream --format to get stats for a single container
-    std::string format = "--format \"{{.CPUPerc}}\t{{.MemUsage}}\t{{.MemLimit}}\t{{.NetIO}}\"";
-    std::string cmd = "stats --no-stream --format '{{.CPUPerc}}\t{{.MemUsage}}\t{{.MemLimit}}\t{{.NetIO}}' " + containerId;
-    std::string output = executeDockerCommand(cmd);
+    std::string output = executeDockerCommand({"stats", "--no-stream", "--format", "{{.CPUPerc}}\\t{{.MemUsage}}\\t{{.MemLimit}}\\t{{.NetIO}}", containerId});
 
     Json::Value stats;
     if (output.empty()) {
@@ -458,16 +934,21 @@ Json::Value DockerController::getContainerStats(const std::string &containerId)
 }
 
 Json::Value DockerController::getDockerInfo() {
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.get("/info");
+        if (res.ok()) {
+            return res.json();
+        }
+    }
     // Use docker info --format to get running, stopped, and paused containers
-    std::string cmd = "info --format '{{json .}}'";
-    std::string output = executeDockerCommand(cmd);
+    std::string output = executeDockerCommand({"info", "--format", "{{json .}}"});
     Json::Value info;
     Json::CharReaderBuilder builder;
     std::string errs;
     std::istringstream iss(output);
     if (!Json::parseFromStream(builder, iss, &info, &errs)) {
         // Fallback: try to parse from plain text output
-        output = executeDockerCommand("info");
+        output = executeDockerCommand({"info"});
         std::istringstream lines(output);
         std::string line;
         while (std::getline(lines, line)) {
@@ -1,13 +1,27 @@
 #ifndef DOCKER_CONTROLLER_H
 #define DOCKER_CONTROLLER_H
 
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <json/json.h>
+#include "DockerEngineClient.h"
+#include "ContainerStateCache.h"
+#include "CgroupStatsReader.h"
+#include "ContainerLogReader.h"
+#include "ImagePullManager.h"
+#include "CommandRunner.h"
+#include "WorkloadStore.h"
 
 class DockerController {
 public:
-    DockerController();
+    // Reports launch progress: "pulling" or "creating".
+    using PhaseCallback = std::function<void(const std::string &phase)>;
+
+    DockerController(DockerEngineClient& engine, ContainerStateCache& stateCache, CommandRunner& commands,
+                     WorkloadStore& workloads);
     ~DockerController();
 
     std::string startContainer(const std::string &image,
@@ -19,15 +33,23 @@ public:
                               const std::string &network,
                               const std::string &restartPolicy,
                               bool detach,
-                              const std::string &command = "");
+                              const std::string &command = "",
+                              const PhaseCallback &onPhase = nullptr);
 
     std::string stopContainer(const std::string &containerId);
     Json::Value listContainers(bool all = false);
     std::string removeContainer(const std::string &containerId);
     std::string getContainerLogs(const std::string &containerId);
+    // True once the container has stopped (or no longer exists, exitCode -1).
+    bool containerExited(const std::string &containerId, int &exitCode);
+    LogPage readContainerLogs(const std::string &containerId, const LogQuery &query); // One bounded page of logs
     // New functions
     Json::Value listImages(bool all = false);  // List all images, optionally including intermediates
-    std::string pullImage(const std::string &image);  // Pull a public image
+    std::string pullImage(const std::string &image);  // Pull a public image, joining any pull already in flight
+    bool hasImage(const std::string &image);  // Present locally, so a launch will not pull
+    ImagePullManager &imagePulls() { return imagePulls_; }
+    ProcessSupervisor &processes() { return commands_.supervisor(); }
+    WorkloadStore &workloads() { return workloads_; }
     std::string loginToRegistry(const std::string &registry,
                                 const std::string &username,
                                 const std::string &password);  // Login to a registry
@@ -35,11 +57,49 @@ public:
                                  const std::string &registry,
                                  const std::string &username,
                                  const std::string &password);  // Pull a private image
-    Json::Value getContainerStats(const std::string &containerId); // Get stats for a specific container
+    // Stats for a specific container. consumer keeps cpu_percent baselines
+    // apart, so callers at different cadences do not shorten each other's interval.
+    Json::Value getContainerStats(const std::string &containerId, const std::string &consumer = "api");
+    // Drops cached cgroup state for containers no longer in the state cache.
+    void pruneContainerStats();
     Json::Value getDockerInfo(); // Get general Docker daemon info
 
 private:
-    std::string executeDockerCommand(const std::string &command);
+    // Runs `docker <args...>` and returns stdout followed by stderr; tag names the workload it works for.
+    std::string executeDockerCommand(const std::vector<std::string> &args, const std::string &tag = "");
+
+    // Engine API implementations, used whenever engine_.useApi() is true.
+    std::string startContainerApi(const std::string &image,
+                                  const std::string &name,
+                                  const std::vector<std::string> &ports,
+                                  const std::vector<std::string> &envVars,
+                                  const std::vector<std::string> &volumes,
+                                  const std::vector<std::string> &labels,
+                                  const std::string &network,
+                                  const std::string &restartPolicy,
+                                  bool detach,
+                                  const std::string &command,
+                                  const PhaseCallback &onPhase);
+    Json::Value listContainersApi(bool all);
+    Json::Value listContainersCached(bool all);
+    Json::Value listContainersCli(bool all);
+    std::string pullImageDirect(const std::string &image, const ImagePullManager::ProgressCallback &onProgress);
+    std::string pullImageApi(const std::string &image, const ImagePullManager::ProgressCallback &onProgress);
+    Json::Value getContainerStatsApi(const std::string &containerId);
+    void addNetworkStatsApi(const std::string &containerId, Json::Value &stats);
+    std::string registryAuthHeader(const std::string &image);
+
+    DockerEngineClient& engine_;
+    ContainerStateCache& stateCache_;
+    CommandRunner& commands_;
+    WorkloadStore& workloads_;
+    CgroupStatsReader cgroupStats_;
+    ContainerLogReader logReader_;
+    std::mutex registryAuthMutex_;
+    std::map<std::string, std::string> registryAuth_; // registry -> X-Registry-Auth value
+    // Last, so it is destroyed first: its destructor waits for background
+    // pulls, which still read registryAuth_ and the members above.
+    ImagePullManager imagePulls_;
 };
 
 #endif // DOCKER_CONTROLLER_H
@@ -0,0 +1,318 @@
+#include "HeartbeatClient.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+
+namespace {
+
+constexpr long kRequestTimeoutMs = 10000;
+
+int envSeconds(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    if (parsed > 0) {
+        return parsed;
+    }
+    LOG_WARN << "Invalid " << name << ": " << value << ", using default: " << fallback;
+    return fallback;
+}
+
+} // namespace
+
+Json::Value HeartbeatClient::WorkloadStatus::toJson(const std::string& name) const {
+    Json::Value out;
+    out["name"] = name;
+    out["workloadId"] = workloadId;
+    out["state"] = state;
+    if (!reason.empty()) out["reason"] = reason;
+    if (restartCount != 0) out["restartCount"] = restartCount;
+    out["revision"] = static_cast<Json::UInt64>(revision);
+    return out;
+}
+
+HeartbeatClient::HeartbeatClient(const std::string& centralUrl, NodeController& nodeCtrl, SystemController& sysCtrl,
+                                 ContainerStateCache& containerCache, WorkloadStore& workloadStore, ResourceHistory& history)
+    : nodeCtrl_(nodeCtrl), sysCtrl_(sysCtrl), containerCache_(containerCache), workloadStore_(workloadStore), history_(history),
+      http_(centralUrl),
+      fastInterval_(envSeconds("HEARTBEAT_FAST_SECONDS", 15)),
+      slowInterval_(envSeconds("HEARTBEAT_SLOW_SECONDS", 240)),
+      changePercent_(10.0),
+      fullEvery_(static_cast<uint64_t>(envSeconds("HEARTBEAT_FULL_EVERY", 10))),
+      percentileWindow_(std::min(envSeconds("HEARTBEAT_PERCENTILE_SECONDS", 60), 600)),
+      rttSeconds_({0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10}) {
+    if (const char* percent = std::getenv("HEARTBEAT_CHANGE_PERCENT")) {
+        double parsed = std::atof(percent);
+        if (parsed > 0 && parsed <= 100) {
+            changePercent_ = parsed;
+        } else {
+            LOG_WARN << "Invalid HEARTBEAT_CHANGE_PERCENT: " << percent << ", using default: " << changePercent_;
+        }
+    }
+    if (slowInterval_ < fastInterval_) {
+        slowInterval_ = fastInterval_;
+    }
+}
+
+HeartbeatClient::~HeartbeatClient() {
+    stop();
+}
+
+void HeartbeatClient::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&HeartbeatClient::loop, this);
+}
+
+void HeartbeatClient::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void HeartbeatClient::loop() {
+    while (running_) {
+        auto started = std::chrono::steady_clock::now();
+        try {
+            Sample sample = takeSample();
+            bool due = !haveAcked_ || forceFull_ || started - lastBeat_ >= slowInterval_ || changedSignificantly(sample);
+            if (due) {
+                beat(sample);
+            }
+        } catch (const std::exception& e) {
+            LOG_ERROR << "Heartbeat error: " << e.what();
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait_until(lock, started + fastInterval_, [this] { return !running_; });
+    }
+}
+
+HeartbeatClient::Sample HeartbeatClient::takeSample() {
+    Json::Value resources = sysCtrl_.getSystemResources();
+    Sample sample;
+    sample.status = nodeCtrl_.determineStatus(resources);
+    sample.readiness = static_cast<int>(std::lround(nodeCtrl_.capacity().last().score));
+    sample.availableCpu = resources.get("available_cpu", 0.99).asDouble();
+    sample.availableMemory = resources.get("available_memory", 1354).asInt64();
+    sample.totalCpu = resources["total_cpu"].asDouble();
+    sample.totalMemory = resources["total_memory"].asInt64();
+    for (ResourceHistory::Series series : {ResourceHistory::Cpu, ResourceHistory::Memory}) {
+        std::vector<double> values;
+        if (history_.percentiles(series, percentileWindow_, {50, 95, 100}, values)) {
+            Json::Value& entry = sample.recent[ResourceHistory::seriesName(series)];
+            entry["p50"] = static_cast<int>(std::lround(values[0]));
+            entry["p95"] = static_cast<int>(std::lround(values[1]));
+            entry["max"] = static_cast<int>(std::lround(values[2]));
+        }
+    }
+    // Before the first sync an empty table would read as "everything removed".
+    sample.haveWorkloads = containerCache_.ready();
+    if (sample.haveWorkloads) {
+        sample.workloads = takeWorkloadDigest();
+    }
+    return sample;
+}
+
+// Same sources as /docker/list: containers we launched, plus launches that
+// are still pending or failed before creating one.
+HeartbeatClient::WorkloadDigest HeartbeatClient::takeWorkloadDigest() {
+    WorkloadDigest digest;
+    std::shared_ptr<const ContainerSnapshot> containers = containerCache_.snapshot();
+    for (const auto& container : containers->containers) {
+        auto workloadId = container.labels.find("workloadId");
+        if (workloadId == container.labels.end()) {
+            continue;
+        }
+        WorkloadStatus& entry = digest[container.name];
+        entry.workloadId = workloadId->second;
+        entry.state = container.state;
+        entry.reason = container.error;
+        entry.restartCount = container.restartCount;
+    }
+    for (const auto& record : workloadStore_.snapshot()) {
+        if (digest.count(record.name) || (!record.pending() && record.state != "failed")) {
+            continue;
+        }
+        WorkloadStatus& entry = digest[record.name];
+        entry.workloadId = record.workloadId;
+        entry.state = record.state;
+        entry.reason = record.reason;
+    }
+
+    for (auto& entry : digest) {
+        auto previous = sampled_.find(entry.first);
+        bool unchanged = previous != sampled_.end() && previous->second.sameAs(entry.second);
+        entry.second.revision = unchanged ? previous->second.revision : ++digestRevision_;
+    }
+    sampled_ = digest;
+    trackedWorkloads_ = digest.size();
+    return digest;
+}
+
+bool HeartbeatClient::changedSignificantly(const Sample& sample) const {
+    if (sample.status != acked_.status || std::abs(sample.readiness - acked_.readiness) > changePercent_) {
+        return true;
+    }
+    if (sample.haveWorkloads) {
+        if (!acked_.haveWorkloads || sample.workloads.size() != acked_.workloads.size()) {
+            return true;
+        }
+        for (const auto& entry : sample.workloads) {
+            auto acked = acked_.workloads.find(entry.first);
+            if (acked == acked_.workloads.end() || acked->second.revision != entry.second.revision) {
+                return true;
+            }
+        }
+    }
+    // Moves are measured against the node's size so that small nodes and big
+    // nodes react to the same share of their capacity.
+    if (sample.totalCpu > 0 &&
+        std::fabs(sample.availableCpu - acked_.availableCpu) * 100.0 / sample.totalCpu > changePercent_) {
+        return true;
+    }
+    if (sample.totalMemory > 0 &&
+        std::llabs(sample.availableMemory - acked_.availableMemory) * 100.0 / sample.totalMemory > changePercent_) {
+        return true;
+    }
+    return false;
+}
+
+Json::Value HeartbeatClient::fields(const Sample& sample) const {
+    Json::Value out;
+    out["status"] = sample.status;
+    out["readiness"] = sample.readiness;
+    out["availableCpu"] = sample.availableCpu;
+    out["availableMemory"] = static_cast<Json::Int64>(sample.availableMemory);
+    if (!sample.recent.isNull()) {
+        out["recent"] = sample.recent;
+    }
+    return out;
+}
+
+void HeartbeatClient::beat(const Sample& sample) {
+    Json::Value current = fields(sample);
+    bool full = forceFull_ || !haveAcked_ || sinceFull_ + 1 >= fullEvery_;
+
+    Json::Value heartbeat;
+    heartbeat["nodeId"] = nodeCtrl_.getNodeId();
+    heartbeat["seq"] = static_cast<Json::UInt64>(++seq_);
+    heartbeat["full"] = full;
+    if (!full) {
+        heartbeat["baseSeq"] = static_cast<Json::UInt64>(ackedSeq_);
+    }
+    for (const auto& key : current.getMemberNames()) {
+        if (full || current[key] != ackedFields_[key]) {
+            heartbeat[key] = current[key];
+        }
+    }
+
+    size_t workloadEntries = 0;
+    if (sample.haveWorkloads) {
+        // The whole table when central may not have a usable one, else only what moved.
+        bool complete = full || !acked_.haveWorkloads;
+        Json::Value workloads(Json::arrayValue);
+        for (const auto& entry : sample.workloads) {
+            auto acked = acked_.workloads.find(entry.first);
+            if (complete || acked == acked_.workloads.end() || acked->second.revision != entry.second.revision) {
+                workloads.append(entry.second.toJson(entry.first));
+            }
+        }
+        Json::Value removed(Json::arrayValue);
+        if (!complete) {
+            for (const auto& entry : acked_.workloads) {
+                if (!sample.workloads.count(entry.first)) removed.append(entry.first);
+            }
+        }
+        workloadEntries = workloads.size() + removed.size();
+        if (complete || !workloads.empty()) heartbeat["workloads"] = workloads;
+        if (complete) heartbeat["workloadsComplete"] = true;
+        if (!removed.empty()) heartbeat["removedWorkloads"] = removed;
+    }
+
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    std::string payload = Json::writeString(writer, heartbeat);
+    lastPayloadBytes_ = payload.size();
+
+    auto now = std::chrono::steady_clock::now();
+    if (lastBeat_.time_since_epoch().count() != 0) {
+        lastIntervalSeconds_ = std::chrono::duration<double>(now - lastBeat_).count();
+    }
+    lastBeat_ = now;
+
+    HttpClient::Response response = http_.post("/nodes/heartbeat", payload, kRequestTimeoutMs);
+    if (response.error.empty()) {
+        rttSeconds_.observe(response.seconds);
+    }
+
+    bool resync = response.status == 409;
+    if (response.ok() && !response.body.empty()) {
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value reply;
+        std::string errs;
+        if (reader->parse(response.body.data(), response.body.data() + response.body.size(), &reply, &errs) &&
+            reply.isObject() && reply["resync"].asBool()) {
+            resync = true;
+        }
+    }
+
+    if (!response.ok() || resync) {
+        ++(full ? fullFailed_ : deltaFailed_);
+        uint64_t failures = ++consecutiveFailures_;
+        forceFull_ = true;
+        if (resync) {
+            LOG_INFO << "Central asked node " << heartbeat["nodeId"].asString() << " for a full heartbeat";
+        } else if (failures == 1 || failures % 10 == 0) {
+            LOG_WARN << "Heartbeat failed for node " << heartbeat["nodeId"].asString() << ": "
+                     << (response.error.empty() ? "OK" : response.error) << ", HTTP " << response.status
+                     << " (" << failures << " in a row)";
+        }
+        return;
+    }
+
+    ++(full ? fullOk_ : deltaOk_);
+    workloadEntriesSent_ += workloadEntries;
+    if (consecutiveFailures_.exchange(0) > 0) {
+        LOG_INFO << "Heartbeats to central recovered";
+    }
+    lastSuccessUnix_ = static_cast<int64_t>(std::time(nullptr));
+    acked_ = sample;
+    ackedFields_ = current;
+    ackedSeq_ = seq_;
+    haveAcked_ = true;
+    forceFull_ = false;
+    sinceFull_ = full ? 0 : sinceFull_ + 1;
+    if (full) {
+        LOG_INFO << "Sent full heartbeat for node " << heartbeat["nodeId"].asString() << " (seq " << seq_ << ")";
+    }
+}
+
+void HeartbeatClient::exportMetrics(MetricsRegistry& registry) const {
+    const char* help = "Heartbeats sent to central, by payload kind and result";
+    registry.counter("persys_heartbeats_total", help, {{"kind", "full"}, {"result", "success"}}, static_cast<double>(fullOk_.load()));
+    registry.counter("persys_heartbeats_total", help, {{"kind", "full"}, {"result", "failure"}}, static_cast<double>(fullFailed_.load()));
+    registry.counter("persys_heartbeats_total", help, {{"kind", "delta"}, {"result", "success"}}, static_cast<double>(deltaOk_.load()));
+    registry.counter("persys_heartbeats_total", help, {{"kind", "delta"}, {"result", "failure"}}, static_cast<double>(deltaFailed_.load()));
+    registry.gauge("persys_heartbeat_consecutive_failures", "Heartbeats failed since the last one central accepted", {},
+                   static_cast<double>(consecutiveFailures_.load()));
+    registry.gauge("persys_heartbeat_last_success_timestamp_seconds", "Unix time of the last heartbeat central accepted", {},
+                   static_cast<double>(lastSuccessUnix_.load()));
+    registry.gauge("persys_heartbeat_interval_seconds", "Time between the last two heartbeats", {}, lastIntervalSeconds_.load());
+    registry.gauge("persys_heartbeat_payload_bytes", "Size of the last heartbeat body", {}, static_cast<double>(lastPayloadBytes_.load()));
+    registry.gauge("persys_heartbeat_workloads", "Workloads in the heartbeat status digest", {}, static_cast<double>(trackedWorkloads_.load()));
+    registry.counter("persys_heartbeat_workload_entries_total", "Workload digest entries (changed or removed) delivered to central", {},
+                     static_cast<double>(workloadEntriesSent_.load()));
+    registry.counter("persys_heartbeat_connections_total", "Connections opened to central for heartbeats; stays flat while keep-alive holds", {},
+                     static_cast<double>(http_.connectionsOpened()));
+    registry.histogram("persys_heartbeat_rtt_seconds", "Heartbeat round-trip time, including any connection setup", {}, rttSeconds_);
+}
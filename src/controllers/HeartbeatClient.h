@@ -0,0 +1,126 @@
+#ifndef HEARTBEAT_CLIENT_H
+#define HEARTBEAT_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <json/json.h>
+#include "ContainerStateCache.h"
+#include "HttpClient.h"
+#include "MetricsRegistry.h"
+#include "NodeController.h"
+#include "ResourceHistory.h"
+#include "SystemController.h"
+#include "WorkloadStore.h"
+
+// Sends heartbeats to central over one kept-alive connection. Resources are
+// sampled every HEARTBEAT_FAST_SECONDS and a beat goes out as soon as status
+// changes or available CPU/memory moves by more than HEARTBEAT_CHANGE_PERCENT
+// of the node's total; while nothing changes, beats are HEARTBEAT_SLOW_SECONDS
+// apart. Each beat carries a sequence number and, unless it is a full beat,
+// only the fields that differ from the last beat central acknowledged
+// ("baseSeq"). A full beat is sent first, after any failure, when central
+// answers 409 or {"resync": true}, and every HEARTBEAT_FULL_EVERY beats.
+//
+// Beats also carry a digest of workload state, so central does not have to
+// poll /docker/list: one entry per workload container (from the container
+// cache) or per launch that has no container yet (from the workload store).
+// Full beats list every entry under "workloads"; deltas list the entries
+// that changed plus the names in "removedWorkloads". Any change in the
+// digest triggers a beat at the next sample.
+//
+// "recent" summarises the last HEARTBEAT_PERCENTILE_SECONDS of the resource
+// history (p50, p95 and max of CPU and memory use, whole percent), so central
+// sees spikes that fall between beats. It rides along in every beat but does
+// not trigger one.
+class HeartbeatClient {
+public:
+    HeartbeatClient(const std::string& centralUrl, NodeController& nodeCtrl, SystemController& sysCtrl,
+                    ContainerStateCache& containerCache, WorkloadStore& workloadStore, ResourceHistory& history);
+    ~HeartbeatClient();
+
+    void start();
+    void stop();
+
+    void exportMetrics(MetricsRegistry& registry) const;
+
+private:
+    struct WorkloadStatus {
+        std::string workloadId;
+        std::string state;        // container state, or the launch state before there is one
+        std::string reason;
+        int restartCount = 0;
+        uint64_t revision = 0;    // bumped by this client whenever the entry changes
+
+        bool sameAs(const WorkloadStatus& other) const {
+            return workloadId == other.workloadId && state == other.state && reason == other.reason &&
+                   restartCount == other.restartCount;
+        }
+        Json::Value toJson(const std::string& name) const;
+    };
+    using WorkloadDigest = std::map<std::string, WorkloadStatus>; // by container name
+
+    struct Sample {
+        std::string status;
+        int readiness = 0;          // whole points, so noise below one point sends nothing
+        double availableCpu = 0;
+        int64_t availableMemory = 0;
+        double totalCpu = 0;
+        int64_t totalMemory = 0;
+        Json::Value recent;         // percentiles from the resource history, null without data
+        bool haveWorkloads = false; // false until the container cache has synced
+        WorkloadDigest workloads;
+    };
+
+    void loop();
+    Sample takeSample();
+    WorkloadDigest takeWorkloadDigest();
+    bool changedSignificantly(const Sample& sample) const;
+    Json::Value fields(const Sample& sample) const;
+    void beat(const Sample& sample);
+
+    NodeController& nodeCtrl_;
+    SystemController& sysCtrl_;
+    ContainerStateCache& containerCache_;
+    WorkloadStore& workloadStore_;
+    ResourceHistory& history_;
+    HttpClient http_;
+    std::chrono::seconds fastInterval_;
+    std::chrono::seconds slowInterval_;
+    double changePercent_;
+    uint64_t fullEvery_;
+    int64_t percentileWindow_;
+
+    // Loop thread only.
+    Sample acked_;                  // what central last acknowledged
+    Json::Value ackedFields_;
+    bool haveAcked_ = false;
+    bool forceFull_ = true;
+    uint64_t seq_ = 0;
+    uint64_t ackedSeq_ = 0;
+    uint64_t sinceFull_ = 0;
+    std::chrono::steady_clock::time_point lastBeat_;
+    WorkloadDigest sampled_;        // previous sample, to carry revisions over
+    uint64_t digestRevision_ = 0;
+
+    MetricsRegistry::Histogram rttSeconds_;
+    std::atomic<uint64_t> fullOk_{0}, fullFailed_{0}, deltaOk_{0}, deltaFailed_{0};
+    std::atomic<uint64_t> consecutiveFailures_{0};
+    std::atomic<uint64_t> lastPayloadBytes_{0};
+    std::atomic<uint64_t> workloadEntriesSent_{0};
+    std::atomic<uint64_t> trackedWorkloads_{0};
+    std::atomic<double> lastIntervalSeconds_{0};
+    std::atomic<int64_t> lastSuccessUnix_{0};
+
+    std::atomic<bool> running_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+};
+
+#endif // HEARTBEAT_CLIENT_H
@@ -0,0 +1,238 @@
+#include "ImagePullManager.h"
+#include "Logger.h"
+#include <thread>
+#include <uuid/uuid.h>
+
+namespace {
+
+constexpr size_t kFinishedPullsKept = 256;
+
+std::string newPullId() {
+    uuid_t uuid;
+    uuid_generate_random(uuid);
+    char uuidStr[37];
+    uuid_unparse(uuid, uuidStr);
+    return std::string(uuidStr);
+}
+
+int64_t unixMillis(std::chrono::system_clock::time_point t) {
+    if (t.time_since_epoch().count() == 0) return 0;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+
+} // namespace
+
+Json::Value ImagePullStatus::toJson() const {
+    Json::Value out;
+    out["pullId"] = id;
+    out["image"] = reference;
+    out["state"] = state;
+    out["message"] = message;
+    out["error"] = error;
+    out["version"] = static_cast<Json::UInt64>(version);
+    out["waiters"] = waiters;
+    out["bytesDownloaded"] = static_cast<Json::Int64>(bytesDownloaded);
+    out["bytesTotal"] = static_cast<Json::Int64>(bytesTotal);
+    out["startedAt"] = static_cast<Json::Int64>(unixMillis(startedAt));
+    out["finishedAt"] = static_cast<Json::Int64>(unixMillis(finishedAt));
+    out["layers"] = Json::Value(Json::objectValue);
+    for (const auto &entry : layers) {
+        Json::Value layer;
+        layer["status"] = entry.second.status;
+        layer["current"] = static_cast<Json::Int64>(entry.second.current);
+        layer["total"] = static_cast<Json::Int64>(entry.second.total);
+        out["layers"][entry.first] = layer;
+    }
+    return out;
+}
+
+ImagePullManager::ImagePullManager(PullFunction pull)
+    : pull_(std::move(pull)), durationSeconds_({1, 5, 10, 30, 60, 120, 300, 600, 1200}) {}
+
+ImagePullManager::~ImagePullManager() {
+    // Background pulls reference this object; let them finish.
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return background_ == 0; });
+}
+
+std::string ImagePullManager::normalizeReference(const std::string &image) {
+    std::string name;
+    std::string suffix;
+    size_t at = image.find('@');
+    if (at != std::string::npos) {
+        name = image.substr(0, at);
+        suffix = image.substr(at);
+    } else {
+        size_t slash = image.rfind('/');
+        size_t colon = image.rfind(':');
+        if (colon != std::string::npos && (slash == std::string::npos || colon > slash)) {
+            name = image.substr(0, colon);
+            suffix = image.substr(colon);
+        } else {
+            name = image;
+            suffix = ":latest";
+        }
+    }
+
+    size_t slash = name.find('/');
+    std::string first = slash == std::string::npos ? "" : name.substr(0, slash);
+    bool hasRegistry = !first.empty() &&
+                       (first.find('.') != std::string::npos || first.find(':') != std::string::npos || first == "localhost");
+    if (hasRegistry && (first == "index.docker.io" || first == "registry-1.docker.io")) {
+        name = name.substr(slash + 1);
+        hasRegistry = false;
+    }
+    if (!hasRegistry) {
+        // Official images live under library/ on Docker Hub
+        name = "docker.io/" + std::string(name.find('/') == std::string::npos ? "library/" : "") + name;
+    }
+    return name + suffix;
+}
+
+std::shared_ptr<ImagePullManager::Flight> ImagePullManager::join(const std::string &image, bool &leader) {
+    std::string reference = normalizeReference(image);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = inFlight_.find(reference);
+    if (it != inFlight_.end()) {
+        leader = false;
+        ++it->second->status.waiters;
+        ++it->second->status.version;
+        ++coalescedTotal_;
+        return it->second;
+    }
+    leader = true;
+    auto flight = std::make_shared<Flight>();
+    flight->status.id = newPullId();
+    flight->status.reference = reference;
+    flight->status.state = "pulling";
+    flight->status.startedAt = std::chrono::system_clock::now();
+    inFlight_[reference] = flight;
+    byId_[flight->status.id] = flight;
+    return flight;
+}
+
+void ImagePullManager::onProgress(Flight &flight, const Json::Value &progress) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ImagePullStatus &status = flight.status;
+    std::string layerId = progress["id"].asString();
+    std::string text = progress["status"].asString();
+    const Json::Value &detail = progress["progressDetail"];
+
+    // "Pulling from library/nginx" carries the tag as its id; it describes
+    // the image, not a layer.
+    if (layerId.empty() || text.compare(0, 12, "Pulling from") == 0) {
+        if (!text.empty()) status.message = text;
+    } else {
+        LayerProgress &layer = status.layers[layerId];
+        layer.status = text;
+        if (detail.isObject() && detail.isMember("current")) {
+            layer.current = detail["current"].asInt64();
+            layer.total = detail["total"].asInt64();
+            if (text == "Downloading") {
+                layer.downloaded = layer.current;
+            }
+        }
+        if (text == "Download complete" && layer.total > 0) {
+            layer.downloaded = layer.total;
+        }
+        status.bytesDownloaded = 0;
+        status.bytesTotal = 0;
+        for (const auto &entry : status.layers) {
+            status.bytesDownloaded += entry.second.downloaded;
+            status.bytesTotal += entry.second.total;
+        }
+    }
+    ++status.version;
+    changed_.notify_all();
+}
+
+void ImagePullManager::run(const std::shared_ptr<Flight> &flight) {
+    std::string result;
+    try {
+        result = pull_(flight->status.reference, [this, &flight](const Json::Value &progress) { onProgress(*flight, progress); });
+    } catch (const std::exception &e) {
+        result = std::string("Error: ") + e.what();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ImagePullStatus &status = flight->status;
+    bool failed = result.find("Error") != std::string::npos;
+    status.state = failed ? "failed" : "succeeded";
+    if (failed) status.error = result;
+    status.finishedAt = std::chrono::system_clock::now();
+    ++status.version;
+    flight->result = result;
+    flight->done = true;
+
+    if (failed) ++failedTotal_;
+    else ++succeededTotal_;
+    bytesPulledTotal_ += static_cast<uint64_t>(status.bytesDownloaded);
+    durationSeconds_.observe(std::chrono::duration<double>(status.finishedAt - status.startedAt).count());
+    LOG_INFO << "Image pull " << status.reference << " " << status.state << " after "
+             << std::chrono::duration_cast<std::chrono::seconds>(status.finishedAt - status.startedAt).count()
+             << "s, " << status.waiters << " waiter(s)";
+
+    inFlight_.erase(status.reference);
+    finishedOrder_.push_back(status.id);
+    while (finishedOrder_.size() > kFinishedPullsKept) {
+        byId_.erase(finishedOrder_.front());
+        finishedOrder_.pop_front();
+    }
+    changed_.notify_all();
+}
+
+std::string ImagePullManager::pull(const std::string &image) {
+    bool leader = false;
+    std::shared_ptr<Flight> flight = join(image, leader);
+    if (leader) {
+        run(flight);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&flight] { return flight->done; });
+    return flight->result;
+}
+
+std::string ImagePullManager::startPull(const std::string &image, bool &coalesced) {
+    bool leader = false;
+    std::shared_ptr<Flight> flight = join(image, leader);
+    coalesced = !leader;
+    if (leader) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++background_;
+        }
+        std::thread([this, flight]() {
+            run(flight);
+            std::lock_guard<std::mutex> lock(mutex_);
+            --background_;
+            changed_.notify_all();
+        }).detach();
+    }
+    return flight->status.id;
+}
+
+bool ImagePullManager::status(const std::string &pullId, ImagePullStatus &out, uint64_t afterVersion, int waitMs) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = byId_.find(pullId);
+    if (it == byId_.end()) {
+        return false;
+    }
+    std::shared_ptr<Flight> flight = it->second;
+    if (waitMs > 0) {
+        changed_.wait_for(lock, std::chrono::milliseconds(waitMs), [&flight, afterVersion] {
+            return flight->done || flight->status.version > afterVersion;
+        });
+    }
+    out = flight->status;
+    return true;
+}
+
+void ImagePullManager::exportMetrics(MetricsRegistry &registry) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    registry.gauge("persys_image_pulls_in_flight", "Image pulls currently running", {}, static_cast<double>(inFlight_.size()));
+    registry.counter("persys_image_pulls_total", "Image pulls finished, by outcome", {{"result", "succeeded"}}, static_cast<double>(succeededTotal_));
+    registry.counter("persys_image_pulls_total", "Image pulls finished, by outcome", {{"result", "failed"}}, static_cast<double>(failedTotal_));
+    registry.counter("persys_image_pull_coalesced_total", "Pull requests that attached to a pull already in flight", {}, static_cast<double>(coalescedTotal_));
+    registry.counter("persys_image_pull_bytes_total", "Layer bytes downloaded by finished image pulls", {}, static_cast<double>(bytesPulledTotal_));
+    registry.histogram("persys_image_pull_duration_seconds", "Wall time of image pulls", {}, durationSeconds_);
+}
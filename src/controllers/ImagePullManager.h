@@ -0,0 +1,95 @@
+#ifndef IMAGE_PULL_MANAGER_H
+#define IMAGE_PULL_MANAGER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <json/json.h>
+#include "MetricsRegistry.h"
+
+struct LayerProgress {
+    std::string status;      // last daemon status for the layer, e.g. Downloading, Pull complete
+    int64_t current = 0;     // progress within the current step
+    int64_t total = 0;
+    int64_t downloaded = 0;  // bytes fetched from the registry
+};
+
+struct ImagePullStatus {
+    std::string id;
+    std::string reference;   // normalized, e.g. docker.io/library/nginx:latest
+    std::string state;       // pulling, succeeded, failed
+    std::string message;     // last image-level status line
+    std::string error;
+    uint64_t version = 0;    // bumped on every progress update
+    int waiters = 1;         // callers attached to this pull
+    int64_t bytesDownloaded = 0;
+    int64_t bytesTotal = 0;  // sum of the layer sizes announced so far
+    std::map<std::string, LayerProgress> layers;
+    std::chrono::system_clock::time_point startedAt;
+    std::chrono::system_clock::time_point finishedAt;
+
+    Json::Value toJson() const;
+};
+
+// Coalesces image pulls: every caller asking for the same normalized
+// reference while a pull is in flight attaches to it and shares its result
+// and per-layer progress, instead of starting another download of the same
+// layers.
+class ImagePullManager {
+public:
+    // Receives each progress object the daemon streams during a pull.
+    using ProgressCallback = std::function<void(const Json::Value &progress)>;
+    // Performs one pull; returns "Image pulled successfully" or "Error: ...".
+    using PullFunction = std::function<std::string(const std::string &reference, const ProgressCallback &onProgress)>;
+
+    explicit ImagePullManager(PullFunction pull);
+    ~ImagePullManager();
+
+    // Pulls on the calling thread, or waits for the pull already in flight.
+    std::string pull(const std::string &image);
+    // Starts (or joins) a pull in the background and returns its pull ID.
+    std::string startPull(const std::string &image, bool &coalesced);
+
+    // Copies the pull's status. With waitMs > 0, first waits until its
+    // version exceeds afterVersion or it finishes (long polling).
+    bool status(const std::string &pullId, ImagePullStatus &out, uint64_t afterVersion = 0, int waitMs = 0);
+
+    void exportMetrics(MetricsRegistry &registry) const;
+
+    // "nginx" -> "docker.io/library/nginx:latest"
+    static std::string normalizeReference(const std::string &image);
+
+private:
+    struct Flight {
+        ImagePullStatus status;
+        std::string result;
+        bool done = false;
+    };
+
+    std::shared_ptr<Flight> join(const std::string &image, bool &leader);
+    void run(const std::shared_ptr<Flight> &flight);
+    void onProgress(Flight &flight, const Json::Value &progress);
+
+    PullFunction pull_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::map<std::string, std::shared_ptr<Flight>> inFlight_; // reference -> pull
+    std::map<std::string, std::shared_ptr<Flight>> byId_;     // pull ID -> pull, including finished ones
+    std::deque<std::string> finishedOrder_;
+    int background_ = 0;                                       // detached startPull() threads still running
+
+    uint64_t succeededTotal_ = 0;
+    uint64_t failedTotal_ = 0;
+    uint64_t coalescedTotal_ = 0;
+    uint64_t bytesPulledTotal_ = 0;
+    MetricsRegistry::Histogram durationSeconds_;
+};
+
+#endif // IMAGE_PULL_MANAGER_H
@@ -0,0 +1,384 @@
+#include "LaunchQueue.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstdlib>
+#include <uuid/uuid.h>
+
+namespace {
+
+constexpr size_t kFinishedJobsKept = 1024;
+constexpr size_t kAttachedOutputBytes = 64 * 1024;
+constexpr auto kAttachedPollInterval = std::chrono::seconds(5);
+
+std::string newJobId() {
+    uuid_t uuid;
+    uuid_generate_random(uuid);
+    char uuidStr[37];
+    uuid_unparse(uuid, uuidStr);
+    return std::string(uuidStr);
+}
+
+size_t envSize(const char* name, size_t fallback) {
+    if (const char* value = std::getenv(name)) {
+        long parsed = std::atol(value);
+        if (parsed > 0) {
+            return static_cast<size_t>(parsed);
+        }
+        LOG_WARN << "Invalid " << name << ": " << value << ", using default: " << fallback;
+    }
+    return fallback;
+}
+
+int64_t unixMillis(std::chrono::system_clock::time_point t) {
+    if (t.time_since_epoch().count() == 0) return 0;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+}
+
+// Detached launches print the container ID last (after any pull output);
+// anything else is an error from the daemon or the CLI.
+bool launchSucceeded(const std::string& result, std::string& containerId) {
+    size_t end = result.find_last_not_of(" \r\n");
+    if (end == std::string::npos) {
+        return false;
+    }
+    size_t start = result.find_last_of('\n', end);
+    start = start == std::string::npos ? 0 : start + 1;
+    std::string lastLine = result.substr(start, end - start + 1);
+    if (lastLine.size() != 64 || lastLine.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        return false;
+    }
+    containerId = lastLine;
+    return true;
+}
+
+double secondsBetween(std::chrono::system_clock::time_point from, std::chrono::system_clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+} // namespace
+
+Json::Value LaunchJob::toJson() const {
+    Json::Value out;
+    out["jobId"] = id;
+    if (!batchId.empty()) out["batchId"] = batchId;
+    out["workloadId"] = workloadId;
+    out["name"] = name;
+    out["image"] = image;
+    out["state"] = state;
+    out["result"] = result;
+    out["queuedAt"] = static_cast<Json::Int64>(unixMillis(queuedAt));
+    out["startedAt"] = static_cast<Json::Int64>(unixMillis(startedAt));
+    out["finishedAt"] = static_cast<Json::Int64>(unixMillis(finishedAt));
+    if (attached) {
+        out["exited"] = exited;
+        if (exited) {
+            out["exitCode"] = exitCode;
+            out["output"] = output;
+        }
+    }
+    return out;
+}
+
+LaunchQueue::LaunchQueue(DockerController& dockerCtrl, WorkloadStore& workloads)
+    : dockerCtrl_(dockerCtrl),
+      workloads_(workloads),
+      concurrency_(envSize("LAUNCH_CONCURRENCY", 4)),
+      capacity_(envSize("LAUNCH_QUEUE_CAPACITY", 1024)),
+      waitSeconds_({0.01, 0.1, 0.5, 1, 5, 15, 30, 60, 120, 300, 600}),
+      launchSeconds_({0.1, 0.5, 1, 2.5, 5, 10, 30, 60, 120, 300, 600}) {}
+
+LaunchQueue::~LaunchQueue() {
+    stop();
+}
+
+void LaunchQueue::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    for (size_t i = 0; i < concurrency_; ++i) {
+        workers_.emplace_back(&LaunchQueue::worker, this);
+    }
+    watcher_ = std::thread(&LaunchQueue::watchAttached, this);
+}
+
+void LaunchQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    ready_.notify_all();
+    watchWake_.notify_all();
+    // Workers finish the launch they are on; queued jobs are dropped.
+    // Attached containers keep running; their exits are no longer collected.
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+    workers_.clear();
+    if (watcher_.joinable()) watcher_.join();
+}
+
+std::string LaunchQueue::submit(const LaunchRequest& request) {
+    std::vector<std::string> jobIds;
+    return enqueue({request}, "", 0, jobIds) ? jobIds.front() : "";
+}
+
+std::string LaunchQueue::submitBatch(const std::vector<LaunchRequest>& requests, size_t maxParallel,
+                                     std::vector<std::string>& jobIds) {
+    std::string batchId = newJobId();
+    return enqueue(requests, batchId, maxParallel, jobIds) ? batchId : "";
+}
+
+bool LaunchQueue::enqueue(const std::vector<LaunchRequest>& requests, const std::string& batchId, size_t maxParallel,
+                          std::vector<std::string>& jobIds) {
+    std::vector<LaunchJob> jobs;
+    jobs.reserve(requests.size());
+    auto now = std::chrono::system_clock::now();
+    for (const auto& request : requests) {
+        LaunchJob job;
+        job.id = newJobId();
+        job.batchId = batchId;
+        job.workloadId = request.workloadId;
+        job.name = request.name;
+        job.image = request.image;
+        job.state = "queued";
+        job.queuedAt = now;
+        jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() + reserved_ + jobs.size() > capacity_) {
+            rejectedTotal_ += jobs.size();
+            return false;
+        }
+        submittedTotal_ += jobs.size();
+        reserved_ += jobs.size();
+        for (const auto& job : jobs) {
+            jobs_[job.id] = job;
+        }
+        if (maxParallel > 0) {
+            BatchLimit& limit = batches_[batchId];
+            limit.maxParallel = maxParallel;
+            limit.remaining = jobs.size();
+        }
+    }
+
+    // Recorded before a worker can see the jobs, so "queued" never lands after a later phase.
+    for (const auto& job : jobs) {
+        WorkloadRecord record;
+        record.name = job.name;
+        record.workloadId = job.workloadId;
+        record.image = job.image;
+        record.jobId = job.id;
+        record.state = job.state;
+        record.reason = "waiting for a launch worker";
+        workloads_.update(record);
+    }
+
+    jobIds.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reserved_ -= jobs.size();
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            queue_.push_back({jobs[i].id, batchId, requests[i]});
+            jobIds.push_back(jobs[i].id);
+        }
+    }
+    if (jobs.size() == 1) {
+        ready_.notify_one();
+    } else {
+        ready_.notify_all();
+    }
+    return true;
+}
+
+std::deque<LaunchQueue::QueuedLaunch>::iterator LaunchQueue::nextRunnable() {
+    for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+        auto limit = batches_.find(it->batchId);
+        if (limit == batches_.end() || limit->second.running < limit->second.maxParallel) {
+            return it;
+        }
+    }
+    return queue_.end();
+}
+
+bool LaunchQueue::job(const std::string& jobId, LaunchJob& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(jobId);
+    if (it == jobs_.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+std::vector<LaunchJob> LaunchQueue::inFlight() const {
+    std::vector<LaunchJob> out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : jobs_) {
+        if (!entry.second.finished()) {
+            out.push_back(entry.second);
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const LaunchJob& a, const LaunchJob& b) { return a.queuedAt < b.queuedAt; });
+    return out;
+}
+
+void LaunchQueue::setState(const std::string& jobId, const std::string& state, const std::string& result) {
+    WorkloadRecord record;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(jobId);
+        if (it == jobs_.end()) {
+            return;
+        }
+        LaunchJob& job = it->second;
+        job.state = state;
+        record.name = job.name;
+        record.jobId = job.id;
+        if (job.finished()) {
+            job.result = result;
+            job.finishedAt = std::chrono::system_clock::now();
+            if (state == "running") ++runningTotal_;
+            else ++failedTotal_;
+            launchSeconds_.observe(secondsBetween(job.startedAt, job.finishedAt));
+
+            finishedOrder_.push_back(jobId);
+            while (finishedOrder_.size() > kFinishedJobsKept) {
+                jobs_.erase(finishedOrder_.front());
+                finishedOrder_.pop_front();
+            }
+        }
+    }
+
+    // Journaled outside the queue lock so disk writes never stall submit().
+    record.state = state;
+    if (state == "pulling") record.reason = "pulling image";
+    else if (state == "creating") record.reason = "creating container";
+    else if (state == "failed") record.reason = result;
+    workloads_.update(record);
+}
+
+void LaunchQueue::worker() {
+    for (;;) {
+        std::string jobId;
+        std::string batchId;
+        LaunchRequest request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto next = queue_.end();
+            ready_.wait(lock, [this, &next] {
+                if (!running_) return true;
+                next = nextRunnable();
+                return next != queue_.end();
+            });
+            if (!running_) {
+                return;
+            }
+            jobId = std::move(next->jobId);
+            batchId = std::move(next->batchId);
+            request = std::move(next->request);
+            queue_.erase(next);
+            auto limit = batches_.find(batchId);
+            if (limit != batches_.end()) {
+                ++limit->second.running;
+            }
+            ++busy_;
+            LaunchJob& job = jobs_[jobId];
+            job.startedAt = std::chrono::system_clock::now();
+            waitSeconds_.observe(secondsBetween(job.queuedAt, job.startedAt));
+        }
+        setState(jobId, "creating");
+
+        // Always started detached: an attached run would hold this worker
+        // until the container exits. watchAttached() collects its exit instead.
+        std::string result;
+        try {
+            result = dockerCtrl_.startContainer(request.image, request.name, request.ports, request.envVars,
+                                                request.volumes, request.labels, request.network,
+                                                request.restartPolicy, true, request.command,
+                                                [this, &jobId](const std::string& phase) { setState(jobId, phase); });
+        } catch (const std::exception& e) {
+            result = std::string("Error: ") + e.what();
+        }
+        LOG_INFO << "Container execution result for " << request.name << ": " << result;
+
+        std::string containerId;
+        if (launchSucceeded(result, containerId)) {
+            if (!request.detach) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = jobs_.find(jobId);
+                if (it != jobs_.end()) it->second.attached = true;
+                attached_[jobId] = containerId;
+            }
+            setState(jobId, "running", containerId);
+        } else {
+            if (!result.empty() && result.back() == '\n') result.pop_back();
+            setState(jobId, "failed", result);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        --busy_;
+        auto limit = batches_.find(batchId);
+        if (limit != batches_.end()) {
+            --limit->second.running;
+            if (--limit->second.remaining == 0) {
+                batches_.erase(limit);
+            }
+            // A worker may be waiting on this batch's limit rather than an empty queue.
+            ready_.notify_all();
+        }
+    }
+}
+
+void LaunchQueue::watchAttached() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        watchWake_.wait_for(lock, kAttachedPollInterval, [this] { return !running_; });
+        std::map<std::string, std::string> watched = attached_;
+        lock.unlock();
+
+        std::map<std::string, std::pair<int, std::string>> exits;
+        for (const auto& entry : watched) {
+            int exitCode = -1;
+            if (!dockerCtrl_.containerExited(entry.second, exitCode)) continue;
+            std::string output = dockerCtrl_.getContainerLogs(entry.second);
+            if (output.size() > kAttachedOutputBytes) {
+                output.erase(0, output.size() - kAttachedOutputBytes);
+            }
+            exits[entry.first] = {exitCode, std::move(output)};
+        }
+
+        lock.lock();
+        for (auto& exit : exits) {
+            attached_.erase(exit.first);
+            auto it = jobs_.find(exit.first);
+            if (it == jobs_.end()) continue; // aged out of the finished-job history
+            it->second.exited = true;
+            it->second.exitCode = exit.second.first;
+            it->second.output = std::move(exit.second.second);
+        }
+        // Jobs that aged out no longer need watching.
+        for (auto it = attached_.begin(); it != attached_.end();) {
+            it = jobs_.count(it->first) ? std::next(it) : attached_.erase(it);
+        }
+    }
+}
+
+void LaunchQueue::exportMetrics(MetricsRegistry& registry) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    registry.gauge("persys_launch_queue_depth", "Workload launches waiting for a worker", {}, static_cast<double>(queue_.size()));
+    registry.gauge("persys_launch_queue_capacity", "Maximum number of queued workload launches", {}, static_cast<double>(capacity_));
+    registry.gauge("persys_launch_workers_busy", "Launch workers currently pulling or creating", {}, static_cast<double>(busy_));
+    registry.gauge("persys_launch_workers", "Size of the launch worker pool", {}, static_cast<double>(concurrency_));
+    registry.counter("persys_launch_jobs_submitted_total", "Workload launches accepted into the queue", {}, static_cast<double>(submittedTotal_));
+    registry.counter("persys_launch_jobs_rejected_total", "Workload launches rejected because the queue was full", {}, static_cast<double>(rejectedTotal_));
+    registry.counter("persys_launch_jobs_finished_total", "Workload launches finished, by outcome", {{"state", "running"}}, static_cast<double>(runningTotal_));
+    registry.counter("persys_launch_jobs_finished_total", "Workload launches finished, by outcome", {{"state", "failed"}}, static_cast<double>(failedTotal_));
+    registry.histogram("persys_launch_queue_wait_seconds", "Time a launch spent queued before a worker picked it up", {}, waitSeconds_);
+    registry.histogram("persys_launch_duration_seconds", "Time from a worker picking up a launch to running or failed", {}, launchSeconds_);
+}
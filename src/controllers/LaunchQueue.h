@@ -0,0 +1,125 @@
+#ifndef LAUNCH_QUEUE_H
+#define LAUNCH_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DockerController.h"
+#include "MetricsRegistry.h"
+#include "WorkloadStore.h"
+
+struct LaunchRequest {
+    std::string workloadId;
+    std::string image;
+    std::string name;
+    std::vector<std::string> ports;
+    std::vector<std::string> envVars;
+    std::vector<std::string> volumes;
+    std::vector<std::string> labels;
+    std::string network;
+    std::string restartPolicy;
+    bool detach = true;    // false: the job still finishes once the container runs; its exit and logs follow
+    std::string command;
+};
+
+struct LaunchJob {
+    std::string id;
+    std::string batchId; // set for jobs submitted through submitBatch()
+    std::string workloadId;
+    std::string name;
+    std::string image;
+    std::string state;   // queued, pulling, creating, running, failed
+    std::string result;  // container ID once running, error text once failed
+    std::chrono::system_clock::time_point queuedAt;
+    std::chrono::system_clock::time_point startedAt;  // picked up by a worker
+    std::chrono::system_clock::time_point finishedAt;
+    // Attached launches (detach: false) only: filled in once the container exits.
+    bool attached = false;
+    bool exited = false;
+    int exitCode = -1;
+    std::string output;  // tail of the container's logs
+
+    bool finished() const { return state == "running" || state == "failed"; }
+    Json::Value toJson() const;
+};
+
+// Runs workload launches on a fixed pool of workers fed by a bounded FIFO,
+// so a burst from central turns into at most LAUNCH_CONCURRENCY concurrent
+// pulls/creates instead of one thread (and docker fork) per request.
+class LaunchQueue {
+public:
+    LaunchQueue(DockerController& dockerCtrl, WorkloadStore& workloads);
+    ~LaunchQueue();
+
+    void start();
+    void stop();
+
+    // Queues a launch and returns its job ID, or "" when the queue is full.
+    std::string submit(const LaunchRequest& request);
+    // Queues all of requests or none of them. Returns the batch ID (and one
+    // job ID per request, in order), or "" when they do not all fit. With
+    // maxParallel > 0 at most that many of the batch run at once.
+    std::string submitBatch(const std::vector<LaunchRequest>& requests, size_t maxParallel,
+                            std::vector<std::string>& jobIds);
+
+    bool job(const std::string& jobId, LaunchJob& out) const;
+    // Launches not finished yet, oldest first.
+    std::vector<LaunchJob> inFlight() const;
+
+    void exportMetrics(MetricsRegistry& registry) const;
+
+private:
+    struct QueuedLaunch {
+        std::string jobId;
+        std::string batchId;
+        LaunchRequest request;
+    };
+    struct BatchLimit {
+        size_t maxParallel = 0;
+        size_t running = 0;
+        size_t remaining = 0; // jobs not finished yet; the entry goes when it hits 0
+    };
+
+    bool enqueue(const std::vector<LaunchRequest>& requests, const std::string& batchId, size_t maxParallel,
+                 std::vector<std::string>& jobIds);
+    // First queued launch whose batch is below its limit. Must be called with mutex_ held.
+    std::deque<QueuedLaunch>::iterator nextRunnable();
+    void worker();
+    // Waits for attached launches' containers to exit, off the worker pool.
+    void watchAttached();
+    void setState(const std::string& jobId, const std::string& state, const std::string& result = "");
+
+    DockerController& dockerCtrl_;
+    WorkloadStore& workloads_;
+    size_t concurrency_;
+    size_t capacity_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    bool running_ = false;
+    std::deque<QueuedLaunch> queue_;
+    std::map<std::string, BatchLimit> batches_; // only batches submitted with a limit
+    std::map<std::string, LaunchJob> jobs_;
+    std::deque<std::string> finishedOrder_; // finished job IDs, oldest first, for retention
+    size_t reserved_ = 0; // accepted by submit() but not yet queued
+    size_t busy_ = 0;
+    uint64_t submittedTotal_ = 0;
+    uint64_t rejectedTotal_ = 0;
+    uint64_t runningTotal_ = 0;
+    uint64_t failedTotal_ = 0;
+    std::vector<std::thread> workers_;
+    std::map<std::string, std::string> attached_; // job ID -> container ID still running
+    std::condition_variable watchWake_; // separate from ready_ so a submit never wakes the watcher instead of a worker
+    std::thread watcher_;
+
+    MetricsRegistry::Histogram waitSeconds_;
+    MetricsRegistry::Histogram launchSeconds_;
+};
+
+#endif // LAUNCH_QUEUE_H
@@ -0,0 +1,229 @@
+#include "MetricsCollector.h"
+#include "Logger.h"
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <set>
+#include <zlib.h>
+
+namespace {
+
+std::string gzipCompress(const std::string& input) {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    // windowBits 15 + 16 selects the gzip wrapper instead of raw zlib
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return "";
+    }
+    std::string out;
+    out.resize(deflateBound(&zs, input.size()) + 32);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    zs.avail_in = static_cast<uInt>(input.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END ? out : "";
+}
+
+} // namespace
+
+const std::string& MetricsCollector::Snapshot::body(MetricsRegistry::Format format, bool gzip) const {
+    if (format == MetricsRegistry::Format::OpenMetrics) {
+        return gzip ? openMetricsGzip : openMetrics;
+    }
+    return gzip ? prometheusGzip : prometheus;
+}
+
+MetricsCollector::MetricsCollector(DockerController& dockerCtrl, ContainerStateCache& containerCache)
+    : dockerCtrl_(dockerCtrl), containerCache_(containerCache), interval_(15) {
+    if (const char* interval = std::getenv("METRICS_INTERVAL_SECONDS")) {
+        int seconds = std::atoi(interval);
+        if (seconds > 0) {
+            interval_ = std::chrono::seconds(seconds);
+        } else {
+            LOG_WARN << "Invalid METRICS_INTERVAL_SECONDS: " << interval << ", using default: " << interval_.count();
+        }
+    }
+    // Valid, empty expositions until the first collection finishes
+    auto empty = std::make_shared<Snapshot>();
+    MetricsRegistry registry;
+    empty->prometheus = registry.render(MetricsRegistry::Format::Prometheus);
+    empty->openMetrics = registry.render(MetricsRegistry::Format::OpenMetrics);
+    empty->prometheusGzip = gzipCompress(empty->prometheus);
+    empty->openMetricsGzip = gzipCompress(empty->openMetrics);
+    snapshot_ = std::move(empty);
+}
+
+MetricsCollector::~MetricsCollector() {
+    stop();
+}
+
+void MetricsCollector::addSource(Source source) {
+    sources_.push_back(std::move(source));
+}
+
+void MetricsCollector::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&MetricsCollector::loop, this);
+}
+
+void MetricsCollector::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+std::shared_ptr<const MetricsCollector::Snapshot> MetricsCollector::snapshot() const {
+    return std::atomic_load(&snapshot_);
+}
+
+bool MetricsCollector::acceptsGzip(const std::string& acceptEncoding) {
+    size_t pos = acceptEncoding.find("gzip");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    // "gzip;q=0" explicitly refuses it
+    size_t end = acceptEncoding.find(',', pos);
+    std::string params = acceptEncoding.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    size_t q = params.find("q=");
+    return q == std::string::npos || std::atof(params.c_str() + q + 2) > 0;
+}
+
+void MetricsCollector::loop() {
+    while (running_) {
+        auto started = std::chrono::steady_clock::now();
+        MetricsRegistry registry;
+        collect(registry);
+        for (const auto& source : sources_) {
+            try {
+                source(registry);
+            } catch (const std::exception& e) {
+                LOG_ERROR << "Error collecting metrics: " << e.what();
+            }
+        }
+        double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        registry.gauge("persys_metrics_collection_duration_seconds", "Time taken by the last metrics collection", {}, duration);
+        registry.gauge("persys_metrics_last_collection_timestamp_seconds", "Unix time of the last metrics collection", {},
+                       static_cast<double>(std::time(nullptr)));
+        registry.gauge("persys_metrics_collection_interval_seconds", "Configured metrics collection interval", {},
+                       static_cast<double>(interval_.count()));
+
+        auto next = std::make_shared<Snapshot>();
+        next->prometheus = registry.render(MetricsRegistry::Format::Prometheus);
+        next->openMetrics = registry.render(MetricsRegistry::Format::OpenMetrics);
+        next->prometheusGzip = gzipCompress(next->prometheus);
+        next->openMetricsGzip = gzipCompress(next->openMetrics);
+        next->collectedAt = std::chrono::system_clock::now();
+        next->durationSeconds = duration;
+        std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(std::move(next)));
+
+        // Sleep for the rest of the interval; a slow collection never stacks up.
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait_until(lock, started + interval_, [this] { return !running_; });
+    }
+}
+
+void MetricsCollector::collect(MetricsRegistry& registry) {
+    try {
+        // Workload labels are only known from the cache; the listing drops them.
+        std::map<std::string, std::map<std::string, std::string>> labelsByName;
+        std::shared_ptr<const ContainerSnapshot> cached = containerCache_.snapshot();
+        for (const auto& record : cached->containers) {
+            labelsByName[record.name] = record.labels;
+        }
+
+        // Containers sharing a network namespace see the same counters;
+        // they are exported once, under the first such container listed.
+        std::set<uint64_t> namespacesSeen;
+        auto containers = dockerCtrl_.listContainers();
+        for (const auto& container : containers) {
+            std::string id = container["id"].asString();
+            // Launches still in flight have no container yet
+            if (id.empty()) continue;
+            std::string name = container["names"].asString();
+            auto stats = dockerCtrl_.getContainerStats(id, "metrics");
+
+            // Containers started by the agent are named after their workload ID
+            std::string workloadId = name;
+            std::string displayName = name;
+            auto labels = labelsByName.find(name);
+            if (labels != labelsByName.end()) {
+                auto it = labels->second.find("workloadId");
+                if (it != labels->second.end() && !it->second.empty()) workloadId = it->second;
+                it = labels->second.find("displayName");
+                if (it != labels->second.end() && !it->second.empty()) displayName = it->second;
+            }
+            MetricsRegistry::Labels base = {
+                {"container_id", id}, {"name", name}, {"workload_id", workloadId}, {"display_name", displayName}};
+
+            registry.gauge("docker_container_cpu_usage_percent", "CPU usage percentage", base,
+                           stats["cpu_percent"].asDouble());
+            registry.gauge("docker_container_memory_usage_bytes", "Memory usage in bytes", base,
+                           static_cast<double>(stats["memory_usage"].asInt64()));
+            registry.gauge("docker_container_memory_limit_bytes", "Memory limit in bytes", base,
+                           static_cast<double>(stats["memory_limit"].asInt64()));
+
+            // Network counters are monotonic, one series per interface
+            if (stats.isMember("network_namespace") &&
+                !namespacesSeen.insert(stats["network_namespace"].asUInt64()).second) {
+                continue;
+            }
+            const Json::Value& networks = stats["networks"];
+            for (const auto& iface : networks.getMemberNames()) {
+                const Json::Value& n = networks[iface];
+                MetricsRegistry::Labels labels = base;
+                labels.emplace_back("interface", iface);
+                registry.counter("docker_container_network_receive_bytes_total", "Network bytes received", labels,
+                                 static_cast<double>(n["rx_bytes"].asUInt64()));
+                registry.counter("docker_container_network_transmit_bytes_total", "Network bytes transmitted", labels,
+                                 static_cast<double>(n["tx_bytes"].asUInt64()));
+                registry.counter("docker_container_network_receive_packets_total", "Network packets received", labels,
+                                 static_cast<double>(n["rx_packets"].asUInt64()));
+                registry.counter("docker_container_network_transmit_packets_total", "Network packets transmitted", labels,
+                                 static_cast<double>(n["tx_packets"].asUInt64()));
+                registry.counter("docker_container_network_receive_errors_total", "Network receive errors", labels,
+                                 static_cast<double>(n["rx_errors"].asUInt64()));
+                registry.counter("docker_container_network_transmit_errors_total", "Network transmit errors", labels,
+                                 static_cast<double>(n["tx_errors"].asUInt64()));
+                registry.counter("docker_container_network_receive_dropped_total", "Network packets dropped on receive", labels,
+                                 static_cast<double>(n["rx_dropped"].asUInt64()));
+                registry.counter("docker_container_network_transmit_dropped_total", "Network packets dropped on transmit", labels,
+                                 static_cast<double>(n["tx_dropped"].asUInt64()));
+            }
+        }
+
+        // Removed containers are never sampled again; drop what was cached for them
+        dockerCtrl_.pruneContainerStats();
+
+        // Docker daemon metrics
+        auto info = dockerCtrl_.getDockerInfo();
+        registry.gauge("docker_daemon_containers_running", "Number of running containers", {}, info["ContainersRunning"].asInt());
+        registry.gauge("docker_daemon_containers_stopped", "Number of stopped containers", {}, info["ContainersStopped"].asInt());
+        registry.gauge("docker_daemon_containers_paused", "Number of paused containers", {}, info["ContainersPaused"].asInt());
+
+        // Container state cache health
+        ContainerStateCache::Stats cacheStats = containerCache_.stats();
+        registry.counter("persys_container_events_total", "Docker container events applied to the state cache", {},
+                         static_cast<double>(cacheStats.eventsTotal));
+        registry.gauge("persys_container_event_lag_seconds", "Delay between a Docker event and its application to the state cache", {},
+                       cacheStats.lastEventLagSeconds);
+        registry.counter("persys_container_resyncs_total", "Full container resyncs against the Docker daemon", {},
+                         static_cast<double>(cacheStats.resyncsTotal));
+        registry.counter("persys_container_resync_corrections_total", "Cache entries corrected by a resync (missed events)", {},
+                         static_cast<double>(cacheStats.resyncCorrectionsTotal));
+        registry.counter("persys_container_event_stream_reconnects_total", "Docker event stream reconnects after a failure", {},
+                         static_cast<double>(cacheStats.streamReconnectsTotal));
+        registry.gauge("persys_container_event_stream_up", "Whether the Docker event stream is connected", {},
+                       cacheStats.streamConnected ? 1 : 0);
+    } catch (const std::exception& e) {
+        LOG_ERROR << "Error collecting Docker metrics: " << e.what();
+    }
+}
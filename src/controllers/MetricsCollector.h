@@ -0,0 +1,69 @@
+#ifndef METRICS_COLLECTOR_H
+#define METRICS_COLLECTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DockerController.h"
+#include "ContainerStateCache.h"
+#include "MetricsRegistry.h"
+
+// Samples Docker and agent metrics on a background thread and publishes a
+// pre-rendered exposition in every supported format and encoding. /metrics
+// only copies the matching buffer, so scrapes never wait on the daemon and
+// never overlap collection.
+class MetricsCollector {
+public:
+    struct Snapshot {
+        std::string prometheus;
+        std::string prometheusGzip;
+        std::string openMetrics;
+        std::string openMetricsGzip;
+        std::chrono::system_clock::time_point collectedAt; // epoch if nothing collected yet
+        double durationSeconds = 0;
+
+        const std::string& body(MetricsRegistry::Format format, bool gzip) const;
+    };
+
+    // Called on the collector thread each cycle to add a module's metrics.
+    using Source = std::function<void(MetricsRegistry&)>;
+
+    MetricsCollector(DockerController& dockerCtrl, ContainerStateCache& containerCache);
+    ~MetricsCollector();
+
+    // Sources must be registered before start().
+    void addSource(Source source);
+
+    void start();
+    void stop();
+
+    // Latest immutable snapshot; concurrent scrapes share the same buffers.
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    // True when an Accept-Encoding header allows gzip.
+    static bool acceptsGzip(const std::string& acceptEncoding);
+
+private:
+    void loop();
+    void collect(MetricsRegistry& registry);
+
+    DockerController& dockerCtrl_;
+    ContainerStateCache& containerCache_;
+    std::chrono::seconds interval_;
+    std::vector<Source> sources_;
+
+    std::shared_ptr<const Snapshot> snapshot_;
+
+    std::atomic<bool> running_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+};
+
+#endif // METRICS_COLLECTOR_H
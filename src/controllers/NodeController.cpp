@@ -1,4 +1,6 @@
 #include "NodeController.h"
+#include "Codec.h"
+#include "Logger.h"
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <uuid/uuid.h>
@@ -9,108 +11,16 @@
 #include <sys/ioctl.h>
 #include <net/if.h>
 #include <netinet/in.h>
-#include <openssl/evp.h>
-#include <openssl/pem.h>
-#include <openssl/bio.h>
-#include <openssl/sha.h>
+#include <algorithm>
+#include <future>
 #include <vector>
 #include <string>
 
-// Custom base64 decoder
-static std::vector<char> base64_decode(const std::string& input) {
-    static const unsigned char decode_table[] = {
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,
-        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,
-        64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
-        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,
-        64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
-        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
-    };
-
-    std::vector<char> output;
-    std::string cleaned_input;
-    // Filter out invalid characters
-    for (char c : input) {
-        if (std::isalnum(c) || c == '+' || c == '/' || c == '=') {
-            cleaned_input += c;
-        } else {
-            std::cerr << "Filtered invalid base64 character '" << c << "' (ASCII " << (int)c << ")" << std::endl;
-        }
-    }
-    std::cerr << "Cleaned base64 input: " << cleaned_input << std::endl;
-
-    size_t input_len = cleaned_input.size();
-    // Validate length (must be multiple of 4)
-    if (input_len % 4 != 0) {
-        std::cerr << "Invalid base64 length: " << input_len << ", must be multiple of 4" << std::endl;
-        return {};
-    }
-
-    size_t i = 0;
-    while (i < input_len) {
-        if (cleaned_input[i] == '=') {
-            // Handle padding
-            if (i < input_len - 2 || (i == input_len - 2 && cleaned_input[i + 1] != '=')) {
-                std::cerr << "Invalid base64 padding at position " << i << std::endl;
-                return {};
-            }
-            break;
-        }
-
-        if (i + 3 >= input_len) {
-            std::cerr << "Incomplete base64 quartet at position " << i << std::endl;
-            return {};
-        }
-
-        unsigned char a = decode_table[static_cast<unsigned char>(cleaned_input[i])];
-        unsigned char b = decode_table[static_cast<unsigned char>(cleaned_input[i + 1])];
-        unsigned char c = decode_table[static_cast<unsigned char>(cleaned_input[i + 2])];
-        unsigned char d = decode_table[static_cast<unsigned char>(cleaned_input[i + 3])];
-
-        if (a == 64) {
-            std::cerr << "Invalid base64 character '" << cleaned_input[i] << "' at position " << i << std::endl;
-            return {};
-        }
-        if (b == 64) {
-            std::cerr << "Invalid base64 character '" << cleaned_input[i + 1] << "' at position " << i + 1 << std::endl;
-            return {};
-        }
-        if (c == 64 && cleaned_input[i + 2] != '=') {
-            std::cerr << "Invalid base64 character '" << cleaned_input[i + 2] << "' at position " << i + 2 << std::endl;
-            return {};
-        }
-        if (d == 64 && cleaned_input[i + 3] != '=') {
-            std::cerr << "Invalid base64 character '" << cleaned_input[i + 3] << "' at position " << i + 3 << std::endl;
-            return {};
-        }
-
-        output.push_back((a << 2) | (b >> 4));
-        if (cleaned_input[i + 2] != '=') {
-            output.push_back((b << 4) | (c >> 2));
-            if (cleaned_input[i + 3] != '=') {
-                output.push_back((c << 6) | d);
-            }
-        }
-
-        i += 4;
-    }
-
-    std::cerr << "Base64 decoded length: " << output.size() << std::endl;
-    return output;
-}
-
-NodeController::NodeController(const std::string& centralUrl, SystemController& sysCtrl, int agentPort)
-    : centralUrl_(centralUrl), isReady_(false), sysCtrl_(sysCtrl), agentPort_(agentPort) {
+NodeController::NodeController(const std::string& centralUrl, SystemController& sysCtrl, DockerEngineClient& engine,
+                               CommandRunner& commands, TrustStore& trust, int agentPort)
+    : centralUrl_(centralUrl), isReady_(false), sysCtrl_(sysCtrl), engine_(engine), commands_(commands), trust_(trust),
+      agentPort_(agentPort),
+      central_(centralUrl), probeTimeout_(3000), createdAt_(std::chrono::steady_clock::now()) {
     nodeId_ = loadNodeId();
     if (nodeId_.empty()) {
         nodeId_ = generateNodeId();
@@ -121,20 +31,29 @@ NodeController::NodeController(const std::string& centralUrl, SystemController&
         try {
             agentPort_ = std::stoi(portEnv);
             if (agentPort_ <= 0 || agentPort_ > 65535) {
-                std::cerr << "Invalid AGENT_PORT: " << portEnv << ", using default: " << agentPort << std::endl;
+                LOG_WARN << "Invalid AGENT_PORT: " << portEnv << ", using default: " << agentPort;
                 agentPort_ = agentPort;
             }
         } catch (const std::exception& e) {
-            std::cerr << "Invalid AGENT_PORT format: " << portEnv << ", using default: " << agentPort << std::endl;
+            LOG_WARN << "Invalid AGENT_PORT format: " << portEnv << ", using default: " << agentPort;
             agentPort_ = agentPort;
         }
     } else {
-        std::cerr << "AGENT_PORT not set, using default: " << agentPort_ << std::endl;
+        LOG_INFO << "AGENT_PORT not set, using default: " << agentPort_;
+    }
+
+    if (const char* probeEnv = std::getenv("NODE_PROBE_TIMEOUT_MS")) {
+        int ms = std::atoi(probeEnv);
+        if (ms > 0) {
+            probeTimeout_ = std::chrono::milliseconds(ms);
+        } else {
+            LOG_WARN << "Invalid NODE_PROBE_TIMEOUT_MS: " << probeEnv << ", using default: " << probeTimeout_.count();
+        }
     }
 
     sharedSecret_ = std::getenv("AGENT_SECRET") ? std::getenv("AGENT_SECRET") : "";
     if (sharedSecret_.empty()) {
-        std::cerr << "Warning: AGENT_SECRET not set; TOFU mode will be used unless shared secret is provided" << std::endl;
+        LOG_WARN << "AGENT_SECRET not set; TOFU mode will be used unless shared secret is provided";
     }
 }
 
@@ -244,35 +163,22 @@ std::string NodeController::getKernelVersion() const {
 }
 
 std::string NodeController::determineStatus(const Json::Value& resources) const {
-    const double CPU_THRESHOLD = 80.0;
-    const double MEM_THRESHOLD = 80.0;
-    const double DISK_THRESHOLD = 80.0;
-
-    double cpu = resources["cpu_usage"].asDouble();
-    double mem = resources["memory_usage"].asDouble();
-    int disk = resources["disk_usage"].asInt();
-
-    if (cpu > CPU_THRESHOLD || mem > MEM_THRESHOLD || disk > DISK_THRESHOLD) {
-        return "busy";
-    }
-    return "active";
+    return capacity_.assess(resources).status;
 }
 
-std::string NodeController::executeCommand(const std::string& cmd) const {
-    std::array<char, 128> buffer;
-    std::string result;
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
-        return "unknown";
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
+// Runs a probe and returns its stdout without the trailing newline, or "unknown".
+std::string NodeController::executeCommand(const std::vector<std::string>& argv, std::chrono::milliseconds timeout) const {
+    CommandOptions options;
+    options.timeout = timeout;
+    CommandResult result = commands_.run(argv, options);
+    std::string out = result.started ? result.out : "";
+    while (!out.empty() && out.back() == '\n') {
+        out.pop_back();
     }
-    pclose(pipe);
-    return result.empty() ? "unknown" : result;
+    return out.empty() ? "unknown" : out;
 }
 
-Json::Value NodeController::getHypervisorInfo() const {
+Json::Value NodeController::getHypervisorInfo(std::chrono::milliseconds timeout) const {
     Json::Value hypervisor;
 
     std::ifstream cpuinfo("/proc/cpuinfo");
@@ -293,7 +199,7 @@ Json::Value NodeController::getHypervisorInfo() const {
         hypervisor["status"] = "active";
     }
 
-    std::string vbox_version = executeCommand("vboxmanage --version 2>/dev/null | tr -d '\n'");
+    std::string vbox_version = executeCommand({"vboxmanage", "--version"}, timeout);
     if (!vbox_version.empty() && vbox_version != "unknown") {
         hypervisor["type"] = "VirtualBox";
         hypervisor["version"] = vbox_version;
@@ -308,17 +214,33 @@ Json::Value NodeController::getHypervisorInfo() const {
     return hypervisor;
 }
 
-Json::Value NodeController::getContainerEngineInfo() const {
+Json::Value NodeController::getContainerEngineInfo(std::chrono::milliseconds timeout) const {
     Json::Value container;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    auto remaining = [deadline] {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return std::max(left, std::chrono::milliseconds(1));
+    };
 
-    std::string docker_version = executeCommand("docker --version 2>/dev/null | tr -d '\n'");
-    if (!docker_version.empty() && docker_version != "unknown") {
+    // A daemon that answers the API is active; no need to ask the CLI or systemd.
+    Json::Value version;
+    if (engine_.useApi()) {
+        version = engine_.get("/version", static_cast<int>(remaining().count())).json();
+    }
+    if (version.isObject() && version["Version"].isString()) {
         container["type"] = "Docker";
-        container["version"] = docker_version;
-        container["status"] = executeCommand("systemctl is-active docker 2>/dev/null | tr -d '\n'") == "active" ? "active" : "inactive";
+        container["version"] = "Docker version " + version["Version"].asString() + ", build " + version["GitCommit"].asString();
+        container["status"] = "active";
+    } else {
+        std::string docker_version = executeCommand({"docker", "--version"}, remaining());
+        if (!docker_version.empty() && docker_version != "unknown") {
+            container["type"] = "Docker";
+            container["version"] = docker_version;
+            container["status"] = executeCommand({"systemctl", "is-active", "docker"}, remaining()) == "active" ? "active" : "inactive";
+        }
     }
 
-    std::string podman_version = executeCommand("podman --version 2>/dev/null | tr -d '\n'");
+    std::string podman_version = executeCommand({"podman", "--version"}, remaining());
     if (!podman_version.empty() && podman_version != "unknown") {
         container["type"] = "Podman";
         container["version"] = podman_version;
@@ -333,17 +255,32 @@ Json::Value NodeController::getContainerEngineInfo() const {
     return container;
 }
 
-Json::Value NodeController::getDockerSwarmInfo() const {
+Json::Value NodeController::getDockerSwarmInfo(std::chrono::milliseconds timeout) const {
     Json::Value swarm;
-
-    std::string swarmState = executeCommand("docker info --format '{{.Swarm.LocalNodeState}}' 2>/dev/null | tr -d '\n'");
+    int timeoutMs = static_cast<int>(timeout.count());
+
+    std::string swarmState;
+    std::string nodeInspect;
+    bool useApi = engine_.useApi();
+    Json::Value swarmInfo;
+    if (useApi) {
+        swarmInfo = engine_.get("/info", timeoutMs).json()["Swarm"];
+        swarmState = swarmInfo["LocalNodeState"].asString();
+    } else {
+        swarmState = executeCommand({"docker", "info", "--format", "{{.Swarm.LocalNodeState}}"}, timeout);
+    }
     if (swarmState.empty() || swarmState == "unknown" || swarmState == "inactive") {
         swarm["active"] = false;
         return swarm;
     }
 
     swarm["active"] = true;
-    std::string nodeInspect = executeCommand("docker node inspect self --format '{{json .}}' 2>/dev/null");
+    if (useApi) {
+        DockerEngineClient::Response res = engine_.get("/nodes/" + DockerEngineClient::urlEncode(swarmInfo["NodeID"].asString()), timeoutMs);
+        nodeInspect = res.ok() ? res.body : "unknown";
+    } else {
+        nodeInspect = executeCommand({"docker", "node", "inspect", "self", "--format", "{{json .}}"}, timeout);
+    }
 
     if (!nodeInspect.empty() && nodeInspect != "unknown") {
         Json::CharReaderBuilder builder;
@@ -358,81 +295,28 @@ Json::Value NodeController::getDockerSwarmInfo() const {
                 swarm["managerAddress"] = nodeData["ManagerStatus"]["Addr"].asString();
             }
         } else {
-            std::cerr << "Failed to parse docker node inspect: " << errs << std::endl;
+            LOG_WARN << "Failed to parse docker node inspect: " << errs;
         }
     }
 
     return swarm;
 }
 
-std::string NodeController::extractHostname(const std::string& url) const {
-    // Simple URL parsing to extract hostname
-    // Handle both http:// and https:// URLs
-    std::string hostname = url;
-    
-    // Remove protocol
-    size_t protocolPos = hostname.find("://");
-    if (protocolPos != std::string::npos) {
-        hostname = hostname.substr(protocolPos + 3);
-    }
-    
-    // Remove path (everything after first slash)
-    size_t pathPos = hostname.find('/');
-    if (pathPos != std::string::npos) {
-        hostname = hostname.substr(0, pathPos);
-    }
-    
-    // Remove port if present
-    size_t portPos = hostname.find(':');
-    if (portPos != std::string::npos) {
-        hostname = hostname.substr(0, portPos);
-    }
-    
-    return hostname;
-}
-
-bool NodeController::isIpAddress(const std::string& hostname) const {
-    // Check if the hostname is an IP address (IPv4 or IPv6)
-    
-    // IPv4 pattern: x.x.x.x where x is 0-255
-    std::string ipv4Pattern = R"((\d{1,3})\.(\d{1,3})\.(\d{1,3})\.(\d{1,3}))";
-    
-    // Simple IPv4 validation
-    std::istringstream iss(hostname);
-    std::string octet;
-    int octetCount = 0;
-    
-    while (std::getline(iss, octet, '.')) {
-        if (octetCount >= 4) return false; // Too many octets
-        
-        try {
-            int value = std::stoi(octet);
-            if (value < 0 || value > 255) return false; // Invalid octet range
-        } catch (const std::exception&) {
-            return false; // Not a number
-        }
-        
-        octetCount++;
-    }
-    
-    // Must have exactly 4 octets for IPv4
-    if (octetCount != 4) return false;
-    
-    // Check if it's not all digits (which would indicate it's a hostname)
-    for (char c : hostname) {
-        if (c != '.' && !std::isdigit(c)) {
-            return false; // Contains non-numeric characters, likely a hostname
-        }
-    }
-    
-    return true; // Looks like an IPv4 address
-}
-
 void NodeController::registerNode() {
-    Json::Value resources = sysCtrl_.getSystemResources();
-    Json::Value hypervisor = getHypervisorInfo();
-    Json::Value container = getContainerEngineInfo();
-    Json::Value swarm = getDockerSwarmInfo();
+    auto started = std::chrono::steady_clock::now();
+    ++attemptsTotal_;
+
+    // The probes are independent and mostly wait on other processes, so run
+    // them side by side; each is bounded by probeTimeout_.
+    auto resourcesProbe = std::async(std::launch::async, [this] { return sysCtrl_.getSystemResources(); });
+    auto hypervisorProbe = std::async(std::launch::async, [this] { return getHypervisorInfo(probeTimeout_); });
+    auto containerProbe = std::async(std::launch::async, [this] { return getContainerEngineInfo(probeTimeout_); });
+    auto swarmProbe = std::async(std::launch::async, [this] { return getDockerSwarmInfo(probeTimeout_); });
+    Json::Value resources = resourcesProbe.get();
+    Json::Value hypervisor = hypervisorProbe.get();
+    Json::Value container = containerProbe.get();
+    Json::Value swarm = swarmProbe.get();
+    factsSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
 
     Json::Value nodeData;
     nodeData["nodeId"] = nodeId_;
@@ -443,6 +327,7 @@ void NodeController::registerNode() {
     nodeData["osName"] = getOsName();
     nodeData["kernelVersion"] = getKernelVersion();
     nodeData["status"] = determineStatus(resources);
+    nodeData["readiness"] = capacity_.last().score;
     nodeData["timestamp"] = std::to_string(std::time(nullptr));
     nodeData["resources"] = resources;
     nodeData["hypervisor"] = hypervisor;
@@ -473,97 +358,59 @@ void NodeController::registerNode() {
         nodeData["labels"][config.key] = value && std::string(value) != "" ? value : config.fallback;
     }
 
-    // Log labels for debugging
-    std::cerr << "Registering node with labels: ";
+    std::string labels;
     for (const auto& config : labelConfigs) {
-        std::cerr << config.key << "=" << nodeData["labels"][config.key].asString();
-        if (&config != &labelConfigs.back()) {
-            std::cerr << ", ";
-        }
+        if (!labels.empty()) labels += ", ";
+        labels += config.key + "=" + nodeData["labels"][config.key].asString();
     }
-    std::cerr << std::endl;  
+    LOG_INFO << "Registering node with labels: " << labels;
 
     Json::StreamWriterBuilder writer;
     std::string jsonPayload = Json::writeString(writer, nodeData);
 
     std::string url = centralUrl_ + "/nodes/register";
-    
-    // Log the URL being called
-    std::cerr << "Attempting to register node with central service at: " << url << std::endl;
-    
-    // First, test DNS resolution (skip if IP address)
-    std::string hostname = extractHostname(url);
-    
-    if (!isIpAddress(hostname)) {
-        std::string dnsTestCmd = "nslookup " + hostname + " >/dev/null 2>&1";
-        int dnsResult = std::system(dnsTestCmd.c_str());
-        
-        if (dnsResult != 0) {
-            std::string errorMsg = "DNS resolution failed for hostname: " + hostname;
-            std::cerr << "ERROR: " << errorMsg << std::endl;
-            // isReady_ = false;
-            // throw std::runtime_error(errorMsg);
-        }
-    } else {
-        std::cerr << "Skipping DNS resolution for IP address: " << hostname << std::endl;
-    }
-    
-    // Test if the server is reachable (basic connectivity)
-    std::string connectivityTestCmd = "curl -s --connect-timeout 5 --max-time 10 " + url + " >/dev/null 2>&1";
-    int connectivityResult = std::system(connectivityTestCmd.c_str());
-    
-    if (connectivityResult != 0) {
-        std::string errorMsg = "Server not reachable or timeout: " + url;
-        std::cerr << "ERROR: " << errorMsg << std::endl;
-        // isReady_ = false;
-        // throw std::runtime_error(errorMsg);
-    }
-    
-    // Attempt the actual registration with detailed error capture
-    std::string command = "curl -X POST -H \"Content-Type: application/json\" -d '"
-                         + jsonPayload + "' " + url + " -w \"HTTP_CODE:%{http_code}\" -s";
-    
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe) {
-        std::string errorMsg = "Failed to execute curl command for URL: " + url;
-        std::cerr << "ERROR: " << errorMsg << std::endl;
-        isReady_ = false;
-        throw std::runtime_error(errorMsg);
-    }
-    
-    char buffer[128];
-    std::string result = "";
-    while (!feof(pipe)) {
-        if (fgets(buffer, 128, pipe) != NULL) {
-            result += buffer;
-        }
-    }
-    int curlResult = pclose(pipe);
-    
-    // Extract HTTP status code from curl output
-    size_t httpCodePos = result.find("HTTP_CODE:");
-    int httpCode = -1;
-    if (httpCodePos != std::string::npos) {
-        std::string httpCodeStr = result.substr(httpCodePos + 10);
-        httpCode = std::stoi(httpCodeStr);
-    }
-    
-    if (curlResult == 0 && httpCode >= 200 && httpCode < 300) {
-        std::cerr << "SUCCESS: Node registered successfully with HTTP code: " << httpCode << std::endl;
+    LOG_INFO << "Attempting to register node with central service at: " << url;
+
+    // libcurl's error tells DNS, connect and timeout failures apart, so there
+    // is no separate resolve or reachability check.
+    HttpClient::Response response = central_.post("/nodes/register", jsonPayload, 60000);
+    registerRequestSeconds_ = response.seconds;
+
+    if (response.ok()) {
         isReady_ = (nodeData["status"].asString() == "active");
-    } else {
-        std::string errorMsg = "Registration failed for URL: " + url;
-        if (httpCode > 0) {
-            errorMsg += " (HTTP " + std::to_string(httpCode) + ")";
-        }
-        if (curlResult != 0) {
-            errorMsg += " (curl exit code: " + std::to_string(curlResult) + ")";
-        }
-        std::cerr << "ERROR: " << errorMsg << std::endl;
-        std::cerr << "Response: " << result << std::endl;
-        isReady_ = false;
-        throw std::runtime_error(errorMsg);
+        registeredSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - createdAt_).count();
+        LOG_INFO << "Node registered successfully with HTTP code: " << response.status
+                 << " (facts " << factsSeconds_.load() * 1000.0 << " ms, request " << response.seconds * 1000.0
+                 << " ms, " << registeredSeconds_.load() * 1000.0 << " ms since startup)";
+        return;
     }
+
+    ++failuresTotal_;
+    std::string errorMsg = "Registration failed for URL: " + url;
+    if (response.status > 0) {
+        errorMsg += " (HTTP " + std::to_string(response.status) + ")";
+    }
+    if (!response.error.empty()) {
+        errorMsg += " (" + response.error + ")";
+    }
+    LOG_ERROR << errorMsg;
+    if (!response.body.empty()) {
+        LOG_ERROR << "Response: " << response.body;
+    }
+    isReady_ = false;
+    throw std::runtime_error(errorMsg);
+}
+
+void NodeController::exportMetrics(MetricsRegistry& registry) const {
+    registry.gauge("persys_node_registered_seconds", "Time from agent startup until central accepted the registration, 0 until then", {},
+                   registeredSeconds_.load());
+    registry.gauge("persys_node_registration_facts_seconds", "Time the last registration spent gathering node facts", {}, factsSeconds_.load());
+    registry.gauge("persys_node_registration_request_seconds", "Round-trip time of the last registration request", {},
+                   registerRequestSeconds_.load());
+    registry.counter("persys_node_registration_attempts_total", "Registration attempts", {}, static_cast<double>(attemptsTotal_.load()));
+    capacity_.exportMetrics(registry);
+    registry.counter("persys_node_registration_failures_total", "Registration attempts central did not accept", {},
+                     static_cast<double>(failuresTotal_.load()));
 }
 
 std::string NodeController::getNodeId() const {
@@ -575,113 +422,22 @@ bool NodeController::isNodeReady() const {
 }
 
 std::string NodeController::loadPublicKey() const {
-    std::ifstream file("trusted_key.txt");
-    if (!file.is_open()) {
-        std::cerr << "Failed to open trusted_key.txt for reading" << std::endl;
-        return "";
-    }
-    std::string key;
-    std::getline(file, key); // Read the entire file (single line)
-    file.close();
-    if (!key.empty()) {
-        std::cout << "Loaded public key from trusted_key.txt: " << key.substr(0, 50) << "..." << std::endl;
-    }
-    return key;
+    std::shared_ptr<const TrustStore::TrustedKey> trusted = trust_.trusted();
+    return trusted ? trusted->hex : std::string();
 }
 
 bool NodeController::savePublicKey(const std::string& publicKeyHex) const {
-    std::ofstream file("trusted_key.txt");
-    if (!file.is_open()) {
-        std::cerr << "Failed to open /root/prod-agent/trusted_key.txt for writing" << std::endl;
-        return false;
-    }
-    file << publicKeyHex;
-    file.close();
-    std::cout << "Saved public key to /root/prod-agent/trusted_key.txt: " << publicKeyHex.substr(0, 50) << "..." << std::endl;
-    return true;
+    return trust_.trust(publicKeyHex);
 }
 
 bool NodeController::verifySignature(const std::string& body, const std::string& signatureB64, const std::string& publicKeyHex) const {
-    std::cerr << "verifySignature: signatureB64=" << signatureB64 << ", length=" << signatureB64.size() << std::endl;
-    std::cerr << "verifySignature: publicKeyHex=" << publicKeyHex.substr(0, 50) << "..., length=" << publicKeyHex.size() << std::endl;
-
-    std::vector<char> sigData = base64_decode(signatureB64);
-    if (sigData.empty()) {
-        std::cerr << "Failed to decode base64 signature" << std::endl;
-        return false;
-    }
-
-    // Decode hex public key
-    std::vector<unsigned char> keyData;
-    for (size_t i = 0; i < publicKeyHex.length(); i += 2) {
-        std::string byteString = publicKeyHex.substr(i, 2);
-        try {
-            unsigned char byte = (unsigned char)std::stoul(byteString, nullptr, 16);
-            keyData.push_back(byte);
-        } catch (const std::exception& e) {
-            std::cerr << "Failed to decode hex at position " << i << ": " << e.what() << std::endl;
-            return false;
-        }
-    }
+    LOG_DEBUG << "verifySignature: signature length=" << signatureB64.size() << ", public key length=" << publicKeyHex.size();
 
-    // Load public key
-    BIO* bio = BIO_new_mem_buf(keyData.data(), keyData.size());
-    if (!bio) {
-        std::cerr << "Failed to create BIO" << std::endl;
+    std::vector<char> sigData;
+    if (!Codec::base64Decode(signatureB64, sigData) || sigData.empty()) {
+        LOG_WARN << "Failed to decode base64 signature";
         return false;
     }
 
-    EVP_PKEY* pkey = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
-    BIO_free(bio);
-    if (!pkey) {
-        std::cerr << "Failed to parse public key: " << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
-        return false;
-    }
-
-    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(pkey, nullptr);
-    if (!ctx) {
-        EVP_PKEY_free(pkey);
-        std::cerr << "Failed to create EVP context" << std::endl;
-        return false;
-    }
-
-    if (EVP_PKEY_verify_init(ctx) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        EVP_PKEY_free(pkey);
-        std::cerr << "Failed to initialize verification" << std::endl;
-        return false;
-    }
-
-    if (EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        EVP_PKEY_free(pkey);
-        std::cerr << "Failed to set RSA padding" << std::endl;
-        return false;
-    }
-
-    if (EVP_PKEY_CTX_set_signature_md(ctx, EVP_sha256()) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        EVP_PKEY_free(pkey);
-        std::cerr << "Failed to set signature MD" << std::endl;
-        return false;
-    }
-
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256(reinterpret_cast<const unsigned char*>(body.c_str()), body.length(), hash);
-
-    int result = EVP_PKEY_verify(ctx,
-                                reinterpret_cast<const unsigned char*>(sigData.data()),
-                                sigData.size(),
-                                hash,
-                                SHA256_DIGEST_LENGTH);
-
-    EVP_PKEY_CTX_free(ctx);
-    EVP_PKEY_free(pkey);
-
-    if (result != 1) {
-        std::cerr << "Signature verification failed: " << ERR_error_string(ERR_get_error(), nullptr) << std::endl;
-        return false;
-    }
-
-    return true;
-}
\ No newline at end of file
+    return trust_.verify(body, sigData, publicKeyHex);
+}
@@ -2,25 +2,39 @@
 #define NODE_CONTROLLER_H
 
 #include "SystemController.h"
+#include "CommandRunner.h"
+#include "CapacityScorer.h"
+#include "DockerEngineClient.h"
+#include "HttpClient.h"
+#include "MetricsRegistry.h"
+#include "TrustStore.h"
 #include <crow.h>
 #include <json/json.h>
+#include <atomic>
+#include <chrono>
 #include <string>
+#include <vector>
 #include <openssl/rsa.h>
 #include <openssl/pem.h>
 #include <openssl/err.h>
 
 class NodeController {
 public:
-    NodeController(const std::string& centralUrl, SystemController& sysCtrl, int agentPort = 8080);
+    NodeController(const std::string& centralUrl, SystemController& sysCtrl, DockerEngineClient& engine,
+                   CommandRunner& commands, TrustStore& trust, int agentPort = 8080);
     void registerNode();
     std::string getNodeId() const;
     bool isNodeReady() const;
     bool verifySignature(const std::string& body, const std::string& signatureB64, const std::string& publicKeyHex) const;
+    // The trusted key as hex, from memory; empty while none is trusted.
     std::string loadPublicKey() const;
     std::string getSharedSecret() const { return sharedSecret_; }
     bool savePublicKey(const std::string& publicKeyHex) const;
+    // "active" or "busy", from the smoothed readiness score; see CapacityScorer.
     std::string determineStatus(const Json::Value& resources) const;
-    
+    const CapacityScorer& capacity() const { return capacity_; }
+    void exportMetrics(MetricsRegistry& registry) const;
+
 private:
     std::string generateNodeId() const;
     std::string loadNodeId() const;
@@ -31,19 +45,32 @@ private:
     std::string getHostname() const;
     std::string getOsName() const;
     std::string getKernelVersion() const;
-    std::string executeCommand(const std::string& cmd) const;
-    Json::Value getHypervisorInfo() const;
-    Json::Value getContainerEngineInfo() const;
-    Json::Value getDockerSwarmInfo() const;
-    std::string extractHostname(const std::string& url) const;
-    bool isIpAddress(const std::string& hostname) const;
+    std::string executeCommand(const std::vector<std::string>& argv,
+                               std::chrono::milliseconds timeout = std::chrono::seconds(10)) const;
+    // Each probe gives up after `timeout`, reporting what it found so far.
+    Json::Value getHypervisorInfo(std::chrono::milliseconds timeout) const;
+    Json::Value getContainerEngineInfo(std::chrono::milliseconds timeout) const;
+    Json::Value getDockerSwarmInfo(std::chrono::milliseconds timeout) const;
 
     std::string centralUrl_;
     std::string nodeId_;
     bool isReady_;
     SystemController& sysCtrl_;
+    DockerEngineClient& engine_;
+    CommandRunner& commands_;
+    TrustStore& trust_;
     std::string sharedSecret_;
     int agentPort_;
+    HttpClient central_;
+    std::chrono::milliseconds probeTimeout_;
+    mutable CapacityScorer capacity_;
+
+    std::chrono::steady_clock::time_point createdAt_; // agent startup, for time-to-registered
+    std::atomic<double> registeredSeconds_{0};
+    std::atomic<double> factsSeconds_{0};
+    std::atomic<double> registerRequestSeconds_{0};
+    std::atomic<uint64_t> attemptsTotal_{0};
+    std::atomic<uint64_t> failuresTotal_{0};
 };
 
 #endif // NODE_CONTROLLER_H
\ No newline at end of file
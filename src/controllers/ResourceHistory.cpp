@@ -0,0 +1,191 @@
+#include "ResourceHistory.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include "ResourceSampler.h"
+
+namespace {
+
+int64_t floorTo(int64_t value, int64_t step) {
+    return value - ((value % step) + step) % step;
+}
+
+} // namespace
+
+ResourceHistory::ResourceHistory() {
+    rings_[0].step = 1;
+    rings_[0].slots.resize(600);
+    rings_[1].step = 10;
+    rings_[1].slots.resize(360);
+    rings_[2].step = 60;
+    rings_[2].slots.resize(1440);
+}
+
+const char* ResourceHistory::seriesName(Series series) {
+    switch (series) {
+        case Cpu: return "cpu";
+        case Memory: return "memory";
+        case Disk: return "disk";
+        case NetRx: return "net_rx";
+        case NetTx: return "net_tx";
+        default: return "";
+    }
+}
+
+bool ResourceHistory::parseSeconds(const std::string& text, int64_t& seconds) {
+    char* end = nullptr;
+    long long value = std::strtoll(text.c_str(), &end, 10);
+    if (end == text.c_str() || value <= 0) {
+        return false;
+    }
+    int64_t unit = 1;
+    std::string suffix(end);
+    if (suffix == "m") unit = 60;
+    else if (suffix == "h") unit = 3600;
+    else if (suffix == "d") unit = 86400;
+    else if (!suffix.empty() && suffix != "s") return false;
+    if (value > 366LL * 86400 / unit) {
+        return false;
+    }
+    seconds = value * unit;
+    return true;
+}
+
+void ResourceHistory::fold(Slot& slot, int64_t start, const double (&values)[kSeriesCount]) {
+    if (slot.start != start) {
+        slot.start = start;
+        slot.count = 0;
+    }
+    for (int i = 0; i < kSeriesCount; ++i) {
+        float value = static_cast<float>(values[i]);
+        Cell& cell = slot.cells[i];
+        if (slot.count == 0) {
+            cell.min = cell.max = cell.sum = value;
+        } else {
+            cell.min = std::min(cell.min, value);
+            cell.max = std::max(cell.max, value);
+            cell.sum += value;
+        }
+    }
+    ++slot.count;
+}
+
+void ResourceHistory::record(const ResourceSnapshot& snapshot) {
+    double disk = snapshot.diskUsage >= 0 ? snapshot.diskUsage : 0;
+    for (const auto& fs : snapshot.storage.filesystems) {
+        disk = std::max(disk, fs.usedPercent);
+    }
+    const double values[kSeriesCount] = {
+        snapshot.cpu.busy(), snapshot.memoryUsage, disk, snapshot.netRxBytesPerSecond, snapshot.netTxBytesPerSecond,
+    };
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(snapshot.sampledAt.time_since_epoch()).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    network_ = snapshot.networkAvailable;
+    for (auto& ring : rings_) {
+        int64_t start = floorTo(now, ring.step);
+        Slot& slot = ring.slots[static_cast<size_t>((start / ring.step) % static_cast<int64_t>(ring.slots.size()))];
+        fold(slot, start, values);
+    }
+}
+
+Json::Value ResourceHistory::query(int64_t windowSeconds, int64_t stepSeconds) const {
+    // Finest ring that spans the window and is no coarser than the step asked for.
+    const Ring* ring = &rings_.back();
+    for (const auto& candidate : rings_) {
+        int64_t span = candidate.step * static_cast<int64_t>(candidate.slots.size());
+        if (span >= windowSeconds && (stepSeconds <= 0 || candidate.step <= stepSeconds)) {
+            ring = &candidate;
+            break;
+        }
+    }
+    int64_t span = ring->step * static_cast<int64_t>(ring->slots.size());
+    windowSeconds = std::min(std::max(windowSeconds, ring->step), span);
+    int64_t step = stepSeconds <= 0 ? ring->step : stepSeconds;
+    // Buckets must start on slot boundaries, so the step stays a multiple of
+    // the ring's after the window clamps it.
+    step = std::max(ring->step, floorTo(std::min(step, windowSeconds), ring->step));
+
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    int64_t end = floorTo(now, step) + step; // exclusive; the last bucket is still filling
+    int64_t buckets = (windowSeconds + step - 1) / step;
+    int64_t begin = end - buckets * step;
+
+    Json::Value out;
+    out["window"] = static_cast<Json::Int64>(windowSeconds);
+    out["step"] = static_cast<Json::Int64>(step);
+    out["resolution"] = static_cast<Json::Int64>(ring->step);
+    Json::Value timestamps(Json::arrayValue);
+    Json::Value series(Json::objectValue);
+    Json::Value columns[kSeriesCount][3];
+    for (auto& column : columns) {
+        for (auto& values : column) values = Json::Value(Json::arrayValue);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int64_t bucket = begin; bucket < end; bucket += step) {
+        timestamps.append(static_cast<Json::Int64>(bucket));
+        double mins[kSeriesCount] = {0};
+        double maxs[kSeriesCount] = {0};
+        double sums[kSeriesCount] = {0};
+        uint32_t count = 0;
+        for (int64_t t = bucket; t < bucket + step; t += ring->step) {
+            const Slot& slot = ring->slots[static_cast<size_t>((t / ring->step) % static_cast<int64_t>(ring->slots.size()))];
+            if (slot.start != t || slot.count == 0) continue;
+            for (int i = 0; i < kSeriesCount; ++i) {
+                const Cell& cell = slot.cells[i];
+                mins[i] = count == 0 ? cell.min : std::min<double>(mins[i], cell.min);
+                maxs[i] = count == 0 ? cell.max : std::max<double>(maxs[i], cell.max);
+                sums[i] += cell.sum;
+            }
+            count += slot.count;
+        }
+        for (int i = 0; i < kSeriesCount; ++i) {
+            if (count == 0) {
+                for (auto& values : columns[i]) values.append(Json::Value());
+                continue;
+            }
+            columns[i][0].append(mins[i]);
+            columns[i][1].append(maxs[i]);
+            columns[i][2].append(sums[i] / count);
+        }
+    }
+    for (int i = 0; i < kSeriesCount; ++i) {
+        if (!network_ && (i == NetRx || i == NetTx)) continue;
+        Json::Value& entry = series[seriesName(static_cast<Series>(i))];
+        entry["min"] = columns[i][0];
+        entry["max"] = columns[i][1];
+        entry["avg"] = columns[i][2];
+    }
+    out["timestamps"] = timestamps;
+    out["series"] = series;
+    return out;
+}
+
+bool ResourceHistory::percentiles(Series series, int64_t windowSeconds, const std::vector<double>& ranks,
+                                  std::vector<double>& out) const {
+    const Ring& ring = rings_.front();
+    int64_t now = static_cast<int64_t>(std::time(nullptr));
+    std::vector<double> values;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& slot : ring.slots) {
+            if (slot.count > 0 && slot.start > now - windowSeconds) {
+                values.push_back(slot.cells[series].sum / slot.count);
+            }
+        }
+    }
+    if (values.empty()) {
+        return false;
+    }
+    std::sort(values.begin(), values.end());
+    out.clear();
+    for (double rank : ranks) {
+        // Nearest rank
+        size_t index = static_cast<size_t>(std::ceil(rank / 100.0 * values.size()));
+        out.push_back(values[std::min(values.size() - 1, index > 0 ? index - 1 : 0)]);
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef RESOURCE_HISTORY_H
+#define RESOURCE_HISTORY_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json/json.h>
+
+struct ResourceSnapshot;
+
+// Fixed-size, in-memory history of node resources at three resolutions:
+//
+//   1 s  x  600 slots  = last 10 minutes
+//   10 s x  360 slots  = last hour
+//   1 min x 1440 slots = last day
+//
+// Each slot keeps min, max and sum (floats) for the five series plus a
+// sample count and its start time: 5 * 12 + 4 + 8 = 72 bytes, so the whole
+// store is 2400 * 72 = 172,800 bytes (~169 KiB), allocated once at startup
+// and never grown. Every sample is folded into the current slot of all
+// three rings; a slot whose start time is stale is reset before reuse, so
+// gaps (agent paused, sampler late) show up as empty buckets.
+class ResourceHistory {
+public:
+    enum Series { Cpu, Memory, Disk, NetRx, NetTx, kSeriesCount };
+
+    ResourceHistory();
+
+    // Called by ResourceSampler after every pass.
+    void record(const ResourceSnapshot& snapshot);
+
+    // Buckets of `step` seconds covering the last `windowSeconds`, oldest
+    // first, from the finest ring that spans the window. step 0 picks the
+    // ring's own resolution; larger steps merge its buckets. Returns the
+    // JSON served by /api/v1/resources/history.
+    Json::Value query(int64_t windowSeconds, int64_t stepSeconds) const;
+
+    // Percentiles of per-second averages over the last `windowSeconds`
+    // (at most the 1 s ring's 10 minutes). Returns false without data.
+    bool percentiles(Series series, int64_t windowSeconds, const std::vector<double>& ranks,
+                     std::vector<double>& out) const;
+
+    static const char* seriesName(Series series);
+    // "90", "90s", "10m", "1h" or "1d" to seconds; false unless positive.
+    static bool parseSeconds(const std::string& text, int64_t& seconds);
+
+private:
+    struct Cell {
+        float min;
+        float max;
+        float sum;
+    };
+    struct Slot {
+        int64_t start = -1;   // unix seconds, -1 when never used
+        uint32_t count = 0;
+        Cell cells[kSeriesCount];
+    };
+    static_assert(sizeof(Slot) * (600 + 360 + 1440) == 172800, "history footprint no longer matches the header comment");
+    struct Ring {
+        int64_t step;         // seconds per slot
+        std::vector<Slot> slots;
+    };
+
+    static void fold(Slot& slot, int64_t start, const double (&values)[kSeriesCount]);
+
+    mutable std::mutex mutex_;
+    std::array<Ring, 3> rings_;
+    bool network_ = false; // the sampler found the node's network counters; net_* are left out otherwise
+};
+
+#endif // RESOURCE_HISTORY_H
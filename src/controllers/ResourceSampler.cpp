@@ -0,0 +1,376 @@
+#include "ResourceSampler.h"
+#include "NetDevReader.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+// Small /proc files are read in one go; /proc/stat grows with the core count.
+bool readProcFile(const char* path, std::string& content) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    content.resize(16384);
+    size_t used = 0;
+    while (true) {
+        if (used == content.size()) content.resize(content.size() * 2);
+        ssize_t n = read(fd, &content[used], content.size() - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += static_cast<size_t>(n);
+    }
+    close(fd);
+    content.resize(used);
+    return used > 0;
+}
+
+uint64_t namespaceInode(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? static_cast<uint64_t>(st.st_ino) : 0;
+}
+
+// Fixed inodes of the initial namespaces (include/linux/proc_ns.h).
+constexpr uint64_t kInitUtsNamespace = 0xEFFFFFFEU;
+constexpr uint64_t kInitPidNamespace = 0xEFFFFFFCU;
+
+} // namespace
+
+ResourceSampler::ResourceSampler(StorageCollector& storage, ResourceHistory& history)
+    : storage_(storage), history_(history), interval_(1000), snapshot_(std::make_shared<ResourceSnapshot>()) {
+    if (const char* interval = std::getenv("RESOURCE_SAMPLE_INTERVAL_MS")) {
+        int ms = std::atoi(interval);
+        if (ms >= 100) {
+            interval_ = std::chrono::milliseconds(ms);
+        } else {
+            LOG_WARN << "Invalid RESOURCE_SAMPLE_INTERVAL_MS: " << interval << ", using default: " << interval_.count();
+        }
+    }
+
+    // cgroup v2 only; the cgroupfs driver nests containers under /docker,
+    // the systemd driver under system.slice.
+    const char* cgroup = std::getenv("PSI_CGROUP");
+    std::vector<std::string> candidates;
+    if (cgroup && *cgroup) {
+        candidates.push_back(cgroup[0] == '/' ? cgroup : std::string("/sys/fs/cgroup/") + cgroup);
+    } else {
+        candidates = {"/sys/fs/cgroup/docker", "/sys/fs/cgroup/system.slice"};
+    }
+    for (const auto& candidate : candidates) {
+        if (access((candidate + "/cpu.pressure").c_str(), R_OK) == 0) {
+            pressureCgroup_ = candidate;
+            break;
+        }
+    }
+    if (cgroup && *cgroup && pressureCgroup_.empty()) {
+        LOG_WARN << "PSI_CGROUP " << cgroup << " has no pressure files, using system-wide pressure only";
+    }
+
+    netDevPid_ = hostNetworkPid();
+    if (netDevPid_ == 0) {
+        LOG_WARN << "The agent is not in the host network namespace, node network rates are not reported; "
+                    "run its container with network_mode: host";
+    }
+}
+
+// The node's network counters are those of the host network namespace. A
+// bridged agent container only sees its own eth0 in /proc/self/net/dev.
+int ResourceSampler::hostNetworkPid() {
+    uint64_t self = namespaceInode("/proc/self/ns/net");
+    uint64_t init = namespaceInode("/proc/1/ns/net");
+    if (self == 0) {
+        return 0;
+    }
+    if (init != 0 && init != self) {
+        return 1; // host PID namespace visible (pid: host): read host init's
+    }
+    if (namespaceInode("/proc/self/ns/pid") == kInitPidNamespace) {
+        return static_cast<int>(getpid()); // not containerized, or pid: host; same netns as init
+    }
+    // In our own PID namespace pid 1 is the container's init. Docker joins
+    // the host UTS namespace exactly when it joins the host network one.
+    if (namespaceInode("/proc/self/ns/uts") == kInitUtsNamespace) {
+        return static_cast<int>(getpid());
+    }
+    return 0;
+}
+
+ResourceSampler::~ResourceSampler() {
+    stop();
+}
+
+void ResourceSampler::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    sample();
+    thread_ = std::thread(&ResourceSampler::loop, this);
+}
+
+void ResourceSampler::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+std::shared_ptr<const ResourceSnapshot> ResourceSampler::snapshot() const {
+    return std::atomic_load(&snapshot_);
+}
+
+void ResourceSampler::loop() {
+    auto next = std::chrono::steady_clock::now() + interval_;
+    while (running_) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            if (wake_.wait_until(lock, next, [this] { return !running_; })) {
+                break;
+            }
+        }
+        sample();
+        // Fixed cadence; a late pass does not shift the ones after it.
+        next += interval_;
+        auto now = std::chrono::steady_clock::now();
+        if (next < now) next = now + interval_;
+    }
+}
+
+bool ResourceSampler::readCpuTicks(std::vector<CpuTicks>& ticks) {
+    std::string content;
+    if (!readProcFile("/proc/stat", content)) {
+        return false;
+    }
+    ticks.clear();
+    size_t lineStart = 0;
+    // The cpu lines come first; stop at the first line that is not one.
+    while (lineStart < content.size() && content.compare(lineStart, 3, "cpu") == 0) {
+        size_t lineEnd = content.find('\n', lineStart);
+        if (lineEnd == std::string::npos) lineEnd = content.size();
+        size_t nameEnd = content.find(' ', lineStart);
+        CpuTicks entry;
+        entry.name = content.substr(lineStart, nameEnd - lineStart);
+        const char* p = content.c_str() + nameEnd;
+        for (int i = 0; i < 8; ++i) {
+            char* end;
+            entry.fields[i] = std::strtoull(p, &end, 10);
+            if (end == p) break;
+            p = end;
+        }
+        ticks.push_back(std::move(entry));
+        lineStart = lineEnd + 1;
+    }
+    return !ticks.empty();
+}
+
+CpuUsage ResourceSampler::usage(const CpuTicks& current, const CpuTicks* previous) {
+    uint64_t delta[8];
+    uint64_t total = 0;
+    for (int i = 0; i < 8; ++i) {
+        uint64_t before = previous ? previous->fields[i] : 0;
+        // iowait may go backwards on some kernels; never count that as time.
+        delta[i] = current.fields[i] > before ? current.fields[i] - before : 0;
+        total += delta[i];
+    }
+    CpuUsage out;
+    out.name = current.name;
+    if (total == 0) {
+        out.idle = 100.0;
+        return out;
+    }
+    double scale = 100.0 / static_cast<double>(total);
+    out.user = delta[0] * scale;
+    out.nice = delta[1] * scale;
+    out.system = delta[2] * scale;
+    out.idle = delta[3] * scale;
+    out.iowait = delta[4] * scale;
+    out.irq = delta[5] * scale;
+    out.softirq = delta[6] * scale;
+    out.steal = delta[7] * scale;
+    return out;
+}
+
+PressureSample ResourceSampler::readPressure(const std::string& directory, const char* suffix) {
+    PressureSample out;
+    std::pair<const char*, PressureStall*> files[] = {{"cpu", &out.cpu}, {"memory", &out.memory}, {"io", &out.io}};
+    std::string content;
+    for (auto& file : files) {
+        if (!readProcFile((directory + "/" + file.first + suffix).c_str(), content)) {
+            continue;
+        }
+        // some avg10=0.12 avg60=0.05 avg300=0.01 total=12345
+        // full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+        PressureStall& stall = *file.second;
+        stall.available = true;
+        size_t lineStart = 0;
+        while (lineStart < content.size()) {
+            size_t lineEnd = content.find('\n', lineStart);
+            if (lineEnd == std::string::npos) lineEnd = content.size();
+            std::string line = content.substr(lineStart, lineEnd - lineStart);
+            bool some = line.compare(0, 4, "some") == 0;
+            size_t avg10 = line.find("avg10=");
+            size_t avg60 = line.find("avg60=");
+            if ((some || line.compare(0, 4, "full") == 0) && avg10 != std::string::npos && avg60 != std::string::npos) {
+                double ten = std::strtod(line.c_str() + avg10 + 6, nullptr);
+                double sixty = std::strtod(line.c_str() + avg60 + 6, nullptr);
+                (some ? stall.someAvg10 : stall.fullAvg10) = ten;
+                (some ? stall.someAvg60 : stall.fullAvg60) = sixty;
+            }
+            lineStart = lineEnd + 1;
+        }
+    }
+    return out;
+}
+
+void ResourceSampler::sample() {
+    auto started = std::chrono::steady_clock::now();
+    auto next = std::make_shared<ResourceSnapshot>();
+    next->sampledAt = std::chrono::system_clock::now();
+
+    std::vector<CpuTicks> ticks;
+    if (readCpuTicks(ticks)) {
+        bool haveBaseline = !previous_.empty();
+        for (const auto& current : ticks) {
+            const CpuTicks* previous = nullptr;
+            // Cores can go offline; match by name rather than position.
+            for (const auto& candidate : previous_) {
+                if (candidate.name == current.name) {
+                    previous = &candidate;
+                    break;
+                }
+            }
+            CpuUsage cpu = usage(current, previous);
+            if (current.name == "cpu") {
+                next->cpu = cpu;
+            } else {
+                next->cores.push_back(std::move(cpu));
+            }
+        }
+        next->cpuCount = static_cast<int>(next->cores.size());
+        next->intervalSeconds = haveBaseline ? std::chrono::duration<double>(started - previousAt_).count() : 0;
+        previous_ = std::move(ticks);
+        previousAt_ = started;
+    }
+
+    std::string content;
+    if (readProcFile("/proc/meminfo", content)) {
+        int64_t totalKb = 0, freeKb = 0, availableKb = -1, buffersKb = 0, cachedKb = 0;
+        size_t lineStart = 0;
+        while (lineStart < content.size()) {
+            size_t lineEnd = content.find('\n', lineStart);
+            if (lineEnd == std::string::npos) lineEnd = content.size();
+            size_t colon = content.find(':', lineStart);
+            if (colon != std::string::npos && colon < lineEnd) {
+                int64_t value = std::strtoll(content.c_str() + colon + 1, nullptr, 10);
+                std::string key = content.substr(lineStart, colon - lineStart);
+                if (key == "MemTotal") totalKb = value;
+                else if (key == "MemFree") freeKb = value;
+                else if (key == "MemAvailable") availableKb = value;
+                else if (key == "Buffers") buffersKb = value;
+                else if (key == "Cached") cachedKb = value;
+            }
+            lineStart = lineEnd + 1;
+        }
+        if (availableKb < 0) {
+            // Kernels before 3.14 have no MemAvailable.
+            availableKb = std::min(totalKb, freeKb + buffersKb + cachedKb);
+        }
+        next->totalMemoryMb = totalKb / 1024;
+        next->availableMemoryMb = availableKb / 1024;
+        if (totalKb > 0) {
+            next->memoryUsage = 100.0 * static_cast<double>(totalKb - availableKb) / static_cast<double>(totalKb);
+        }
+    }
+
+    if (readProcFile("/proc/loadavg", content)) {
+        const char* p = content.c_str();
+        char* end;
+        next->load1 = std::strtod(p, &end);
+        next->load5 = std::strtod(end, &end);
+        next->load15 = std::strtod(end, &end);
+    }
+
+    next->pressure = readPressure("/proc/pressure", "");
+    if (!pressureCgroup_.empty()) {
+        next->cgroupPressure = readPressure(pressureCgroup_, ".pressure");
+        next->pressureCgroup = pressureCgroup_;
+    }
+
+    std::vector<NetDevReader::Interface> interfaces;
+    if (netDevPid_ > 0 && NetDevReader::read(netDevPid_, interfaces)) {
+        next->networkAvailable = true;
+        uint64_t rx = 0, tx = 0;
+        for (const auto& iface : interfaces) {
+            if (iface.name == "lo") continue;
+            rx += iface.rxBytes;
+            tx += iface.txBytes;
+        }
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - previousNetAt_).count();
+        if (previousNetAt_.time_since_epoch().count() != 0 && seconds > 0) {
+            next->netRxBytesPerSecond = rx > previousRx_ ? (rx - previousRx_) / seconds : 0;
+            next->netTxBytesPerSecond = tx > previousTx_ ? (tx - previousTx_) / seconds : 0;
+        }
+        previousRx_ = rx;
+        previousTx_ = tx;
+        previousNetAt_ = now;
+    }
+
+    next->storage = storage_.collect();
+    for (const auto& fs : next->storage.filesystems) {
+        if (fs.path == "/") {
+            // df's Use% rounds up
+            next->diskUsage = static_cast<int>(std::ceil(fs.usedPercent));
+        }
+    }
+
+    history_.record(*next);
+    std::atomic_store(&snapshot_, std::shared_ptr<const ResourceSnapshot>(std::move(next)));
+    ++samplesTotal_;
+    lastDurationSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+void ResourceSampler::exportMetrics(MetricsRegistry& registry) const {
+    std::shared_ptr<const ResourceSnapshot> current = snapshot();
+    const char* help = "Share of the last sampling interval the node's CPUs spent in each mode";
+    const std::pair<const char*, double> modes[] = {
+        {"user", current->cpu.user}, {"nice", current->cpu.nice}, {"system", current->cpu.system},
+        {"idle", current->cpu.idle}, {"iowait", current->cpu.iowait}, {"irq", current->cpu.irq},
+        {"softirq", current->cpu.softirq}, {"steal", current->cpu.steal},
+    };
+    for (const auto& mode : modes) {
+        registry.gauge("persys_node_cpu_percent", help, {{"mode", mode.first}}, mode.second);
+    }
+    for (const auto& core : current->cores) {
+        MetricsRegistry::Labels labels = {{"cpu", core.name.substr(3)}};
+        registry.gauge("persys_node_cpu_core_busy_percent", "Share of the last sampling interval each core was busy", labels, core.busy());
+        registry.gauge("persys_node_cpu_core_iowait_percent", "Share of the last sampling interval each core waited on I/O", labels, core.iowait);
+        registry.gauge("persys_node_cpu_core_steal_percent", "Share of the last sampling interval each core lost to the hypervisor", labels, core.steal);
+    }
+    registry.gauge("persys_node_memory_available_bytes", "MemAvailable from /proc/meminfo", {},
+                   static_cast<double>(current->availableMemoryMb) * 1024 * 1024);
+    registry.gauge("persys_node_load1", "1-minute load average", {}, current->load1);
+    registry.gauge("persys_resource_sample_duration_seconds", "Time taken by the last resource sampling pass", {}, lastDurationSeconds_.load());
+    for (const auto& scope : {std::make_pair("host", &current->pressure), std::make_pair("cgroup", &current->cgroupPressure)}) {
+        const std::pair<const char*, const PressureStall*> resources[] = {
+            {"cpu", &scope.second->cpu}, {"memory", &scope.second->memory}, {"io", &scope.second->io}};
+        for (const auto& resource : resources) {
+            if (!resource.second->available) continue;
+            MetricsRegistry::Labels labels = {{"resource", resource.first}, {"scope", scope.first}};
+            registry.gauge("persys_node_pressure_some_percent", "PSI: share of the last 10s some tasks stalled on the resource", labels,
+                           resource.second->someAvg10);
+            registry.gauge("persys_node_pressure_full_percent", "PSI: share of the last 10s all tasks stalled on the resource", labels,
+                           resource.second->fullAvg10);
+        }
+    }
+    StorageCollector::exportMetrics(registry, current->storage);
+    registry.counter("persys_resource_samples_total", "Resource sampling passes", {}, static_cast<double>(samplesTotal_.load()));
+}
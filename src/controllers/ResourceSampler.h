@@ -0,0 +1,122 @@
+#ifndef RESOURCE_SAMPLER_H
+#define RESOURCE_SAMPLER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MetricsRegistry.h"
+#include "ResourceHistory.h"
+#include "StorageCollector.h"
+
+// Share of one sampling interval a CPU (or all of them) spent in each mode, in percent.
+struct CpuUsage {
+    std::string name; // "cpu" for the whole machine, "cpu0", "cpu1", ... per core
+    double user = 0;  // includes guest time, as the kernel counts it
+    double nice = 0;
+    double system = 0;
+    double idle = 0;
+    double iowait = 0;
+    double irq = 0;
+    double softirq = 0;
+    double steal = 0;
+
+    double busy() const { return 100.0 - idle - iowait; }
+};
+
+// One /proc/pressure or cgroup *.pressure file: share of wall time some
+// (or all) runnable tasks were stalled on the resource, in percent.
+struct PressureStall {
+    bool available = false;
+    double someAvg10 = 0;
+    double someAvg60 = 0;
+    double fullAvg10 = 0;  // cpu has no "full" line before 5.13; stays 0
+    double fullAvg60 = 0;
+};
+
+struct PressureSample {
+    PressureStall cpu;
+    PressureStall memory;
+    PressureStall io;
+};
+
+// Immutable result of one sampling pass, shared with readers.
+struct ResourceSnapshot {
+    std::chrono::system_clock::time_point sampledAt; // epoch until the first pass
+    double intervalSeconds = 0; // what the CPU figures cover; 0 means "since boot"
+    CpuUsage cpu;
+    std::vector<CpuUsage> cores;
+    int cpuCount = 0;           // online CPUs
+    int64_t totalMemoryMb = 0;
+    int64_t availableMemoryMb = 0;
+    double memoryUsage = 0;     // percent
+    double load1 = 0, load5 = 0, load15 = 0;
+    int diskUsage = -1;         // percent of / in use, as df reports it; -1 if unknown
+    bool networkAvailable = false;  // whether the node's own counters could be found
+    double netRxBytesPerSecond = 0; // all interfaces but lo, 0 on the first pass
+    double netTxBytesPerSecond = 0;
+    StorageSample storage;
+    PressureSample pressure;        // system-wide, /proc/pressure
+    PressureSample cgroupPressure;  // the cgroup workloads run under, if it has PSI
+    std::string pressureCgroup;     // path of that cgroup, empty if none
+};
+
+// Samples /proc/stat, /proc/meminfo, /proc/loadavg, pressure stall
+// information and the StorageCollector on a background thread every
+// RESOURCE_SAMPLE_INTERVAL_MS, and records each pass in the ResourceHistory.
+// CPU figures are the difference between consecutive /proc/stat readings,
+// so they describe the last interval rather than the average since boot.
+// Readers load the latest snapshot without blocking the sampler or each
+// other.
+class ResourceSampler {
+public:
+    ResourceSampler(StorageCollector& storage, ResourceHistory& history);
+    ~ResourceSampler();
+
+    // Takes a first reading synchronously, so snapshot() is populated once
+    // this returns; its CPU figures are since boot until the next pass.
+    void start();
+    void stop();
+
+    std::shared_ptr<const ResourceSnapshot> snapshot() const;
+
+    void exportMetrics(MetricsRegistry& registry) const;
+
+private:
+    struct CpuTicks {
+        std::string name;
+        uint64_t fields[8] = {0}; // user nice system idle iowait irq softirq steal
+    };
+
+    void loop();
+    void sample();
+    static bool readCpuTicks(std::vector<CpuTicks>& ticks);
+    static CpuUsage usage(const CpuTicks& current, const CpuTicks* previous);
+    static PressureSample readPressure(const std::string& directory, const char* suffix);
+    static int hostNetworkPid();
+
+    StorageCollector& storage_;
+    ResourceHistory& history_;
+    std::chrono::milliseconds interval_;
+    std::string pressureCgroup_;               // PSI_CGROUP, or where Docker puts containers
+    std::vector<CpuTicks> previous_;           // sampler thread only
+    std::chrono::steady_clock::time_point previousAt_;
+    int netDevPid_ = 0;                        // a process in the host network namespace, 0 if none
+    uint64_t previousRx_ = 0, previousTx_ = 0;  // host network byte counters
+    std::chrono::steady_clock::time_point previousNetAt_;
+    std::shared_ptr<const ResourceSnapshot> snapshot_;
+    std::atomic<double> lastDurationSeconds_{0};
+    std::atomic<uint64_t> samplesTotal_{0};
+
+    std::atomic<bool> running_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+};
+
+#endif // RESOURCE_SAMPLER_H
@@ -0,0 +1,233 @@
+#include "SessionStore.h"
+#include "Codec.h"
+#include "Logger.h"
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+
+namespace {
+
+constexpr size_t kKeyBytes = 32;
+constexpr size_t kIdBytes = 16;
+constexpr size_t kMaxSessions = 256;
+constexpr size_t kMaxSeenPerSession = 4096; // signatures remembered within one skew window
+
+int envSeconds(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    if (parsed > 0) {
+        return parsed;
+    }
+    LOG_WARN << "Invalid " << name << ": " << value << ", using default: " << fallback;
+    return fallback;
+}
+
+// RSA-OAEP with SHA-256, base64 encoded; empty on failure.
+std::string encryptTo(EVP_PKEY* key, const std::string& plaintext) {
+    std::string out;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(key, nullptr);
+    size_t length = 0;
+    if (ctx && EVP_PKEY_encrypt_init(ctx) > 0 && EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_OAEP_PADDING) > 0 &&
+        EVP_PKEY_CTX_set_rsa_oaep_md(ctx, EVP_sha256()) > 0 && EVP_PKEY_CTX_set_rsa_mgf1_md(ctx, EVP_sha256()) > 0 &&
+        EVP_PKEY_encrypt(ctx, nullptr, &length, reinterpret_cast<const unsigned char*>(plaintext.data()), plaintext.size()) > 0) {
+        std::vector<unsigned char> ciphertext(length);
+        if (EVP_PKEY_encrypt(ctx, ciphertext.data(), &length, reinterpret_cast<const unsigned char*>(plaintext.data()),
+                             plaintext.size()) > 0) {
+            std::vector<unsigned char> encoded(4 * ((length + 2) / 3) + 1);
+            int written = EVP_EncodeBlock(encoded.data(), ciphertext.data(), static_cast<int>(length));
+            out.assign(reinterpret_cast<const char*>(encoded.data()), static_cast<size_t>(written));
+        }
+    }
+    if (out.empty()) {
+        LOG_ERROR << "Failed to encrypt session key: " << ERR_error_string(ERR_get_error(), nullptr);
+    }
+    EVP_PKEY_CTX_free(ctx);
+    ERR_clear_error();
+    return out;
+}
+
+void hmac(const std::string& key, const std::string& method, const std::string& url, const std::string& timestamp,
+          const std::string& body, unsigned char (&out)[EVP_MAX_MD_SIZE], unsigned int& length) {
+    std::string message;
+    message.reserve(method.size() + url.size() + timestamp.size() + body.size() + 3);
+    message.append(method).append(1, '\n').append(url).append(1, '\n').append(timestamp).append(1, '\n').append(body);
+    HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()), reinterpret_cast<const unsigned char*>(message.data()),
+         message.size(), out, &length);
+}
+
+} // namespace
+
+SessionStore::SessionStore(TrustStore& trust)
+    : trust_(trust),
+      ttl_(envSeconds("SESSION_TTL_SECONDS", 900)),
+      maxSkew_(envSeconds("SESSION_MAX_SKEW_SECONDS", 30)),
+      authSeconds_({0.000005, 0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001}) {}
+
+Json::Value SessionStore::issue(std::string& error) {
+    std::shared_ptr<const TrustStore::TrustedKey> trusted = trust_.trusted();
+    if (!trusted) {
+        error = "No trusted scheduler key";
+        return Json::Value();
+    }
+    if (TrustStore::algorithm(trusted->key.get()) != TrustStore::Rsa) {
+        error = "Session keys need an RSA scheduler key";
+        return Json::Value();
+    }
+    unsigned char key[kKeyBytes];
+    unsigned char id[kIdBytes];
+    if (RAND_bytes(key, sizeof(key)) != 1 || RAND_bytes(id, sizeof(id)) != 1) {
+        error = "Failed to generate session key";
+        return Json::Value();
+    }
+    Session session;
+    session.key.assign(reinterpret_cast<const char*>(key), sizeof(key));
+    OPENSSL_cleanse(key, sizeof(key));
+    session.boundTo = trusted;
+    session.expiresAt = std::chrono::steady_clock::now() + ttl_;
+
+    std::string wrapped = encryptTo(trusted->key.get(), session.key);
+    if (wrapped.empty()) {
+        error = "Failed to encrypt session key";
+        return Json::Value();
+    }
+    std::string sessionId = Codec::hexEncode(id, sizeof(id));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = sessions_.begin(); it != sessions_.end();) {
+            it = it->second.expiresAt <= now || it->second.boundTo != trusted ? sessions_.erase(it) : std::next(it);
+        }
+        if (sessions_.size() >= kMaxSessions) {
+            auto oldest = sessions_.begin();
+            for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+                if (it->second.expiresAt < oldest->second.expiresAt) oldest = it;
+            }
+            sessions_.erase(oldest);
+        }
+        sessions_[sessionId] = std::move(session);
+    }
+    ++issuedTotal_;
+
+    Json::Value out;
+    out["id"] = sessionId;
+    out["key"] = wrapped;
+    out["algorithm"] = "HMAC-SHA256";
+    out["keyEncryption"] = "RSA-OAEP-SHA256";
+    out["expiresAt"] = static_cast<Json::Int64>(std::time(nullptr) + ttl_.count());
+    return out;
+}
+
+SessionStore::Result SessionStore::authenticate(const std::string& sessionId, const std::string& timestamp,
+                                                const std::string& signatureHex, const std::string& method,
+                                                const std::string& url, const std::string& body) {
+    auto started = std::chrono::steady_clock::now();
+    Result result = Result::Ok;
+    std::string key;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sessions_.find(sessionId);
+        if (it == sessions_.end()) {
+            result = Result::UnknownSession;
+        } else if (it->second.expiresAt <= started) {
+            sessions_.erase(it);
+            result = Result::Expired;
+        } else if (it->second.boundTo != trust_.trusted()) {
+            sessions_.erase(it);
+            result = Result::KeyRotated;
+        } else {
+            key = it->second.key;
+        }
+    }
+
+    long long sentAt = 0;
+    long long now = static_cast<long long>(std::time(nullptr));
+    if (result == Result::Ok) {
+        char* end = nullptr;
+        sentAt = std::strtoll(timestamp.c_str(), &end, 10);
+        if (timestamp.empty() || *end != '\0' || std::llabs(sentAt - now) > maxSkew_.count()) {
+            result = Result::StaleTimestamp;
+        }
+    }
+    std::vector<char> presented;
+    if (result == Result::Ok) {
+        unsigned char expected[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        hmac(key, method, url, timestamp, body, expected, length);
+        if (!Codec::hexDecode(signatureHex, presented) || presented.size() != length ||
+            CRYPTO_memcmp(expected, presented.data(), length) != 0) {
+            result = Result::BadSignature;
+        }
+    }
+    OPENSSL_cleanse(&key[0], key.size());
+
+    // Keyed on the decoded bytes, so a re-cased hex signature is the same one.
+    if (result == Result::Ok && method != "GET" && method != "HEAD") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sessions_.find(sessionId);
+        if (it == sessions_.end()) {
+            result = Result::UnknownSession; // purged while we checked
+        } else {
+            auto& seen = it->second.seen;
+            for (auto entry = seen.begin(); entry != seen.end();) {
+                entry = entry->second + maxSkew_.count() < now ? seen.erase(entry) : std::next(entry);
+            }
+            std::string signature(presented.begin(), presented.end());
+            if (seen.count(signature)) {
+                result = Result::Replayed;
+                ++replayedTotal_;
+            } else if (seen.size() >= kMaxSeenPerSession) {
+                result = Result::TooManyRequests;
+            } else {
+                seen.emplace(std::move(signature), sentAt);
+            }
+        }
+    }
+
+    authSeconds_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+    ++(result == Result::Ok ? acceptedTotal_ : rejectedTotal_);
+    return result;
+}
+
+const char* SessionStore::describe(Result result) {
+    switch (result) {
+        case Result::Ok: return "ok";
+        case Result::UnknownSession: return "Unknown session";
+        case Result::Expired: return "Session expired";
+        case Result::KeyRotated: return "Session was issued to a key that is no longer trusted";
+        case Result::StaleTimestamp: return "Session timestamp missing or outside the allowed skew";
+        case Result::BadSignature: return "Session signature mismatch";
+        case Result::Replayed: return "Session request was already accepted once";
+        case Result::TooManyRequests: return "Too many session requests within the timestamp window";
+    }
+    return "";
+}
+
+std::string SessionStore::sign(const std::string& key, const std::string& method, const std::string& url,
+                               const std::string& timestamp, const std::string& body) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    hmac(key, method, url, timestamp, body, digest, length);
+    return Codec::hexEncode(digest, length);
+}
+
+void SessionStore::exportMetrics(MetricsRegistry& registry) const {
+    registry.counter("persys_sessions_issued_total", "HMAC session keys issued at handshake", {}, static_cast<double>(issuedTotal_.load()));
+    const char* help = "Requests authenticated with a session HMAC, by result";
+    registry.counter("persys_session_authentications_total", help, {{"result", "valid"}}, static_cast<double>(acceptedTotal_.load()));
+    registry.counter("persys_session_authentications_total", help, {{"result", "invalid"}}, static_cast<double>(rejectedTotal_.load()));
+    registry.counter("persys_session_replays_rejected_total", "Session requests rejected because their signature was already used", {},
+                     static_cast<double>(replayedTotal_.load()));
+    registry.histogram("persys_session_authenticate_seconds", "Time to check one session HMAC", {}, authSeconds_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    registry.gauge("persys_sessions", "Session keys held, expired ones included until purged", {}, static_cast<double>(sessions_.size()));
+}
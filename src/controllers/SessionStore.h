@@ -0,0 +1,81 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <json/json.h>
+#include "MetricsRegistry.h"
+#include "TrustStore.h"
+
+// Short-lived HMAC session keys, so signed calls after the handshake cost a
+// SHA-256 HMAC instead of an RSA verification.
+//
+// A handshake that asks for a session ("session": true) gets a random 256-bit
+// key, encrypted with RSA-OAEP (SHA-256) to the scheduler key the handshake
+// was signed with, and an id. Later requests may then carry
+//
+//   X-Session-Id:        the id
+//   X-Session-Timestamp: unix seconds, within SESSION_MAX_SKEW_SECONDS of ours
+//   X-Session-Signature: hex HMAC-SHA256 over
+//                        METHOD "\n" raw URL (path and query) "\n" timestamp "\n" body
+//
+// instead of the RSA headers. A session dies after SESSION_TTL_SECONDS, or as
+// soon as the trusted key changes, since it is bound to the key it was issued
+// to. The handshake itself and key rotation always go through RSA.
+//
+// Every route accepts session auth, including ones that launch workloads,
+// so a signature is accepted once: each session remembers the signatures of
+// its non-GET requests until their timestamp leaves the skew window, and a
+// repeat is rejected. Byte-identical non-GET requests within one second
+// therefore need a new session or to wait a second. GETs only read, so they
+// are not tracked.
+class SessionStore {
+public:
+    enum class Result { Ok, UnknownSession, Expired, KeyRotated, StaleTimestamp, BadSignature, Replayed, TooManyRequests };
+
+    explicit SessionStore(TrustStore& trust);
+
+    // Issues a session bound to the currently trusted key. Returns the JSON
+    // for the handshake response ({id, key, algorithm, expiresAt}), or null
+    // with the reason in `error`. The key can only be wrapped for an RSA
+    // scheduler key; Ed25519 and ECDSA schedulers keep signing every request.
+    Json::Value issue(std::string& error);
+
+    Result authenticate(const std::string& sessionId, const std::string& timestamp, const std::string& signatureHex,
+                        const std::string& method, const std::string& url, const std::string& body);
+
+    static const char* describe(Result result);
+    // Hex HMAC-SHA256 as the scheduler is expected to compute it.
+    static std::string sign(const std::string& key, const std::string& method, const std::string& url,
+                            const std::string& timestamp, const std::string& body);
+
+    void exportMetrics(MetricsRegistry& registry) const;
+
+private:
+    struct Session {
+        std::string key;                                 // raw 32 bytes
+        std::shared_ptr<const TrustStore::TrustedKey> boundTo;
+        std::chrono::steady_clock::time_point expiresAt;
+        std::map<std::string, long long> seen;           // raw signature -> its timestamp
+    };
+
+    TrustStore& trust_;
+    std::chrono::seconds ttl_;
+    std::chrono::seconds maxSkew_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Session> sessions_;
+
+    MetricsRegistry::Histogram authSeconds_;
+    std::atomic<uint64_t> issuedTotal_{0};
+    std::atomic<uint64_t> acceptedTotal_{0};
+    std::atomic<uint64_t> rejectedTotal_{0};
+    std::atomic<uint64_t> replayedTotal_{0};
+};
+
+#endif // SESSION_STORE_H
@@ -0,0 +1,226 @@
+#include "StorageCollector.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kInfoTimeoutMs = 2000;
+constexpr auto kResolveRetry = std::chrono::seconds(60);
+constexpr uint64_t kSectorBytes = 512; // diskstats counts 512-byte sectors whatever the device uses
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole > 0 ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0;
+}
+
+uint64_t delta(uint64_t current, uint64_t previous) {
+    return current > previous ? current - previous : 0;
+}
+
+} // namespace
+
+StorageCollector::StorageCollector(DockerEngineClient& engine) : engine_(engine) {
+    if (const char* mounts = std::getenv("STORAGE_MOUNTS")) {
+        std::istringstream list(mounts);
+        std::string path;
+        while (std::getline(list, path, ',')) {
+            path.erase(0, path.find_first_not_of(' '));
+            path.erase(path.find_last_not_of(' ') + 1);
+            if (!path.empty()) configuredPaths_.push_back(path);
+        }
+    }
+}
+
+void StorageCollector::resolvePaths() {
+    if (pathsResolved_ || (!paths_.empty() && std::chrono::steady_clock::now() < nextResolve_)) {
+        return;
+    }
+    std::string dockerRoot;
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.get("/info", kInfoTimeoutMs);
+        if (res.ok()) {
+            dockerRoot = res.json()["DockerRootDir"].asString();
+            pathsResolved_ = true;
+        }
+    }
+    if (dockerRoot.empty()) {
+        const char* env = std::getenv("DOCKER_DATA_ROOT");
+        dockerRoot = env && *env ? env : "/var/lib/docker";
+        nextResolve_ = std::chrono::steady_clock::now() + kResolveRetry;
+    }
+
+    paths_ = {"/"};
+    if (dockerRoot != "/") {
+        paths_.push_back(dockerRoot);
+    }
+    for (const auto& path : configuredPaths_) {
+        if (std::find(paths_.begin(), paths_.end(), path) == paths_.end()) paths_.push_back(path);
+    }
+}
+
+bool StorageCollector::isWholeDisk(const std::string& device) {
+    auto it = wholeDisk_.find(device);
+    if (it != wholeDisk_.end()) {
+        return it->second;
+    }
+    // Partitions share their disk's I/O; loop and ram devices are not storage.
+    bool whole = device.compare(0, 4, "loop") != 0 && device.compare(0, 3, "ram") != 0 &&
+                 access(("/sys/block/" + device).c_str(), F_OK) == 0;
+    wholeDisk_[device] = whole;
+    return whole;
+}
+
+bool StorageCollector::readDiskstats(std::map<std::string, DiskCounters>& counters) {
+    int fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    std::string content(16384, '\0');
+    size_t used = 0;
+    while (true) {
+        if (used == content.size()) content.resize(content.size() * 2);
+        ssize_t n = read(fd, &content[used], content.size() - used);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        used += static_cast<size_t>(n);
+    }
+    close(fd);
+    content.resize(used);
+
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line)) {
+        // major minor name reads merged sectors ms writes merged sectors ms in-flight io_ms weighted_ms ...
+        std::istringstream fields(line);
+        unsigned major, minor;
+        std::string name;
+        uint64_t v[11] = {0};
+        if (!(fields >> major >> minor >> name)) continue;
+        for (auto& value : v) {
+            if (!(fields >> value)) break;
+        }
+        if (!isWholeDisk(name)) continue;
+        DiskCounters& c = counters[name];
+        c.reads = v[0];
+        c.sectorsRead = v[2];
+        c.readMs = v[3];
+        c.writes = v[4];
+        c.sectorsWritten = v[6];
+        c.writeMs = v[7];
+        c.ioMs = v[9];
+    }
+    return true;
+}
+
+StorageSample StorageCollector::collect() {
+    StorageSample sample;
+    resolvePaths();
+    for (const auto& path : paths_) {
+        struct statvfs fs;
+        if (statvfs(path.c_str(), &fs) != 0) {
+            continue; // not mounted (yet); try again next pass
+        }
+        FilesystemUsage usage;
+        usage.path = path;
+        uint64_t fragment = fs.f_frsize ? fs.f_frsize : fs.f_bsize;
+        usage.totalBytes = static_cast<uint64_t>(fs.f_blocks) * fragment;
+        usage.usedBytes = static_cast<uint64_t>(fs.f_blocks - fs.f_bfree) * fragment;
+        usage.availableBytes = static_cast<uint64_t>(fs.f_bavail) * fragment;
+        usage.usedPercent = percent(usage.usedBytes, usage.usedBytes + usage.availableBytes);
+        usage.totalInodes = fs.f_files;
+        usage.freeInodes = fs.f_ffree;
+        usage.usedInodes = fs.f_files - fs.f_ffree;
+        usage.inodesUsedPercent = percent(usage.usedInodes, usage.totalInodes);
+        sample.filesystems.push_back(usage);
+    }
+
+    std::map<std::string, DiskCounters> counters;
+    auto now = std::chrono::steady_clock::now();
+    if (readDiskstats(counters)) {
+        if (!previous_.empty()) {
+            double seconds = std::chrono::duration<double>(now - previousAt_).count();
+            for (const auto& entry : counters) {
+                auto before = previous_.find(entry.first);
+                if (before == previous_.end() || seconds <= 0) continue;
+                const DiskCounters& c = entry.second;
+                const DiskCounters& p = before->second;
+                uint64_t reads = delta(c.reads, p.reads);
+                uint64_t writes = delta(c.writes, p.writes);
+                DiskIo io;
+                io.device = entry.first;
+                io.readIops = reads / seconds;
+                io.writeIops = writes / seconds;
+                io.readBytesPerSecond = delta(c.sectorsRead, p.sectorsRead) * kSectorBytes / seconds;
+                io.writeBytesPerSecond = delta(c.sectorsWritten, p.sectorsWritten) * kSectorBytes / seconds;
+                io.readAwaitMs = reads ? static_cast<double>(delta(c.readMs, p.readMs)) / reads : 0;
+                io.writeAwaitMs = writes ? static_cast<double>(delta(c.writeMs, p.writeMs)) / writes : 0;
+                io.utilizationPercent = std::min(100.0, delta(c.ioMs, p.ioMs) / (seconds * 10.0));
+                sample.disks.push_back(io);
+            }
+        }
+        previous_ = std::move(counters);
+        previousAt_ = now;
+    }
+    return sample;
+}
+
+Json::Value StorageCollector::toJson(const StorageSample& sample) {
+    Json::Value out;
+    out["filesystems"] = Json::Value(Json::arrayValue);
+    for (const auto& fs : sample.filesystems) {
+        Json::Value entry;
+        entry["path"] = fs.path;
+        entry["total_bytes"] = static_cast<Json::UInt64>(fs.totalBytes);
+        entry["used_bytes"] = static_cast<Json::UInt64>(fs.usedBytes);
+        entry["available_bytes"] = static_cast<Json::UInt64>(fs.availableBytes);
+        entry["used_percent"] = fs.usedPercent;
+        entry["total_inodes"] = static_cast<Json::UInt64>(fs.totalInodes);
+        entry["used_inodes"] = static_cast<Json::UInt64>(fs.usedInodes);
+        entry["inodes_used_percent"] = fs.inodesUsedPercent;
+        out["filesystems"].append(entry);
+    }
+    out["disks"] = Json::Value(Json::arrayValue);
+    for (const auto& io : sample.disks) {
+        Json::Value entry;
+        entry["device"] = io.device;
+        entry["read_iops"] = io.readIops;
+        entry["write_iops"] = io.writeIops;
+        entry["read_bytes_per_second"] = io.readBytesPerSecond;
+        entry["write_bytes_per_second"] = io.writeBytesPerSecond;
+        entry["read_await_ms"] = io.readAwaitMs;
+        entry["write_await_ms"] = io.writeAwaitMs;
+        entry["utilization_percent"] = io.utilizationPercent;
+        out["disks"].append(entry);
+    }
+    return out;
+}
+
+void StorageCollector::exportMetrics(MetricsRegistry& registry, const StorageSample& sample) {
+    for (const auto& fs : sample.filesystems) {
+        MetricsRegistry::Labels labels = {{"path", fs.path}};
+        registry.gauge("persys_node_filesystem_size_bytes", "Filesystem size", labels, static_cast<double>(fs.totalBytes));
+        registry.gauge("persys_node_filesystem_avail_bytes", "Filesystem space available to unprivileged users", labels,
+                       static_cast<double>(fs.availableBytes));
+        registry.gauge("persys_node_filesystem_files", "Filesystem inodes", labels, static_cast<double>(fs.totalInodes));
+        registry.gauge("persys_node_filesystem_files_free", "Filesystem free inodes", labels, static_cast<double>(fs.freeInodes));
+    }
+    for (const auto& io : sample.disks) {
+        MetricsRegistry::Labels labels = {{"device", io.device}};
+        registry.gauge("persys_node_disk_read_iops", "Reads completed per second over the last sampling interval", labels, io.readIops);
+        registry.gauge("persys_node_disk_write_iops", "Writes completed per second over the last sampling interval", labels, io.writeIops);
+        registry.gauge("persys_node_disk_read_bytes_per_second", "Bytes read per second over the last sampling interval", labels,
+                       io.readBytesPerSecond);
+        registry.gauge("persys_node_disk_write_bytes_per_second", "Bytes written per second over the last sampling interval", labels,
+                       io.writeBytesPerSecond);
+        registry.gauge("persys_node_disk_read_await_seconds", "Average read latency over the last sampling interval", labels,
+                       io.readAwaitMs / 1000.0);
+        registry.gauge("persys_node_disk_write_await_seconds", "Average write latency over the last sampling interval", labels,
+                       io.writeAwaitMs / 1000.0);
+        registry.gauge("persys_node_disk_utilization_percent", "Share of the last sampling interval the device was busy", labels,
+                       io.utilizationPercent);
+    }
+}
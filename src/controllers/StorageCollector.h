@@ -0,0 +1,77 @@
+#ifndef STORAGE_COLLECTOR_H
+#define STORAGE_COLLECTOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "DockerEngineClient.h"
+#include "MetricsRegistry.h"
+
+struct FilesystemUsage {
+    std::string path;          // what was asked for: "/", the Docker data-root, a configured mount
+    uint64_t totalBytes = 0;
+    uint64_t usedBytes = 0;
+    uint64_t availableBytes = 0; // to unprivileged users, as df reports it
+    uint64_t totalInodes = 0;
+    uint64_t usedInodes = 0;
+    uint64_t freeInodes = 0;
+    double usedPercent = 0;      // used / (used + available), like df
+    double inodesUsedPercent = 0;
+};
+
+// One block device over the last sampling interval.
+struct DiskIo {
+    std::string device;
+    double readIops = 0;
+    double writeIops = 0;
+    double readBytesPerSecond = 0;
+    double writeBytesPerSecond = 0;
+    double readAwaitMs = 0;      // average time per completed read, queueing included
+    double writeAwaitMs = 0;
+    double utilizationPercent = 0; // share of the interval the device had I/O in flight
+};
+
+struct StorageSample {
+    std::vector<FilesystemUsage> filesystems;
+    std::vector<DiskIo> disks;   // empty on the first pass, which has no baseline
+};
+
+// Filesystem usage through statvfs and block-device rates from consecutive
+// /proc/diskstats readings. Watches "/", the Docker data-root (from the
+// Engine API, else DOCKER_DATA_ROOT, else /var/lib/docker) and the
+// comma-separated paths in STORAGE_MOUNTS. Not thread-safe: ResourceSampler
+// calls collect() from its own thread.
+class StorageCollector {
+public:
+    explicit StorageCollector(DockerEngineClient& engine);
+
+    StorageSample collect();
+
+    static Json::Value toJson(const StorageSample& sample);
+    static void exportMetrics(MetricsRegistry& registry, const StorageSample& sample);
+
+private:
+    struct DiskCounters {
+        uint64_t reads = 0, sectorsRead = 0, readMs = 0;
+        uint64_t writes = 0, sectorsWritten = 0, writeMs = 0;
+        uint64_t ioMs = 0;
+    };
+
+    void resolvePaths();
+    bool readDiskstats(std::map<std::string, DiskCounters>& counters);
+    bool isWholeDisk(const std::string& device);
+
+    DockerEngineClient& engine_;
+    std::vector<std::string> configuredPaths_;
+    std::vector<std::string> paths_;
+    bool pathsResolved_ = false;                // data-root came from the daemon
+    std::chrono::steady_clock::time_point nextResolve_;
+    std::map<std::string, bool> wholeDisk_;     // device -> listed in /sys/block
+    std::map<std::string, DiskCounters> previous_;
+    std::chrono::steady_clock::time_point previousAt_;
+};
+
+#endif // STORAGE_COLLECTOR_H
@@ -1,26 +1,34 @@
 #include "SwarmController.h"
-#include <array>
 #include <stdexcept>
 #include <sstream>
 
-SwarmController::SwarmController() {}
+SwarmController::SwarmController(DockerEngineClient& engine, CommandRunner& commands)
+    : engine_(engine), commands_(commands) {}
 
-std::string SwarmController::executeDockerCommand(const std::string& command) const {
-    std::string fullCommand = "docker " + command + " 2>&1";
-    std::array<char, 128> buffer;
-    std::string result;
-    FILE* pipe = popen(fullCommand.c_str(), "r");
-    if (!pipe) throw std::runtime_error("Failed to run Docker command");
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    pclose(pipe);
-    return result;
+std::string SwarmController::executeDockerCommand(const std::vector<std::string>& args) const {
+    std::vector<std::string> argv = {"docker"};
+    argv.insert(argv.end(), args.begin(), args.end());
+    CommandResult result = commands_.run(argv);
+    if (!result.started) throw std::runtime_error("Failed to run Docker command: " + result.error);
+    return result.combined();
 }
 
 Json::Value SwarmController::getStatus() {
-    std::string cmd = "info --format '{{json .Swarm}}'";
-    std::string rawOutput = executeDockerCommand(cmd);
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.get("/info");
+        if (!res.ok()) {
+            Json::Value status(Json::objectValue);
+            status["active"] = false;
+            status["message"] = res.errorMessage();
+            return status;
+        }
+        Json::StreamWriterBuilder writer;
+        return parseSwarmInfo(Json::writeString(writer, res.json()["Swarm"]));
+    }
+    return parseSwarmInfo(executeDockerCommand({"info", "--format", "{{json .Swarm}}"}));
+}
+
+Json::Value SwarmController::parseSwarmInfo(const std::string& rawOutput) const {
     Json::Value status(Json::objectValue);
 
     // Check for empty output or explicit Docker errors
@@ -59,8 +67,14 @@ Json::Value SwarmController::getStatus() {
 }
 
 std::string SwarmController::initSwarm() {
-    std::string cmd = "swarm init";
-    std::string result = executeDockerCommand(cmd);
+    if (engine_.useApi()) {
+        Json::Value request;
+        request["ListenAddr"] = "0.0.0.0:2377";
+        Json::StreamWriterBuilder writer;
+        DockerEngineClient::Response res = engine_.post("/swarm/init", Json::writeString(writer, request));
+        return res.ok() ? "Swarm initialized successfully" : res.errorMessage();
+    }
+    std::string result = executeDockerCommand({"swarm", "init"});
     return result.find("Error") == std::string::npos ? "Swarm initialized successfully" : result;
 }
 
@@ -68,25 +82,34 @@ std::string SwarmController::joinSwarm(const std::string& managerAddress, const
     if (managerAddress.empty() || token.empty()) {
         return "Error: Manager address and token are required";
     }
-    std::ostringstream cmd;
-    cmd << "swarm join --token " << token << " " << managerAddress;
-    std::string result = executeDockerCommand(cmd.str());
+    if (engine_.useApi()) {
+        Json::Value request;
+        request["ListenAddr"] = "0.0.0.0:2377";
+        request["RemoteAddrs"].append(managerAddress);
+        request["JoinToken"] = token;
+        Json::StreamWriterBuilder writer;
+        DockerEngineClient::Response res = engine_.post("/swarm/join", Json::writeString(writer, request), 60000);
+        return res.ok() ? "Joined swarm successfully" : res.errorMessage();
+    }
+    std::string result = executeDockerCommand({"swarm", "join", "--token", token, managerAddress});
     return result.find("Error") == std::string::npos ? "Joined swarm successfully" : result;
 }
 
 std::string SwarmController::leaveSwarm() {
-    std::string cmd = "swarm leave --force";
-    std::string result = executeDockerCommand(cmd);
+    if (engine_.useApi()) {
+        DockerEngineClient::Response res = engine_.post("/swarm/leave?force=true", "", 60000);
+        return res.ok() ? "Left swarm successfully" : res.errorMessage();
+    }
+    std::string result = executeDockerCommand({"swarm", "leave", "--force"});
     return result.find("Error") == std::string::npos ? "Left swarm successfully" : result;
 }
 
+// Stacks are a CLI-side concept (compose translation), so these stay on the docker CLI.
 std::string SwarmController::deployStack(const std::string& stackName, const std::string& composeFile) {
     if (stackName.empty() || composeFile.empty()) {
         return "Error: Stack name and compose file path are required";
     }
-    std::ostringstream cmd;
-    cmd << "stack deploy -c " << composeFile << " " << stackName;
-    std::string result = executeDockerCommand(cmd.str());
+    std::string result = executeDockerCommand({"stack", "deploy", "-c", composeFile, stackName});
     return result.find("Error") == std::string::npos ? "Stack deployed successfully" : result;
 }
 
@@ -94,7 +117,6 @@ std::string SwarmController::removeStack(const std::string& stackName) {
     if (stackName.empty()) {
         return "Error: Stack name is required";
     }
-    std::string cmd = "stack rm " + stackName;
-    std::string result = executeDockerCommand(cmd);
+    std::string result = executeDockerCommand({"stack", "rm", stackName});
     return result.find("Error") == std::string::npos ? "Stack removed successfully" : result;
 }
\ No newline at end of file
@@ -2,11 +2,14 @@
 #define SWARM_CONTROLLER_H
 
 #include <string>
+#include <vector>
 #include <json/json.h>
+#include "CommandRunner.h"
+#include "DockerEngineClient.h"
 
 class SwarmController {
 public:
-    SwarmController();
+    SwarmController(DockerEngineClient& engine, CommandRunner& commands);
     Json::Value getStatus();  // Existing method
     std::string initSwarm();  // Initialize a new Swarm
     std::string joinSwarm(const std::string& managerAddress, const std::string& token);  // Join an existing Swarm
@@ -15,7 +18,11 @@ public:
     std::string removeStack(const std::string& stackName);  // Remove a stack
 
 private:
-    std::string executeDockerCommand(const std::string& command) const;  // Helper to run Docker commands
+    std::string executeDockerCommand(const std::vector<std::string>& args) const;  // Helper to run Docker commands
+    Json::Value parseSwarmInfo(const std::string& rawOutput) const;
+
+    DockerEngineClient& engine_;
+    CommandRunner& commands_;
 };
 
 #endif // SWARM_CONTROLLER_H
\ No newline at end of file
@@ -1,106 +1,71 @@
 #include "SystemController.h"
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <cstdlib>
-#include <limits>
-#include <array>
-#include <stdexcept>
+#include <memory>
+#include <utility>
 
-SystemController::SystemController() {}
+namespace {
+
+Json::Value pressureJson(const PressureSample &sample) {
+    Json::Value out(Json::objectValue);
+    std::pair<const char *, const PressureStall *> resources[] = {
+        {"cpu", &sample.cpu}, {"memory", &sample.memory}, {"io", &sample.io}};
+    for (const auto &resource : resources) {
+        if (!resource.second->available) continue;
+        Json::Value &entry = out[resource.first];
+        entry["some_avg10"] = resource.second->someAvg10;
+        entry["some_avg60"] = resource.second->someAvg60;
+        entry["full_avg10"] = resource.second->fullAvg10;
+        entry["full_avg60"] = resource.second->fullAvg60;
+    }
+    return out;
+}
+
+} // namespace
+
+SystemController::SystemController(ResourceSampler &sampler) : sampler_(sampler) {}
 
 SystemController::~SystemController() {}
 
 Json::Value SystemController::getSystemResources() {
     Json::Value root;
+    std::shared_ptr<const ResourceSnapshot> snapshot = sampler_.snapshot();
 
-    // Get CPU usage
-    std::ifstream cpuFile("/proc/stat");
-    std::string line;
-    if (!cpuFile.is_open()) {
-        std::cerr << "Failed to open /proc/stat" << std::endl;
-        return root;
-    }
-    if (std::getline(cpuFile, line)) {
-        std::istringstream iss(line);
-        std::string cpu;
-        long user, nice, system, idle;
-        if (iss >> cpu >> user >> nice >> system >> idle) {
-            root["cpu_usage"] = 100.0 * (user + nice + system) / (user + nice + system + idle);
-        }
+    // CPU usage over the last sampling interval
+    root["cpu_usage"] = snapshot->cpu.busy();
+    root["cpu_iowait"] = snapshot->cpu.iowait;
+    root["cpu_steal"] = snapshot->cpu.steal;
+    root["cpu_interval_seconds"] = snapshot->intervalSeconds;
+    Json::Value cores(Json::arrayValue);
+    for (const auto &core : snapshot->cores) {
+        cores.append(core.busy());
     }
-    cpuFile.close();
+    root["cpu_cores_usage"] = cores;
+    root["total_cpu"] = snapshot->cpuCount > 0 ? snapshot->cpuCount : 4.0; // Fallback
+    root["available_cpu"] = root["total_cpu"].asDouble() * (1.0 - root["cpu_usage"].asDouble() / 100.0);
+    root["load_average"][0] = snapshot->load1;
+    root["load_average"][1] = snapshot->load5;
+    root["load_average"][2] = snapshot->load15;
 
-    // Get CPU count for total_cpu
-    std::ifstream cpuinfo("/proc/cpuinfo");
-    int cpu_count = 0;
-    if (cpuinfo.is_open()) {
-        while (std::getline(cpuinfo, line)) {
-            if (line.find("processor") == 0) cpu_count++;
-        }
-        cpuinfo.close();
+    // Memory usage
+    if (snapshot->totalMemoryMb > 0) {
+        root["total_memory"] = static_cast<Json::Int64>(snapshot->totalMemoryMb);
+        root["memory_usage"] = snapshot->memoryUsage;
+        root["available_memory"] = static_cast<Json::Int64>(snapshot->availableMemoryMb);
     }
-    root["total_cpu"] = cpu_count > 0 ? cpu_count : 4.0; // Fallback
-    root["available_cpu"] = root["total_cpu"].asDouble() * (1.0 - root["cpu_usage"].asDouble() / 100.0);
 
-    // Get Memory usage
-    std::ifstream memFile("/proc/meminfo");
-    long totalMem = 0, freeMem = 0, availableMem = 0, buffers = 0, cached = 0;
-    if (memFile.is_open()) {
-        std::string key;
-        long value;
-        while (memFile >> key >> value) {
-            if (key == "MemTotal:") totalMem = value / 1024; // Convert to MB
-            else if (key == "MemFree:") freeMem = value / 1024;
-            else if (key == "MemAvailable:") availableMem = value / 1024;
-            else if (key == "Buffers:") buffers = value / 1024;
-            else if (key == "Cached:") cached = value / 1024;
-            memFile.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-        }
-        if (totalMem > 0) {
-            root["total_memory"] = totalMem;
-            if (availableMem > 0) {
-                root["memory_usage"] = 100.0 * (totalMem - availableMem) / totalMem;
-                root["available_memory"] = availableMem;
-            } else {
-                long approxAvailable = freeMem + buffers + cached;
-                if (approxAvailable > totalMem) approxAvailable = totalMem;
-                root["memory_usage"] = 100.0 * (totalMem - approxAvailable) / totalMem;
-                root["available_memory"] = approxAvailable;
-            }
-        }
-    } else {
-        std::cerr << "Failed to open /proc/meminfo" << std::endl;
+    // Disk usage
+    if (snapshot->diskUsage >= 0) {
+        root["disk_usage"] = snapshot->diskUsage;
     }
-    memFile.close();
+    Json::Value storage = StorageCollector::toJson(snapshot->storage);
+    root["filesystems"] = storage["filesystems"];
+    root["disks"] = storage["disks"];
 
-    // Get Disk usage
-    std::string diskUsage = executeShellCommand("df -h --output=pcent / | tail -1 | tr -d ' %'");
-    try {
-        if (!diskUsage.empty()) {
-            root["disk_usage"] = std::stoi(diskUsage);
-        } else {
-            std::cerr << "Disk usage command returned empty result." << std::endl;
-        }
-    } catch (const std::invalid_argument& e) {
-        std::cerr << "Invalid argument in disk usage: " << e.what() << std::endl;
-    } catch (const std::out_of_range& e) {
-        std::cerr << "Disk usage value out of range: " << e.what() << std::endl;
+    // Pressure stall information, where the kernel has it (4.20+, PSI enabled)
+    root["pressure"] = pressureJson(snapshot->pressure);
+    if (!snapshot->pressureCgroup.empty()) {
+        root["cgroup_pressure"] = pressureJson(snapshot->cgroupPressure);
+        root["cgroup_pressure"]["cgroup"] = snapshot->pressureCgroup;
     }
 
     return root;
 }
-
-std::string SystemController::executeShellCommand(const std::string &command) {
-    std::array<char, 128> buffer;
-    std::string result;
-    FILE *pipe = popen(command.c_str(), "r");
-    if (!pipe) {
-        throw std::runtime_error("Failed to run command: " + command);
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    pclose(pipe);
-    return result;
-}
\ No newline at end of file
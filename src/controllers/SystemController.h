@@ -3,16 +3,19 @@
 
 #include <json/json.h>
 #include <string>
+#include <vector>
+#include "ResourceSampler.h"
 
 class SystemController {
 public:
-    SystemController();
+    explicit SystemController(ResourceSampler &sampler);
     ~SystemController();
 
+    // Built from the sampler's latest snapshot; never reads /proc or forks.
     Json::Value getSystemResources();
 
 private:
-    std::string executeShellCommand(const std::string &command);  // Add the declaration here
+    ResourceSampler &sampler_;
 };
 
 #endif // SYSTEMCONTROLLER_H
@@ -0,0 +1,332 @@
+#include "TrustStore.h"
+#include "Codec.h"
+#include "Logger.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/objects.h>
+#include <openssl/opensslv.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kDefaultCacheSize = 32;
+
+std::vector<double> verifyBuckets() {
+    return {0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.05};
+}
+
+bool isP256(const EVP_PKEY* key) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    char group[64];
+    size_t length = 0;
+    return EVP_PKEY_get_group_name(key, group, sizeof(group), &length) == 1 && OBJ_sn2nid(group) == NID_X9_62_prime256v1;
+#else
+    const EC_KEY* ec = EVP_PKEY_get0_EC_KEY(const_cast<EVP_PKEY*>(key));
+    return ec && EC_GROUP_get_curve_name(EC_KEY_get0_group(ec)) == NID_X9_62_prime256v1;
+#endif
+}
+
+std::string sha256(const std::string& data) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(), digest);
+    return std::string(reinterpret_cast<const char*>(digest), sizeof(digest));
+}
+
+} // namespace
+
+TrustStore::TrustStore(const std::string& path)
+    : path_(path), capacity_(kDefaultCacheSize),
+      verifySeconds_{MetricsRegistry::Histogram(verifyBuckets()), MetricsRegistry::Histogram(verifyBuckets()),
+                     MetricsRegistry::Histogram(verifyBuckets())} {
+    size_t slash = path_.rfind('/');
+    directory_ = slash == std::string::npos ? "." : (slash == 0 ? "/" : path_.substr(0, slash));
+    filename_ = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+
+    if (const char* size = std::getenv("PUBLIC_KEY_CACHE_SIZE")) {
+        int parsed = std::atoi(size);
+        if (parsed > 0) {
+            capacity_ = static_cast<size_t>(parsed);
+        } else {
+            LOG_WARN << "Invalid PUBLIC_KEY_CACHE_SIZE: " << size << ", using default: " << capacity_;
+        }
+    }
+    reload();
+}
+
+TrustStore::~TrustStore() {
+    stop();
+}
+
+void TrustStore::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    inotifyFd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (inotifyFd_ < 0 || wakeFd_ < 0 ||
+        inotify_add_watch(inotifyFd_, directory_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+        // Handshakes still update the key; only edits by hand go unnoticed.
+        LOG_WARN << "Trust store: cannot watch " << directory_ << ": " << std::strerror(errno);
+        if (inotifyFd_ >= 0) close(inotifyFd_);
+        if (wakeFd_ >= 0) close(wakeFd_);
+        inotifyFd_ = wakeFd_ = -1;
+        running_ = false;
+        return;
+    }
+    thread_ = std::thread(&TrustStore::watch, this);
+}
+
+void TrustStore::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+    (void)ignored;
+    if (thread_.joinable()) thread_.join();
+    close(inotifyFd_);
+    close(wakeFd_);
+    inotifyFd_ = wakeFd_ = -1;
+}
+
+void TrustStore::watch() {
+    alignas(inotify_event) char buffer[4096];
+    while (running_) {
+        struct pollfd fds[2] = {{inotifyFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_WARN << "Trust store: poll failed: " << std::strerror(errno);
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+        bool touched = false;
+        ssize_t length;
+        while ((length = read(inotifyFd_, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(p);
+                if (event->len > 0 && filename_ == event->name) {
+                    touched = true;
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        if (touched) {
+            reload();
+        }
+    }
+}
+
+void TrustStore::reload() {
+    std::lock_guard<std::mutex> lock(reloadMutex_);
+    std::string hex;
+    std::ifstream file(path_);
+    if (file.is_open()) {
+        std::getline(file, hex); // single line
+    }
+    std::shared_ptr<const TrustedKey> current = std::atomic_load(&trusted_);
+    if ((current ? current->hex : std::string()) == hex) {
+        return; // our own write, or nothing changed
+    }
+
+    std::shared_ptr<const TrustedKey> next;
+    if (!hex.empty()) {
+        std::shared_ptr<EVP_PKEY> key = parse(hex);
+        if (!key) {
+            // Keep what we have rather than trusting nothing, which would accept any key.
+            LOG_WARN << "Trust store: " << path_ << " does not hold a valid public key, keeping the previous one";
+            return;
+        }
+        next = std::make_shared<const TrustedKey>(TrustedKey{hex, std::move(key)});
+    }
+    std::atomic_store(&trusted_, next);
+    ++reloads_;
+    LOG_INFO << "Trusted public key " << (next ? "loaded from " : "removed with ") << path_;
+}
+
+std::shared_ptr<const TrustStore::TrustedKey> TrustStore::trusted() const {
+    return std::atomic_load(&trusted_);
+}
+
+bool TrustStore::trust(const std::string& publicKeyHex) {
+    std::shared_ptr<EVP_PKEY> key = this->key(publicKeyHex);
+    if (!key) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(reloadMutex_);
+    // Replace atomically, so the watcher never reads a half-written file.
+    std::string temp = path_ + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::trunc);
+        if (!file.is_open() || !(file << publicKeyHex)) {
+            LOG_ERROR << "Failed to write " << temp;
+            return false;
+        }
+    }
+    if (std::rename(temp.c_str(), path_.c_str()) != 0) {
+        LOG_ERROR << "Failed to replace " << path_ << ": " << std::strerror(errno);
+        std::remove(temp.c_str());
+        return false;
+    }
+    std::atomic_store(&trusted_, std::make_shared<const TrustedKey>(TrustedKey{publicKeyHex, std::move(key)}));
+    LOG_INFO << "Saved trusted public key to " << path_ << ": " << publicKeyHex.substr(0, 50) << "...";
+    return true;
+}
+
+std::shared_ptr<EVP_PKEY> TrustStore::parse(const std::string& publicKeyHex) {
+    std::vector<char> pem;
+    if (!Codec::hexDecode(publicKeyHex, pem) || pem.empty()) {
+        return nullptr;
+    }
+    BIO* bio = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+    if (!bio) {
+        return nullptr;
+    }
+    EVP_PKEY* key = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+    if (!key) {
+        ERR_clear_error();
+        return nullptr;
+    }
+    std::shared_ptr<EVP_PKEY> parsed(key, EVP_PKEY_free);
+    int type = EVP_PKEY_base_id(key);
+    if (type != EVP_PKEY_RSA && type != EVP_PKEY_ED25519 && !(type == EVP_PKEY_EC && isP256(key))) {
+        LOG_WARN << (type == EVP_PKEY_EC ? "Unsupported EC curve, only P-256 is accepted"
+                                         : std::string("Unsupported public key type: ") + OBJ_nid2sn(type));
+        return nullptr;
+    }
+    return parsed;
+}
+
+TrustStore::Algorithm TrustStore::algorithm(const EVP_PKEY* key) {
+    switch (EVP_PKEY_base_id(key)) {
+        case EVP_PKEY_ED25519: return Ed25519;
+        case EVP_PKEY_EC: return EcdsaP256;
+        default: return Rsa;
+    }
+}
+
+const char* TrustStore::algorithmName(Algorithm algorithm) {
+    switch (algorithm) {
+        case Rsa: return "rsa-pkcs1-sha256";
+        case Ed25519: return "ed25519";
+        case EcdsaP256: return "ecdsa-p256-sha256";
+        default: return "";
+    }
+}
+
+std::shared_ptr<EVP_PKEY> TrustStore::key(const std::string& publicKeyHex) {
+    std::shared_ptr<const TrustedKey> trusted = this->trusted();
+    if (trusted && trusted->hex == publicKeyHex) {
+        ++trustedHits_;
+        return trusted->key;
+    }
+
+    std::string digest = sha256(publicKeyHex);
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        auto it = index_.find(digest);
+        if (it != index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            ++cacheHits_;
+            return it->second->second;
+        }
+    }
+    ++cacheMisses_;
+
+    // Parse outside the lock; a concurrent miss on the same key parses twice
+    // and the second insert is dropped.
+    std::shared_ptr<EVP_PKEY> key = parse(publicKeyHex);
+    if (!key) {
+        ++parseFailures_;
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    if (!index_.count(digest)) {
+        lru_.emplace_front(digest, key);
+        index_[digest] = lru_.begin();
+        while (lru_.size() > capacity_) {
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+    return key;
+}
+
+bool TrustStore::verify(const std::string& body, const std::vector<char>& signature, const std::string& publicKeyHex) {
+    auto started = std::chrono::steady_clock::now();
+    std::shared_ptr<EVP_PKEY> key = this->key(publicKeyHex);
+    if (!key) {
+        LOG_WARN << "Failed to parse public key";
+        ++unparsedTotal_;
+        return false;
+    }
+
+    // One-shot EVP_DigestVerify covers all three: Ed25519 hashes internally
+    // and takes no digest, the others sign SHA-256.
+    Algorithm kind = algorithm(key.get());
+    bool ok = false;
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    EVP_PKEY_CTX* pctx = nullptr;
+    if (!ctx || EVP_DigestVerifyInit(ctx, &pctx, kind == Ed25519 ? nullptr : EVP_sha256(), nullptr, key.get()) <= 0 ||
+        (kind == Rsa && EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PADDING) <= 0)) {
+        LOG_ERROR << "Failed to initialize verification: " << ERR_error_string(ERR_get_error(), nullptr);
+    } else {
+        ok = EVP_DigestVerify(ctx, reinterpret_cast<const unsigned char*>(signature.data()), signature.size(),
+                              reinterpret_cast<const unsigned char*>(body.data()), body.size()) == 1;
+        if (!ok) {
+            LOG_WARN << "Signature verification failed (" << algorithmName(kind)
+                     << "): " << ERR_error_string(ERR_get_error(), nullptr);
+        }
+    }
+    EVP_MD_CTX_free(ctx);
+    ERR_clear_error();
+
+    verifySeconds_[kind].observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+    ++(ok ? verifiedTotal_[kind] : rejectedTotal_[kind]);
+    return ok;
+}
+
+void TrustStore::exportMetrics(MetricsRegistry& registry) const {
+    const char* help = "Request signatures checked, by key algorithm and result";
+    for (int i = 0; i < kAlgorithmCount; ++i) {
+        const char* name = algorithmName(static_cast<Algorithm>(i));
+        registry.counter("persys_signature_verifications_total", help, {{"algorithm", name}, {"result", "valid"}},
+                         static_cast<double>(verifiedTotal_[i].load()));
+        registry.counter("persys_signature_verifications_total", help, {{"algorithm", name}, {"result", "invalid"}},
+                         static_cast<double>(rejectedTotal_[i].load()));
+    }
+    registry.counter("persys_signature_verifications_total", help, {{"algorithm", "unknown"}, {"result", "invalid"}},
+                     static_cast<double>(unparsedTotal_.load()));
+    for (int i = 0; i < kAlgorithmCount; ++i) {
+        registry.histogram("persys_signature_verify_seconds", "Time to check one request signature, key lookup included",
+                           {{"algorithm", algorithmName(static_cast<Algorithm>(i))}}, verifySeconds_[i]);
+    }
+    const char* lookups = "Public key lookups, by where the parsed key came from";
+    registry.counter("persys_public_key_lookups_total", lookups, {{"source", "trusted"}}, static_cast<double>(trustedHits_.load()));
+    registry.counter("persys_public_key_lookups_total", lookups, {{"source", "cache"}}, static_cast<double>(cacheHits_.load()));
+    registry.counter("persys_public_key_lookups_total", lookups, {{"source", "parsed"}}, static_cast<double>(cacheMisses_.load()));
+    registry.counter("persys_public_key_parse_failures_total", "Public key headers that did not hold a valid PEM key", {},
+                     static_cast<double>(parseFailures_.load()));
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        registry.gauge("persys_public_key_cache_entries", "Parsed public keys in the LRU", {}, static_cast<double>(lru_.size()));
+    }
+    registry.gauge("persys_trusted_key_present", "1 while a trusted scheduler key is held", {}, trusted() ? 1 : 0);
+    registry.counter("persys_trusted_key_reloads_total", "Times the trusted key was reloaded after its file changed", {},
+                     static_cast<double>(reloads_.load()));
+}
@@ -0,0 +1,100 @@
+#ifndef TRUST_STORE_H
+#define TRUST_STORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <openssl/evp.h>
+#include "MetricsRegistry.h"
+
+// Public keys the scheduler signs requests with, parsed once rather than per
+// request.
+//
+// The trusted key (the one accepted at handshake, persisted in
+// trusted_key.txt) is held in memory as a parsed EVP_PKEY. It is replaced on
+// handshake and reloaded when an inotify watch on the file's directory sees
+// it written, replaced or removed, so edits by hand take effect without a
+// restart. Keys presented in X-Scheduler-PublicKey are parsed through an LRU
+// of PUBLIC_KEY_CACHE_SIZE entries keyed by the SHA-256 of the header value.
+//
+// The signature algorithm follows from the key type, so schedulers switch by
+// presenting a different key: RSA (PKCS#1 v1.5 with SHA-256), Ed25519 (over
+// the raw body, 64-byte signatures) or ECDSA P-256 with SHA-256 (DER
+// signatures). Keys of any other type or curve are rejected when parsed.
+class TrustStore {
+public:
+    enum Algorithm { Rsa, Ed25519, EcdsaP256, kAlgorithmCount };
+
+    struct TrustedKey {
+        std::string hex;                // as received: hex-encoded PEM
+        std::shared_ptr<EVP_PKEY> key;
+    };
+
+    explicit TrustStore(const std::string& path = "trusted_key.txt");
+    ~TrustStore();
+
+    // Starts and stops the inotify watcher.
+    void start();
+    void stop();
+
+    // Null while no key is trusted.
+    std::shared_ptr<const TrustedKey> trusted() const;
+    // Persists the key and trusts it from now on. False if it does not parse
+    // or cannot be written.
+    bool trust(const std::string& publicKeyHex);
+
+    // Signature over body by the key in publicKeyHex, with that key's algorithm.
+    bool verify(const std::string& body, const std::vector<char>& signature, const std::string& publicKeyHex);
+
+    // Parsed key for a header value, from the trusted key or the LRU. Null if
+    // it does not parse.
+    std::shared_ptr<EVP_PKEY> key(const std::string& publicKeyHex);
+    static std::shared_ptr<EVP_PKEY> parse(const std::string& publicKeyHex);
+    // For a key that parse() accepted.
+    static Algorithm algorithm(const EVP_PKEY* key);
+    static const char* algorithmName(Algorithm algorithm);
+
+    void exportMetrics(MetricsRegistry& registry) const;
+
+private:
+    using Lru = std::list<std::pair<std::string, std::shared_ptr<EVP_PKEY>>>; // most recent first
+
+    // Rereads the file; a missing or empty file leaves no key trusted.
+    void reload();
+    void watch();
+
+    std::string path_;
+    std::string directory_;
+    std::string filename_;
+    size_t capacity_;
+
+    std::shared_ptr<const TrustedKey> trusted_;   // atomic_load/atomic_store
+    std::mutex reloadMutex_;                      // serializes writers of trusted_
+
+    mutable std::mutex cacheMutex_;
+    Lru lru_;
+    std::unordered_map<std::string, Lru::iterator> index_; // SHA-256 of the header value
+
+    int inotifyFd_ = -1;
+    int wakeFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+
+    MetricsRegistry::Histogram verifySeconds_[kAlgorithmCount];
+    std::atomic<uint64_t> verifiedTotal_[kAlgorithmCount] = {};
+    std::atomic<uint64_t> rejectedTotal_[kAlgorithmCount] = {};
+    std::atomic<uint64_t> unparsedTotal_{0};       // rejected before a key was found
+    std::atomic<uint64_t> trustedHits_{0};
+    std::atomic<uint64_t> cacheHits_{0};
+    std::atomic<uint64_t> cacheMisses_{0};
+    std::atomic<uint64_t> parseFailures_{0};
+    std::atomic<uint64_t> reloads_{0};
+};
+
+#endif // TRUST_STORE_H
@@ -0,0 +1,287 @@
+#include "WorkloadStore.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <unistd.h>
+
+namespace {
+
+// Below this many entries the journal is never worth rewriting.
+constexpr size_t kMinCompactEntries = 1024;
+// Rewrite once the journal holds this many entries per live record.
+constexpr size_t kCompactRatio = 4;
+
+int64_t nowMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string toLine(const Json::Value &entry) {
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    return Json::writeString(writer, entry) + "\n";
+}
+
+bool writeAll(int fd, const std::string &data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t n = write(fd, data.data() + offset, data.size() - offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+Json::Value WorkloadRecord::toJson() const {
+    Json::Value out;
+    out["name"] = name;
+    out["workloadId"] = workloadId;
+    out["image"] = image;
+    out["jobId"] = jobId;
+    out["state"] = state;
+    out["reason"] = reason;
+    out["revision"] = static_cast<Json::UInt64>(revision);
+    out["updatedAt"] = static_cast<Json::Int64>(updatedAt);
+    return out;
+}
+
+WorkloadStore::WorkloadStore() : path_("workloads.journal") {
+    if (const char *path = std::getenv("WORKLOAD_STATE_PATH")) {
+        if (*path) path_ = path;
+    }
+}
+
+WorkloadStore::~WorkloadStore() {
+    if (fd_ >= 0) close(fd_);
+}
+
+WorkloadStore::Shard &WorkloadStore::shard(const std::string &name) {
+    return shards_[std::hash<std::string>{}(name) % kShards];
+}
+
+const WorkloadStore::Shard &WorkloadStore::shard(const std::string &name) const {
+    return shards_[std::hash<std::string>{}(name) % kShards];
+}
+
+void WorkloadStore::load() {
+    auto started = std::chrono::steady_clock::now();
+
+    // Appends from racing writers can land out of order, so the highest
+    // revision wins rather than the last line. A torn final line is skipped.
+    struct Replayed {
+        WorkloadRecord record;
+        bool removed = false;
+    };
+    std::map<std::string, Replayed> replayed;
+    uint64_t maxRevision = 0;
+    std::ifstream in(path_);
+    if (in.is_open()) {
+        Json::CharReaderBuilder builder;
+        std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        std::string line;
+        while (std::getline(in, line)) {
+            Json::Value entry;
+            std::string errs;
+            if (line.empty() || !reader->parse(line.data(), line.data() + line.size(), &entry, &errs) || !entry.isObject()) {
+                continue;
+            }
+            std::string name = entry["name"].asString();
+            uint64_t revision = entry["revision"].asUInt64();
+            if (name.empty()) continue;
+            maxRevision = std::max(maxRevision, revision);
+            Replayed &current = replayed[name];
+            if (current.record.revision > revision) continue;
+            current.removed = entry["removed"].asBool();
+            current.record.name = name;
+            current.record.workloadId = entry["workloadId"].asString();
+            current.record.image = entry["image"].asString();
+            current.record.jobId = entry["jobId"].asString();
+            current.record.state = entry["state"].asString();
+            current.record.reason = entry["reason"].asString();
+            current.record.revision = revision;
+            current.record.updatedAt = entry["updatedAt"].asInt64();
+        }
+    }
+
+    std::vector<WorkloadRecord> interrupted;
+    size_t restored = 0;
+    for (auto &entry : replayed) {
+        if (entry.second.removed) continue;
+        WorkloadRecord &record = entry.second.record;
+        if (record.pending()) {
+            interrupted.push_back(record);
+        }
+        Shard &s = shard(record.name);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        s.records[record.name] = std::move(record);
+        ++restored;
+    }
+    revision_ = maxRevision;
+    size_ = restored;
+
+    {
+        // Start from a compact journal without tombstones or torn lines.
+        std::lock_guard<std::mutex> lock(journalMutex_);
+        compact();
+    }
+
+    for (auto &record : interrupted) {
+        record.reason = "Launch interrupted by agent restart while " + record.state;
+        record.state = "failed";
+        update(record);
+    }
+
+    restoreSeconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    restoredRecords_ = restored;
+    LOG_INFO << "Restored " << restored << " workload records (" << interrupted.size() << " interrupted) from "
+             << path_ << " in " << restoreSeconds_ * 1000.0 << " ms";
+}
+
+void WorkloadStore::update(const WorkloadRecord &record) {
+    Json::Value entry;
+    {
+        Shard &s = shard(record.name);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.records.find(record.name);
+        WorkloadRecord next = record;
+        if (it != s.records.end()) {
+            // Phase updates only carry the state; keep what the launch recorded.
+            if (next.workloadId.empty()) next.workloadId = it->second.workloadId;
+            if (next.image.empty()) next.image = it->second.image;
+            if (next.jobId.empty()) next.jobId = it->second.jobId;
+        } else {
+            ++size_;
+        }
+        next.revision = ++revision_;
+        next.updatedAt = nowMillis();
+        entry = next.toJson();
+        s.records[record.name] = std::move(next);
+    }
+    append(entry);
+}
+
+void WorkloadStore::remove(const std::string &name) {
+    Json::Value entry;
+    {
+        Shard &s = shard(name);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        if (!s.records.erase(name)) {
+            return;
+        }
+        --size_;
+        entry["name"] = name;
+        entry["removed"] = true;
+        entry["revision"] = static_cast<Json::UInt64>(++revision_);
+    }
+    append(entry);
+}
+
+bool WorkloadStore::get(const std::string &name, WorkloadRecord &out) const {
+    const Shard &s = shard(name);
+    std::shared_lock<std::shared_mutex> lock(s.mutex);
+    auto it = s.records.find(name);
+    if (it == s.records.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+std::vector<WorkloadRecord> WorkloadStore::snapshot() const {
+    std::vector<WorkloadRecord> out;
+    out.reserve(size_.load());
+    for (const Shard &s : shards_) {
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        for (const auto &entry : s.records) {
+            out.push_back(entry.second);
+        }
+    }
+    return out;
+}
+
+bool WorkloadStore::openJournal() {
+    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd_ < 0) {
+        LOG_ERROR << "Failed to open workload journal " << path_ << ": " << std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void WorkloadStore::append(const Json::Value &entry) {
+    std::string line = toLine(entry);
+    std::lock_guard<std::mutex> lock(journalMutex_);
+    if (fd_ < 0 && !openJournal()) {
+        ++writeErrorsTotal_;
+        return;
+    }
+    // One write per entry with O_APPEND, so a crash loses at most a torn last line.
+    if (!writeAll(fd_, line)) {
+        ++writeErrorsTotal_;
+        LOG_ERROR << "Failed to append to workload journal " << path_ << ": " << std::strerror(errno);
+        return;
+    }
+    ++journalEntries_;
+    journalBytes_ += line.size();
+    if (journalEntries_ > std::max(kMinCompactEntries, kCompactRatio * size_.load())) {
+        compact();
+    }
+}
+
+// Must be called with journalMutex_ held. Writers that changed a shard
+// after the snapshot append to the new journal, and replay keeps the highest
+// revision, so nothing is lost to the swap.
+void WorkloadStore::compact() {
+    std::vector<WorkloadRecord> records = snapshot();
+    std::string data;
+    for (const auto &record : records) {
+        data += toLine(record.toJson());
+    }
+
+    std::string tmpPath = path_ + ".tmp";
+    int tmp = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (tmp < 0 || !writeAll(tmp, data) || fsync(tmp) != 0) {
+        LOG_ERROR << "Failed to compact workload journal " << path_ << ": " << std::strerror(errno);
+        if (tmp >= 0) close(tmp);
+        unlink(tmpPath.c_str());
+        ++writeErrorsTotal_;
+        if (fd_ < 0) openJournal();
+        return;
+    }
+    close(tmp);
+    if (std::rename(tmpPath.c_str(), path_.c_str()) != 0) {
+        LOG_ERROR << "Failed to replace workload journal " << path_ << ": " << std::strerror(errno);
+        unlink(tmpPath.c_str());
+        ++writeErrorsTotal_;
+        if (fd_ < 0) openJournal();
+        return;
+    }
+    if (fd_ >= 0) close(fd_);
+    openJournal();
+    journalEntries_ = records.size();
+    journalBytes_ = data.size();
+    ++compactionsTotal_;
+}
+
+void WorkloadStore::exportMetrics(MetricsRegistry &registry) const {
+    registry.gauge("persys_workload_store_records", "Workloads tracked in the workload state store", {}, static_cast<double>(size_.load()));
+    registry.gauge("persys_workload_journal_bytes", "Size of the workload state journal", {}, static_cast<double>(journalBytes_.load()));
+    registry.counter("persys_workload_journal_compactions_total", "Times the workload journal was rewritten from live records", {}, static_cast<double>(compactionsTotal_.load()));
+    registry.counter("persys_workload_journal_write_errors_total", "Failed workload journal appends or compactions", {}, static_cast<double>(writeErrorsTotal_.load()));
+    registry.gauge("persys_workload_store_restore_seconds", "Time taken to replay the workload journal at startup", {}, restoreSeconds_);
+    registry.gauge("persys_workload_store_restored_records", "Workload records restored from the journal at startup", {}, static_cast<double>(restoredRecords_));
+}
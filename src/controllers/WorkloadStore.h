@@ -0,0 +1,80 @@
+#ifndef WORKLOAD_STORE_H
+#define WORKLOAD_STORE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <json/json.h>
+#include "MetricsRegistry.h"
+
+struct WorkloadRecord {
+    std::string name;        // container name, the key
+    std::string workloadId;  // central's workload ID
+    std::string image;
+    std::string jobId;       // launch job that last touched it
+    std::string state;       // queued, pulling, creating, running, failed
+    std::string reason;      // why it is pending or failed; empty once running
+    uint64_t revision = 0;   // store-wide, increases with every change
+    int64_t updatedAt = 0;   // unix ms
+
+    bool pending() const { return state == "queued" || state == "pulling" || state == "creating"; }
+    Json::Value toJson() const;
+};
+
+// Workload launch state that outlives the agent. Records are spread over
+// fixed shards, each behind its own shared_mutex, so launch workers updating
+// different workloads never contend. Every change is appended to a JSON-lines
+// journal (WORKLOAD_STATE_PATH, default "workloads.journal"); load() replays
+// it at startup and the journal is rewritten from the live records once it
+// grows to several times their number.
+class WorkloadStore {
+public:
+    WorkloadStore();
+    ~WorkloadStore();
+
+    // Replays the journal. Launches that were still pending when the previous
+    // agent stopped are marked failed, since their queue did not survive.
+    void load();
+
+    void update(const WorkloadRecord &record);
+    void remove(const std::string &name);
+    bool get(const std::string &name, WorkloadRecord &out) const;
+    std::vector<WorkloadRecord> snapshot() const;
+
+    void exportMetrics(MetricsRegistry &registry) const;
+
+private:
+    static constexpr size_t kShards = 16;
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, WorkloadRecord> records;
+    };
+
+    Shard &shard(const std::string &name);
+    const Shard &shard(const std::string &name) const;
+    void append(const Json::Value &entry);
+    void compact();
+    bool openJournal();
+
+    std::string path_;
+    std::array<Shard, kShards> shards_;
+    std::atomic<uint64_t> revision_{0};
+    std::atomic<size_t> size_{0};
+
+    std::mutex journalMutex_;
+    int fd_ = -1;
+    size_t journalEntries_ = 0;
+    std::atomic<uint64_t> journalBytes_{0};
+    std::atomic<uint64_t> compactionsTotal_{0};
+    std::atomic<uint64_t> writeErrorsTotal_{0};
+    double restoreSeconds_ = 0;
+    size_t restoredRecords_ = 0;
+};
+
+#endif // WORKLOAD_STORE_H
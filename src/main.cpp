@@ -2,8 +2,22 @@
 #include "controllers/CronController.h"
 #include "controllers/DockerController.h"
 #include "controllers/SystemController.h"
+#include "controllers/ResourceSampler.h"
+#include "controllers/ResourceHistory.h"
+#include "controllers/StorageCollector.h"
 #include "controllers/NodeController.h"
+#include "controllers/TrustStore.h"
+#include "controllers/SessionStore.h"
 #include "controllers/SwarmController.h"
+#include "utils/DockerEngineClient.h"
+#include "utils/CommandRunner.h"
+#include "utils/ProcessSupervisor.h"
+#include "utils/Logger.h"
+#include "controllers/ContainerStateCache.h"
+#include "controllers/LaunchQueue.h"
+#include "controllers/WorkloadStore.h"
+#include "controllers/MetricsCollector.h"
+#include "controllers/HeartbeatClient.h"
 #include <crow.h>
 #include <json/json.h>
 #include "routes/HandshakeRoutes.h"
@@ -13,172 +27,92 @@
 #include "routes/SwarmRoutes.h"
 #include "routes/Middleware.h"
 #include <cstdlib>
-#include <iostream>
 #include <thread>
 #include <chrono>
 #include <curl/curl.h>
 #include <sstream>
 #include <map>
 
-// Heartbeat function (unchanged)
-bool sendHeartbeat(const std::string& centralUrl, const std::string& nodeId, const std::string& status, double availableCpu, int64_t availableMemory) {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Failed to initialize curl" << std::endl;
-        return false;
-    }
-
-    Json::Value heartbeat;
-    heartbeat["nodeId"] = nodeId;
-    heartbeat["status"] = status;
-    heartbeat["availableCpu"] = availableCpu;
-    heartbeat["availableMemory"] = availableMemory;
-
-    Json::StreamWriterBuilder writer;
-    std::string payload = Json::writeString(writer, heartbeat);
-
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-
-    curl_easy_setopt(curl, CURLOPT_URL, (centralUrl + "/nodes/heartbeat").c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, nullptr);
-
-    CURLcode res = curl_easy_perform(curl);
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-
-    if (res != CURLE_OK || http_code != 200) {
-        std::cerr << "Heartbeat failed for node " << nodeId << ": " << curl_easy_strerror(res) << ", HTTP " << http_code << std::endl;
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        return false;
-    }
-
-    std::cout << "Sent heartbeat for node " << nodeId << std::endl;
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-    return true;
-}
-
-// Heartbeat loop (unchanged)
-void heartbeatLoop(const std::string& centralUrl, NodeController& nodeCtrl, SystemController& sysCtrl) {
-    while (true) {
-        Json::Value resources = sysCtrl.getSystemResources();
-        std::string status = nodeCtrl.determineStatus(resources);
-        double availableCpu = resources.get("available_cpu", 0.99).asDouble();
-        int64_t availableMemory = resources.get("available_memory", 1354).asInt64();
-        sendHeartbeat(centralUrl, nodeCtrl.getNodeId(), status, availableCpu, availableMemory);
-        std::this_thread::sleep_for(std::chrono::minutes(4));
-    }
-}
-
 // Registration with retry (unchanged)
 bool registerWithRetry(NodeController& nodeCtrl, int maxRetries = 3, std::chrono::seconds delay = std::chrono::seconds(30)) {
     for (int attempt = 1; attempt <= maxRetries; ++attempt) {
         try {
             nodeCtrl.registerNode();
             if (nodeCtrl.isNodeReady()) {
-                std::cout << "Node " << nodeCtrl.getNodeId() << " registered and ready for workloads\n";
+                LOG_INFO << "Node " << nodeCtrl.getNodeId() << " registered and ready for workloads";
                 return true;
             } else {
-                std::cout << "Node " << nodeCtrl.getNodeId() << " registered but not ready\n";
+                LOG_INFO << "Node " << nodeCtrl.getNodeId() << " registered but not ready";
                 return true;
             }
         } catch (const std::exception& e) {
-            std::cerr << "Registration attempt " << attempt << "/" << maxRetries << " failed: " << e.what() << std::endl;
+            LOG_WARN << "Registration attempt " << attempt << "/" << maxRetries << " failed: " << e.what();
         }
         if (attempt < maxRetries) {
-            std::cout << "Retrying registration after " << delay.count() << " seconds\n";
+            LOG_INFO << "Retrying registration after " << delay.count() << " seconds";
             std::this_thread::sleep_for(delay);
         }
     }
-    std::cerr << "Node registration failed after " << maxRetries << " attempts\n";
+    LOG_ERROR << "Node registration failed after " << maxRetries << " attempts";
     return false;
 }
 
-// Prometheus metrics collection
-std::string collectDockerMetrics(DockerController& dockerCtrl) {
-    std::stringstream metrics;
-    
-    try {
-        auto containers = dockerCtrl.listContainers();
-        for (const auto& container : containers) {
-            auto stats = dockerCtrl.getContainerStats(container["Id"].asString());
-            
-            // Container metrics
-            metrics << "# HELP docker_container_cpu_usage_percent CPU usage percentage\n";
-            metrics << "# TYPE docker_container_cpu_usage_percent gauge\n";
-            metrics << "docker_container_cpu_usage_percent{container_id=\"" << container["Id"].asString() 
-                   << "\",name=\"" << container["Names"][0].asString() << "\"} " 
-                   << stats["cpu_percent"].asDouble() << "\n";
-            
-            metrics << "# HELP docker_container_memory_usage_bytes Memory usage in bytes\n";
-            metrics << "# TYPE docker_container_memory_usage_bytes gauge\n";
-            metrics << "docker_container_memory_usage_bytes{container_id=\"" << container["Id"].asString() 
-                   << "\",name=\"" << container["Names"][0].asString() << "\"} " 
-                   << stats["memory_usage"].asInt64() << "\n";
-            
-            metrics << "# HELP docker_container_memory_limit_bytes Memory limit in bytes\n";
-            metrics << "# TYPE docker_container_memory_limit_bytes gauge\n";
-            metrics << "docker_container_memory_limit_bytes{container_id=\"" << container["Id"].asString() 
-                   << "\",name=\"" << container["Names"][0].asString() << "\"} " 
-                   << stats["memory_limit"].asInt64() << "\n";
-            
-            metrics << "# HELP docker_container_network_rx_bytes Network received bytes\n";
-            metrics << "# TYPE docker_container_network_rx_bytes gauge\n";
-            metrics << "docker_container_network_rx_bytes{container_id=\"" << container["Id"].asString() 
-                   << "\",name=\"" << container["Names"][0].asString() << "\"} " 
-                   << stats["net_rx_bytes"].asInt64() << "\n";
-            
-            metrics << "# HELP docker_container_network_tx_bytes Network transmitted bytes\n";
-            metrics << "# TYPE docker_container_network_tx_bytes gauge\n";
-            metrics << "docker_container_network_tx_bytes{container_id=\"" << container["Id"].asString() 
-                   << "\",name=\"" << container["Names"][0].asString() << "\"} " 
-                   << stats["net_tx_bytes"].asInt64() << "\n";
-        }
-        
-        // Docker daemon metrics
-        auto info = dockerCtrl.getDockerInfo();
-        metrics << "# HELP docker_daemon_containers_running Number of running containers\n";
-        metrics << "# TYPE docker_daemon_containers_running gauge\n";
-        metrics << "docker_daemon_containers_running " << info["ContainersRunning"].asInt() << "\n";
-        
-        metrics << "# HELP docker_daemon_containers_stopped Number of stopped containers\n";
-        metrics << "# TYPE docker_daemon_containers_stopped gauge\n";
-        metrics << "docker_daemon_containers_stopped " << info["ContainersStopped"].asInt() << "\n";
-        
-        metrics << "# HELP docker_daemon_containers_paused Number of paused containers\n";
-        metrics << "# TYPE docker_daemon_containers_paused gauge\n";
-        metrics << "docker_daemon_containers_paused " << info["ContainersPaused"].asInt() << "\n";
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error collecting Docker metrics: " << e.what() << std::endl;
-    }
-    
-    return metrics.str();
-}
-
 int main() {
     std::string centralUrl = std::getenv("CENTRAL_URL") ? std::getenv("CENTRAL_URL") : "http://localhost:8084";
     if (centralUrl == "" || centralUrl == "http://localhost:8084") {
-        std::cerr << "Error: CENTRAL_URL environment variable not set" << std::endl;
+        LOG_ERROR << "CENTRAL_URL environment variable not set";
         return 1;
     }
     int agentPort = std::getenv("AGENT_PORT") ? std::stoi(std::getenv("AGENT_PORT")) : 8080;
 
+    // Log records are written by a background thread from here on
+    Logger::instance().start();
+
+    // Once, before any thread creates a curl handle
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
     // Initialize all controllers
-    SystemController sysCtrl;
-    NodeController nodeCtrl(centralUrl, sysCtrl, agentPort);
-    SwarmController swarmCtrl;
-    DockerController dockerCtrl;
-    ComposeController composeCtrl;
-    CronController cronCtrl;
+    DockerEngineClient dockerEngine;
+    ProcessSupervisor processSupervisor;
+    processSupervisor.start();
+    CommandRunner commandRunner(processSupervisor);
+    StorageCollector storageCollector(dockerEngine);
+    ResourceHistory resourceHistory;
+    ResourceSampler resourceSampler(storageCollector, resourceHistory);
+    resourceSampler.start();
+    SystemController sysCtrl(resourceSampler);
+    TrustStore trustStore;
+    trustStore.start();
+    SessionStore sessionStore(trustStore);
+    NodeController nodeCtrl(centralUrl, sysCtrl, dockerEngine, commandRunner, trustStore, agentPort);
+    SwarmController swarmCtrl(dockerEngine, commandRunner);
+    ContainerStateCache containerCache(dockerEngine);
+    WorkloadStore workloadStore;
+    workloadStore.load();
+    DockerController dockerCtrl(dockerEngine, containerCache, commandRunner, workloadStore);
+    LaunchQueue launchQueue(dockerCtrl, workloadStore);
+    MetricsCollector metricsCollector(dockerCtrl, containerCache);
+    metricsCollector.addSource([&launchQueue](MetricsRegistry& registry) { launchQueue.exportMetrics(registry); });
+    metricsCollector.addSource([&dockerCtrl](MetricsRegistry& registry) { dockerCtrl.imagePulls().exportMetrics(registry); });
+    metricsCollector.addSource([&processSupervisor](MetricsRegistry& registry) { processSupervisor.exportMetrics(registry); });
+    metricsCollector.addSource([&commandRunner](MetricsRegistry& registry) { commandRunner.exportMetrics(registry); });
+    metricsCollector.addSource([&workloadStore](MetricsRegistry& registry) { workloadStore.exportMetrics(registry); });
+    metricsCollector.addSource([&resourceSampler](MetricsRegistry& registry) { resourceSampler.exportMetrics(registry); });
+    metricsCollector.addSource([&nodeCtrl](MetricsRegistry& registry) { nodeCtrl.exportMetrics(registry); });
+    metricsCollector.addSource([&trustStore](MetricsRegistry& registry) { trustStore.exportMetrics(registry); });
+    metricsCollector.addSource([&sessionStore](MetricsRegistry& registry) { sessionStore.exportMetrics(registry); });
+    metricsCollector.addSource([](MetricsRegistry& registry) { Logger::instance().exportMetrics(registry); });
+    HeartbeatClient heartbeatClient(centralUrl, nodeCtrl, sysCtrl, containerCache, workloadStore, resourceHistory);
+    metricsCollector.addSource([&heartbeatClient](MetricsRegistry& registry) { heartbeatClient.exportMetrics(registry); });
+    ComposeController composeCtrl(commandRunner);
+    CronController cronCtrl(commandRunner);
+
+    // Follow Docker events so /docker/list is served from memory
+    containerCache.start();
 
     // Register node with retries
     if (!registerWithRetry(nodeCtrl)) {
-        std::cerr << "Failed to register node, exiting\n";
+        LOG_ERROR << "Failed to register node, exiting";
         return 1;
     }
 
@@ -186,11 +120,25 @@ int main() {
     crow::App<persys::SignatureMiddleware> app;
 
     app.get_middleware<persys::SignatureMiddleware>().setNodeController(nodeCtrl);
+    app.get_middleware<persys::SignatureMiddleware>().setSessionStore(sessionStore);
 
     // Add metrics endpoint before other routes to ensure it's not affected by middleware
+    // Served from the collector's pre-rendered snapshot; never touches Docker
     CROW_ROUTE(app, "/metrics")
-    ([&dockerCtrl]() {
-        return collectDockerMetrics(dockerCtrl);
+    ([&metricsCollector](const crow::request& req) {
+        MetricsRegistry::Format format = MetricsRegistry::negotiate(req.get_header_value("Accept"));
+        bool gzip = MetricsCollector::acceptsGzip(req.get_header_value("Accept-Encoding"));
+        std::shared_ptr<const MetricsCollector::Snapshot> snapshot = metricsCollector.snapshot();
+        if (gzip && snapshot->body(format, true).empty()) {
+            gzip = false; // compression failed for this snapshot
+        }
+        crow::response res(snapshot->body(format, gzip));
+        res.set_header("Content-Type", MetricsRegistry::contentType(format));
+        if (gzip) {
+            res.set_header("Content-Encoding", "gzip");
+        }
+        res.set_header("Vary", "Accept, Accept-Encoding");
+        return res;
     });
 
     // Health endpoint
@@ -200,6 +148,7 @@ int main() {
         Json::Value health;
         health["nodeId"] = nodeCtrl.getNodeId();
         health["status"] = nodeCtrl.determineStatus(resources);
+        health["readiness"] = nodeCtrl.capacity().last().score;
         health["availableCpu"] = resources.get("available_cpu", 0.99).asDouble();
         health["availableMemory"] = resources.get("available_memory", 1354).asInt64();
         health["timestamp"] = static_cast<long>(time(nullptr));
@@ -208,9 +157,31 @@ int main() {
         return Json::writeString(writer, health);
     });
 
+    // Resource history: min/max/avg per bucket, e.g. ?window=1h&step=1m.
+    // Served from the in-memory rollups, never from /proc.
+    CROW_ROUTE(app, "/api/v1/resources/history")
+    ([&resourceHistory](const crow::request& req) {
+        int64_t window = 600;
+        int64_t step = 0;
+        auto windowParam = req.url_params.get("window");
+        auto stepParam = req.url_params.get("step");
+        if ((windowParam && !ResourceHistory::parseSeconds(windowParam, window)) ||
+            (stepParam && !ResourceHistory::parseSeconds(stepParam, step))) {
+            crow::json::wvalue response;
+            response["error"] = "Invalid window/step: expected seconds or a duration like 10m, 1h or 1d";
+            return crow::response(400, response);
+        }
+
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        crow::response res(200, Json::writeString(writer, resourceHistory.query(window, step)));
+        res.set_header("Content-Type", "application/json");
+        return res;
+    });
+
     // Initialize all routes
-    persys::initializeHandshakeRoutes(app, nodeCtrl);
-    persys::initializeDockerRoutes(app, dockerCtrl);
+    persys::initializeHandshakeRoutes(app, nodeCtrl, sessionStore);
+    persys::initializeDockerRoutes(app, dockerCtrl, launchQueue);
     persys::initializeComposeRoutes(app, composeCtrl);
     persys::initializeCronRoutes(app, cronCtrl);
     persys::initializeSwarmRoutes(app, swarmCtrl);
@@ -224,13 +195,27 @@ int main() {
         res.end();
     });
 
-    // Start heartbeat thread
-    std::thread heartbeatThread(heartbeatLoop, centralUrl, std::ref(nodeCtrl), std::ref(sysCtrl));
+    // Start the launch workers before /docker/run can accept work
+    launchQueue.start();
+
+    // Start background metrics collection
+    metricsCollector.start();
+
+    // Start heartbeats
+    heartbeatClient.start();
 
     // Run the app
     app.port(agentPort).multithreaded().run();
 
-    // Clean up
-    heartbeatThread.detach();
+    // Clean up: stop the background threads before the objects they use go
+    // out of scope, newest first, rather than leaving it to destructor order.
+    heartbeatClient.stop();
+    metricsCollector.stop();
+    launchQueue.stop();
+    containerCache.stop();
+    resourceSampler.stop();
+    trustStore.stop();
+    processSupervisor.stop();
+    Logger::instance().stop();
     return 0;
 }
\ No newline at end of file
@@ -1,13 +1,207 @@
 #include "DockerRoutes.h"
+#include "Logger.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <json/json.h>
+#include <set>
 #include <sstream>
 #include <thread>
 
 namespace persys {
 
-void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerController& dockerController) {
+namespace {
 
-    CROW_ROUTE(app, "/docker/run").methods("POST"_method)([&dockerController](const crow::request &req) {
+// Log follows and pull waits hold a Crow worker for the whole wait, and
+// there are only hardware_concurrency of those. At most LONG_POLL_LIMIT
+// (default a quarter of the workers, at least one) may wait at once; the
+// rest get 429 and Retry-After, so health checks and launches keep a worker.
+class LongPollSlot {
+public:
+    // Takes a slot only if the request is going to wait.
+    explicit LongPollSlot(bool waits) : waits_(waits), held_(waits && inUse_.fetch_add(1) < limit()) {
+        if (waits_ && !held_) --inUse_;
+    }
+    ~LongPollSlot() {
+        if (held_) --inUse_;
+    }
+    bool rejected() const { return waits_ && !held_; }
+
+    static crow::response busy() {
+        crow::json::wvalue response;
+        response["error"] = "Too many long-polling requests, retry later or without wait";
+        crow::response res(429, response);
+        res.set_header("Retry-After", "1");
+        return res;
+    }
+
+private:
+    static int limit() {
+        static const int value = [] {
+            if (const char* env = std::getenv("LONG_POLL_LIMIT")) {
+                int parsed = std::atoi(env);
+                if (parsed > 0) return parsed;
+                LOG_WARN << "Invalid LONG_POLL_LIMIT: " << env << ", using default";
+            }
+            return std::max(1, static_cast<int>((std::thread::hardware_concurrency() + 3) / 4));
+        }();
+        return value;
+    }
+
+    static std::atomic<int> inUse_;
+    bool waits_;
+    bool held_;
+};
+
+std::atomic<int> LongPollSlot::inUse_{0};
+
+// Launches still queued or in progress have no container yet (or one that is
+// still being created), so they are listed from the launch queue, with the
+// PID of the `docker run` child when the CLI is doing the work. Launches that
+// failed before a container existed come from the workload store.
+void appendPendingLaunches(Json::Value &containers, const std::vector<LaunchJob> &jobs,
+                           const std::vector<ChildProcess> &children, const std::vector<WorkloadRecord> &workloads) {
+    std::set<std::string> listed;
+    for (const auto &container : containers) {
+        listed.insert(container["names"].asString());
+    }
+    auto now = std::chrono::system_clock::now();
+    for (const auto &job : jobs) {
+        if (job.name.empty() || listed.count(job.name)) continue;
+        Json::Value synthetic;
+        synthetic["id"] = "";
+        synthetic["names"] = job.name;
+        synthetic["image"] = job.image;
+        synthetic["ports"] = "";
+        synthetic["jobId"] = job.id;
+        synthetic["sinceMinutes"] = std::chrono::duration<double>(now - job.queuedAt).count() / 60.0;
+        if (job.state == "queued") {
+            synthetic["status"] = "Pending";
+            synthetic["reason"] = "waiting for a launch worker";
+        } else if (job.state == "pulling") {
+            synthetic["status"] = "Pulling";
+            synthetic["reason"] = "pulling image";
+        } else {
+            synthetic["status"] = "ContainerCreating";
+            synthetic["reason"] = "creating container";
+        }
+        for (const auto &child : children) {
+            if (child.tag == job.name) {
+                synthetic["reason"] = synthetic["reason"].asString() + " (PID " + std::to_string(child.pid) + ")";
+                break;
+            }
+        }
+        containers.append(synthetic);
+        listed.insert(job.name);
+    }
+    for (const auto &record : workloads) {
+        if (record.state != "failed" || listed.count(record.name)) continue;
+        Json::Value synthetic;
+        synthetic["id"] = "";
+        synthetic["names"] = record.name;
+        synthetic["image"] = record.image;
+        synthetic["ports"] = "";
+        synthetic["jobId"] = record.jobId;
+        synthetic["status"] = "Failed";
+        synthetic["reason"] = record.reason;
+        containers.append(synthetic);
+    }
+}
+
+LaunchRequest parseLaunchRequest(const Json::Value &spec) {
+    LaunchRequest launch;
+    launch.workloadId = spec["workloadId"].asString();
+    launch.image = spec["image"].asString();
+    launch.name = spec["name"].asString(); // This is now the workload ID
+    launch.command = spec["command"].asString();
+    for (const auto &port : spec["ports"]) {
+        launch.ports.push_back(port.asString());
+    }
+    if (spec["env"].isObject()) {
+        for (const auto& key : spec["env"].getMemberNames()) {
+            launch.envVars.push_back(key + "=" + spec["env"][key].asString());
+        }
+    }
+    for (const auto &volume : spec["volumes"]) {
+        launch.volumes.push_back(volume.asString());
+    }
+    launch.network = spec["network"].asString();
+    launch.restartPolicy = spec["restartPolicy"].asString();
+    launch.detach = spec.get("detach", true).asBool();
+    launch.labels.push_back("displayName=" + spec["displayName"].asString());
+    launch.labels.push_back("workloadId=" + launch.workloadId);
+    return launch;
+}
+
+bool isStringArray(const Json::Value &value) {
+    if (value.isNull()) return true;
+    if (!value.isArray()) return false;
+    for (const auto &item : value) {
+        if (!item.isString()) return false;
+    }
+    return true;
+}
+
+// Batch items are checked up front so a bad spec fails the request before
+// anything starts. /docker/run keeps its historical leniency.
+std::string validateLaunchSpec(const Json::Value &spec) {
+    if (!spec.isObject()) {
+        return "item must be an object";
+    }
+    std::string image = spec["image"].asString();
+    if (!spec["image"].isString() || image.empty()) {
+        return "image is required";
+    }
+    if (image.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-/:@") != std::string::npos) {
+        return "invalid image reference: " + image;
+    }
+    std::string name = spec["name"].asString();
+    if (!spec["name"].isString() || name.empty()) {
+        return "name is required";
+    }
+    // Docker's container name rule: [a-zA-Z0-9][a-zA-Z0-9_.-]+
+    if (!std::isalnum(static_cast<unsigned char>(name[0])) ||
+        name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-") != std::string::npos) {
+        return "invalid container name: " + name;
+    }
+    if (!isStringArray(spec["ports"])) return "ports must be an array of strings";
+    if (!isStringArray(spec["volumes"])) return "volumes must be an array of strings";
+    const Json::Value &env = spec["env"];
+    if (!env.isNull()) {
+        if (!env.isObject()) return "env must be an object";
+        for (const auto &key : env.getMemberNames()) {
+            if (key.empty() || key.find('=') != std::string::npos) return "invalid env name: " + key;
+            if (!env[key].isConvertibleTo(Json::stringValue) || env[key].isNull()) return "env " + key + " must be a scalar";
+        }
+    }
+    for (const char *field : {"workloadId", "displayName", "command", "network", "restartPolicy"}) {
+        if (!spec[field].isNull() && !spec[field].isString()) return std::string(field) + " must be a string";
+    }
+    std::string restart = spec["restartPolicy"].asString();
+    if (!restart.empty() && restart != "no" && restart != "always" && restart != "unless-stopped" &&
+        restart.compare(0, 10, "on-failure") != 0) {
+        return "invalid restartPolicy: " + restart;
+    }
+    if (!spec["detach"].isNull() && !spec["detach"].isBool()) return "detach must be a boolean";
+    return "";
+}
+
+crow::response jsonResponse(int code, const Json::Value &body) {
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "";
+    crow::response res(code, Json::writeString(writer, body));
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
+
+} // namespace
+
+void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerController& dockerController,
+                            LaunchQueue& launchQueue) {
+
+    CROW_ROUTE(app, "/docker/run").methods("POST"_method)([&launchQueue](const crow::request &req) {
         Json::CharReaderBuilder builder;
         Json::Value jsonPayload;
         std::string errs;
@@ -18,70 +212,150 @@ void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerC
             return crow::response(400, response);
         }
 
-        std::string workloadId = jsonPayload["workloadId"].asString();
-        std::string image = jsonPayload["image"].asString();
-        std::string name = jsonPayload["name"].asString(); // This is now the workload ID
         std::string displayName = jsonPayload["displayName"].asString(); // Original name for display
-        std::string command = jsonPayload["command"].asString();
-        std::vector<std::string> ports;
-        for (const auto &port : jsonPayload["ports"]) {
-            ports.push_back(port.asString());
-        }
-        std::vector<std::string> envVars;
-        if (jsonPayload["env"].isObject()) {
-            for (const auto& key : jsonPayload["env"].getMemberNames()) {
-                envVars.push_back(key + "=" + jsonPayload["env"][key].asString());
+        LaunchRequest launch = parseLaunchRequest(jsonPayload);
+
+        // The full command line is only built when debug logging is on;
+        // environment values may hold secrets, so only their names are shown.
+        if (Logger::instance().enabled(Logger::Level::Debug)) {
+            std::ostringstream command;
+            command << "Docker Command: run -d --name " << launch.name
+                    << " --label displayName=" << displayName
+                    << " --restart=" << launch.restartPolicy;
+            for (const auto& port : launch.ports) {
+                command << " -p " << port;
+            }
+            for (const auto& volume : launch.volumes) {
+                command << " -v " << volume;
+            }
+            for (const auto& env : launch.envVars) {
+                command << " -e " << env.substr(0, env.find('='));
             }
+            if (!launch.network.empty()) {
+                command << " --network " << launch.network;
+            }
+            if (!launch.command.empty()) {
+                command << " " << launch.command;
+            }
+            LOG_DEBUG << command.str() << " " << launch.image;
         }
-        std::vector<std::string> volumes;
-        for (const auto &volume : jsonPayload["volumes"]) {
-            volumes.push_back(volume.asString());
+
+        // Launches run on the queue's worker pool; the job ID tracks progress
+        std::string jobId = launchQueue.submit(launch);
+        if (jobId.empty()) {
+            crow::json::wvalue response;
+            response["error"] = "Launch queue is full, retry later";
+            response["workloadId"] = launch.workloadId;
+            crow::response res(503, response);
+            res.set_header("Retry-After", "5");
+            return res;
         }
-        std::string network = jsonPayload["network"].asString();
-        std::string restartPolicy = jsonPayload["restartPolicy"].asString();
-        bool detach = jsonPayload["detach"].asBool();
-        bool async = jsonPayload["async"].asBool();
 
-        std::cout << "Docker Command: run -d --name " << name 
-                  << " --label displayName=" << displayName
-                  << " --restart=" << restartPolicy;
-        for (const auto& port : ports) {
-            std::cout << " -p " << port;
+        // Return immediately
+        crow::json::wvalue response;
+        response["result"] = "Command queued for execution";
+        response["workloadId"] = launch.workloadId;
+        response["jobId"] = jobId;
+        return crow::response(200, response);
+    });
+
+    // Many launches in one signed round-trip: validated together, queued
+    // together (or not at all), and each distinct missing image pulled once.
+    CROW_ROUTE(app, "/docker/run/batch").methods("POST"_method)([&dockerController, &launchQueue](const crow::request &req) {
+        Json::CharReaderBuilder builder;
+        Json::Value payload;
+        std::string errs;
+        std::istringstream s(req.body);
+        Json::Value response;
+        if (!Json::parseFromStream(builder, s, &payload, &errs)) {
+            response["error"] = "Invalid JSON: " + errs;
+            return jsonResponse(400, response);
         }
-        for (const auto& volume : volumes) {
-            std::cout << " -v " << volume;
+        // Either {"items": [...], "concurrency": N} or a bare array of items.
+        const Json::Value &items = payload.isArray() ? payload : payload["items"];
+        if (!items.isArray() || items.empty()) {
+            response["error"] = "items must be a non-empty array";
+            return jsonResponse(400, response);
         }
-        for (const auto& env : envVars) {
-            std::cout << " -e \"" << env << "\"";
+        const Json::Value concurrency = payload.isObject() ? payload["concurrency"] : Json::Value();
+        if (!concurrency.isNull() && (!concurrency.isUInt() || concurrency.asUInt() == 0)) {
+            response["error"] = "concurrency must be a positive integer";
+            return jsonResponse(400, response);
         }
-        if (!network.empty()) {
-            std::cout << " --network " << network;
+
+        std::vector<LaunchRequest> launches;
+        launches.reserve(items.size());
+        std::set<std::string> names;
+        Json::Value invalid(Json::arrayValue);
+        for (Json::ArrayIndex i = 0; i < items.size(); ++i) {
+            std::string error = validateLaunchSpec(items[i]);
+            if (error.empty() && !names.insert(items[i]["name"].asString()).second) {
+                error = "duplicate name in batch: " + items[i]["name"].asString();
+            }
+            if (!error.empty()) {
+                Json::Value item;
+                item["index"] = i;
+                item["error"] = error;
+                invalid.append(item);
+                continue;
+            }
+            launches.push_back(parseLaunchRequest(items[i]));
         }
-        if (!command.empty()) {
-            std::cout << " " << command;
+        if (!invalid.empty()) {
+            response["error"] = "Invalid batch, nothing was started";
+            response["items"] = invalid;
+            return jsonResponse(400, response);
         }
-        std::cout << " " << image << std::endl;
 
-        // Prepare labels
-        std::vector<std::string> labels;
-        labels.push_back("displayName=" + displayName);
-        labels.push_back("workloadId=" + workloadId);
+        std::vector<std::string> jobIds;
+        std::string batchId = launchQueue.submitBatch(launches, concurrency.isNull() ? 0 : concurrency.asUInt(), jobIds);
+        if (batchId.empty()) {
+            response["error"] = "Launch queue cannot take " + std::to_string(launches.size()) + " launches, retry later";
+            crow::response res = jsonResponse(503, response);
+            res.set_header("Retry-After", "5");
+            return res;
+        }
 
-        // Execute the Docker command (always async now, but return immediately)
-        std::thread([&dockerController, image, name, ports, envVars, volumes, labels, network, restartPolicy, detach, command]() {
-            try {
-                std::string result = dockerController.startContainer(image, name, ports, envVars, volumes, labels, network, restartPolicy, detach, command);
-                std::cout << "Container execution result for " << name << ": " << result << std::endl;
-            } catch (const std::exception& e) {
-                std::cerr << "Exception during container execution for " << name << ": " << e.what() << std::endl;
-            }
-        }).detach();
+        // Start each missing image once; launches of it join that pull
+        // instead of discovering the image is missing one by one.
+        Json::Value pulls(Json::objectValue);
+        std::set<std::string> images;
+        for (const auto &launch : launches) {
+            std::string reference = ImagePullManager::normalizeReference(launch.image);
+            if (!images.insert(reference).second || dockerController.hasImage(launch.image)) continue;
+            bool coalesced = false;
+            pulls[reference] = dockerController.imagePulls().startPull(launch.image, coalesced);
+        }
 
-        // Return immediately
-        crow::json::wvalue response;
-        response["result"] = "Command queued for execution";
-        response["workloadId"] = workloadId;
-        return crow::response(200, response);
+        response["result"] = "Batch queued for execution";
+        response["batchId"] = batchId;
+        response["jobs"] = Json::Value(Json::arrayValue);
+        for (size_t i = 0; i < launches.size(); ++i) {
+            Json::Value job;
+            job["index"] = static_cast<Json::UInt>(i);
+            job["workloadId"] = launches[i].workloadId;
+            job["name"] = launches[i].name;
+            job["jobId"] = jobIds[i];
+            response["jobs"].append(job);
+        }
+        response["pulls"] = pulls;
+        LOG_INFO << "Queued batch " << batchId << " with " << launches.size() << " launches, "
+                 << pulls.size() << " image pulls";
+        return jsonResponse(200, response);
+    });
+
+    CROW_ROUTE(app, "/docker/jobs/<string>").methods("GET"_method)([&launchQueue](const crow::request &req, const std::string &jobId) {
+        LaunchJob job;
+        if (!launchQueue.job(jobId, job)) {
+            crow::json::wvalue response;
+            response["error"] = "Unknown job: " + jobId;
+            return crow::response(404, response);
+        }
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        crow::response res(200, Json::writeString(writer, job.toJson()));
+        res.set_header("Content-Type", "application/json");
+        return res;
     });
 
     CROW_ROUTE(app, "/docker/stop/<string>").methods("POST"_method)([&dockerController](const crow::request &req, const std::string &id) {
@@ -91,18 +365,22 @@ void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerC
         return crow::response(200, response);
     });
 
-    CROW_ROUTE(app, "/docker/list").methods("GET"_method)([&dockerController](const crow::request &req) {
+    CROW_ROUTE(app, "/docker/list").methods("GET"_method)([&dockerController, &launchQueue](const crow::request &req) {
         bool all = true;
         if (auto allParam = req.url_params.get("all")) {
             all = std::string(allParam) == "true";
         }
 
-        Json::Value containers = dockerController.listContainers(all);
-        crow::json::wvalue response;
+        // Serialize once; round-tripping through crow::json costs more than the cached listing.
+        Json::Value response;
+        response["result"] = dockerController.listContainers(all);
+        appendPendingLaunches(response["result"], launchQueue.inFlight(), dockerController.processes().running(),
+                              dockerController.workloads().snapshot());
         Json::StreamWriterBuilder writer;
-        std::string jsonString = Json::writeString(writer, containers);
-        response["result"] = crow::json::load(jsonString);
-        return crow::response(200, response);
+        writer["indentation"] = "";
+        crow::response res(200, Json::writeString(writer, response));
+        res.set_header("Content-Type", "application/json");
+        return res;
     });
 
     CROW_ROUTE(app, "/docker/remove/<string>").methods("POST"_method)([&dockerController](const crow::request &req, const std::string &id) {
@@ -112,11 +390,60 @@ void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerC
         return crow::response(200, response);
     });
 
+    // Paged logs: each response carries at most `limit` bytes and a cursor to
+    // continue from; with follow=true a caught-up request waits up to `wait`
+    // seconds for new output before returning an empty page.
     CROW_ROUTE(app, "/docker/logs/<string>").methods("GET"_method)([&dockerController](const crow::request &req, const std::string &id) {
-        std::string result = dockerController.getContainerLogs(id);
-        crow::json::wvalue response;
-        response["result"] = result;
-        return crow::response(200, response);
+        LogQuery query;
+        if (auto tail = req.url_params.get("tail")) {
+            if (std::string(tail) != "all") query.tail = std::max(0, std::atoi(tail));
+        }
+        auto since = req.url_params.get("since");
+        auto until = req.url_params.get("until");
+        if ((since && !ContainerLogReader::parseTime(since, query.sinceNanos)) ||
+            (until && !ContainerLogReader::parseTime(until, query.untilNanos))) {
+            crow::json::wvalue response;
+            response["error"] = "Invalid since/until: expected unix seconds, RFC3339 or a duration like 10m";
+            return crow::response(400, response);
+        }
+        if (auto follow = req.url_params.get("follow")) {
+            query.follow = std::string(follow) == "true" || std::string(follow) == "1";
+        }
+        if (auto timestamps = req.url_params.get("timestamps")) {
+            query.timestamps = std::string(timestamps) == "true" || std::string(timestamps) == "1";
+        }
+        if (auto cursor = req.url_params.get("cursor")) {
+            query.cursor = cursor;
+        }
+        if (auto limit = req.url_params.get("limit")) {
+            query.maxBytes = static_cast<size_t>(std::min(std::max(std::atol(limit), 4096L), 8L << 20));
+        }
+        if (auto wait = req.url_params.get("wait")) {
+            query.waitMs = std::min(std::max(std::atoi(wait), 0), 60) * 1000;
+        }
+
+        LongPollSlot slot(query.follow && query.waitMs > 0);
+        if (slot.rejected()) {
+            return LongPollSlot::busy();
+        }
+        LogPage page = dockerController.readContainerLogs(id, query);
+        if (!page.error.empty()) {
+            crow::json::wvalue response;
+            response["error"] = page.error;
+            return crow::response(page.notFound ? 404 : 500, response);
+        }
+
+        Json::Value response;
+        response["result"] = page.text;
+        response["cursor"] = page.cursor;
+        response["more"] = page.more;
+        response["ended"] = page.ended;
+        response["source"] = page.source;
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        crow::response res(200, Json::writeString(writer, response));
+        res.set_header("Content-Type", "application/json");
+        return res;
     });
 
     CROW_ROUTE(app, "/docker/images").methods("GET"_method)([&dockerController](const crow::request &req) {
@@ -140,12 +467,50 @@ void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerC
             return crow::response(400, response);
         }
         std::string image = payload["image"].asString();
-        std::string result = dockerController.pullImage(image);
+        if (image.empty()) {
+            crow::json::wvalue response;
+            response["error"] = "Error: Image name cannot be empty";
+            return crow::response(400, response);
+        }
+
+        // Pulls run in the background; concurrent requests for the same image share one pull
+        bool coalesced = false;
+        std::string pullId = dockerController.imagePulls().startPull(image, coalesced);
         crow::json::wvalue response;
-        response["result"] = result;
+        response["result"] = coalesced ? "Joined pull in progress" : "Pull started";
+        response["pullId"] = pullId;
+        response["image"] = ImagePullManager::normalizeReference(image);
         return crow::response(200, response);
     });
 
+    // Pull progress. With ?wait=N the request is held until the pull reports
+    // progress newer than ?version= (or finishes), up to N seconds.
+    CROW_ROUTE(app, "/docker/pulls/<string>").methods("GET"_method)([&dockerController](const crow::request &req, const std::string &pullId) {
+        uint64_t afterVersion = 0;
+        int waitMs = 0;
+        if (auto version = req.url_params.get("version")) {
+            afterVersion = std::strtoull(version, nullptr, 10);
+        }
+        if (auto wait = req.url_params.get("wait")) {
+            waitMs = std::min(std::max(std::atoi(wait), 0), 60) * 1000;
+        }
+        LongPollSlot slot(waitMs > 0);
+        if (slot.rejected()) {
+            return LongPollSlot::busy();
+        }
+        ImagePullStatus status;
+        if (!dockerController.imagePulls().status(pullId, status, afterVersion, waitMs)) {
+            crow::json::wvalue response;
+            response["error"] = "Unknown pull: " + pullId;
+            return crow::response(404, response);
+        }
+        Json::StreamWriterBuilder writer;
+        writer["indentation"] = "";
+        crow::response res(200, Json::writeString(writer, status.toJson()));
+        res.set_header("Content-Type", "application/json");
+        return res;
+    });
+
     CROW_ROUTE(app, "/docker/login").methods("POST"_method)([&dockerController](const crow::request &req) {
         Json::CharReaderBuilder builder;
         Json::Value payload;
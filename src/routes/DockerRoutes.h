@@ -3,10 +3,12 @@
 
 #include <crow.h>
 #include "DockerController.h"
+#include "LaunchQueue.h"
 #include "Middleware.h"
 
 namespace persys {
-void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerController& DockerController);
+void initializeDockerRoutes(crow::App<persys::SignatureMiddleware>& app, DockerController& DockerController,
+                            LaunchQueue& launchQueue);
 } // namespace persys
 
 #endif // DOCKER_ROUTES_H
\ No newline at end of file
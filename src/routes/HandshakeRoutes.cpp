@@ -1,10 +1,12 @@
 #include "HandshakeRoutes.h"
+#include "Logger.h"
 #include <crow.h>
 #include <json/json.h>
 
 namespace persys{
-    void initializeHandshakeRoutes(crow::App<persys::SignatureMiddleware>& app, NodeController& nodeController) {
-        CROW_ROUTE(app, "/api/v1/handshake").methods("POST"_method)([&nodeController](const crow::request& req) {
+    void initializeHandshakeRoutes(crow::App<persys::SignatureMiddleware>& app, NodeController& nodeController,
+                                   SessionStore& sessions) {
+        CROW_ROUTE(app, "/api/v1/handshake").methods("POST"_method)([&nodeController, &sessions](const crow::request& req) {
             Json::Value payload;
             Json::CharReaderBuilder builder;
             std::string errs;
@@ -16,11 +18,22 @@ namespace persys{
             std::string schedulerId = payload["schedulerId"].asString();
             std::string timestamp = payload["timestamp"].asString();
 
-            std::cout << "Received handshake from scheduler: " << schedulerId << ", timestamp: " << timestamp << std::endl;
+            LOG_INFO << "Received handshake from scheduler: " << schedulerId << ", timestamp: " << timestamp;
 
             Json::Value response;
             response["message"] = "Handshake successful";
             response["nodeId"] = nodeController.getNodeId();
+            // Opt-in: a key for HMAC-signed requests, encrypted to the scheduler key just trusted
+            if (payload["session"].asBool()) {
+                std::string error;
+                Json::Value session = sessions.issue(error);
+                if (session.isNull()) {
+                    // The handshake itself succeeded; the scheduler keeps signing each request.
+                    response["sessionError"] = error;
+                } else {
+                    response["session"] = session;
+                }
+            }
             Json::StreamWriterBuilder writer;
             return crow::response(200, Json::writeString(writer, response));
         });
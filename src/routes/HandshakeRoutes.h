@@ -3,10 +3,12 @@
 
 #include <crow.h>
 #include "NodeController.h"
+#include "SessionStore.h"
 #include "Middleware.h"
 
 namespace persys {
-    void initializeHandshakeRoutes(crow::App<persys::SignatureMiddleware>& app, NodeController& nodeController);
+    void initializeHandshakeRoutes(crow::App<persys::SignatureMiddleware>& app, NodeController& nodeController,
+                                   SessionStore& sessions);
 } // namespace persys
 
 #endif // HANDSHAKE_ROUTES_H
\ No newline at end of file
@@ -3,8 +3,9 @@
 
 #include <crow.h>
 #include <string>
-#include <iostream>
 #include "NodeController.h"
+#include "SessionStore.h"
+#include "Logger.h"
 
 namespace persys {
 
@@ -12,11 +13,16 @@ struct SignatureMiddleware {
     struct context {};
 
     NodeController* nodeController = nullptr;
+    SessionStore* sessionStore = nullptr;
 
     void setNodeController(NodeController& nc) {
         nodeController = &nc;
     }
 
+    void setSessionStore(SessionStore& sessions) {
+        sessionStore = &sessions;
+    }
+
     void before_handle(crow::request& req, crow::response& res, context& /*ctx*/) {
         // Skip authentication for metrics endpoint
         if (req.url == "/metrics") {
@@ -30,6 +36,21 @@ struct SignatureMiddleware {
             return;
         }
 
+        // Requests under a session key from an earlier handshake skip RSA.
+        // The handshake itself always carries an RSA signature.
+        auto session_it = req.headers.find("X-Session-Id");
+        if (session_it != req.headers.end() && sessionStore && req.url != "/api/v1/handshake") {
+            SessionStore::Result result = sessionStore->authenticate(
+                session_it->second, req.get_header_value("X-Session-Timestamp"), req.get_header_value("X-Session-Signature"),
+                crow::method_name(req.method), req.raw_url, req.body);
+            if (result != SessionStore::Result::Ok) {
+                res.code = 401;
+                res.write(crow::json::wvalue{{"error", SessionStore::describe(result)}}.dump());
+                res.end();
+            }
+            return;
+        }
+
         auto signature_it = req.headers.find("X-Scheduler-Signature");
         auto pubkey_it = req.headers.find("X-Scheduler-PublicKey");
         auto secret_it = req.headers.find("X-Shared-Secret");
@@ -49,20 +70,19 @@ struct SignatureMiddleware {
 
         if (!nodeController->verifySignature(body, signature, publicKeyHex)) {
             if (secret_it != req.headers.end() && !secret_it->second.empty() && secret_it->second == nodeController->getSharedSecret()) {
-                std::cout << "Signature verification failed, but shared secret matched: " << secret_it->second << std::endl;
+                LOG_WARN << "Signature verification failed, accepted by shared secret: " << req.url;
             } else {
-                std::cout << "verifySignature: Signature verification failed" << std::endl;
+                LOG_WARN << "Signature verification failed: " << req.url;
                 res.code = 401;
                 res.write(crow::json::wvalue{{"error", "Signature verification failed"}}.dump());
                 res.end();
                 return;
             }
         } else {
-            std::cout << "verifySignature: Signature verified successfully" << std::endl;
+            LOG_DEBUG << "Signature verified: " << req.url;
         }
 
         std::string trustedKey = nodeController->loadPublicKey();
-        std::cout << "Trusted key: " << (trustedKey.empty() ? "empty" : trustedKey.substr(0, 50) + "...") << std::endl;
 
         if (isHandshake) {
             if (!nodeController->savePublicKey(publicKeyHex)) {
@@ -71,12 +91,11 @@ struct SignatureMiddleware {
                 res.end();
                 return;
             }
-            std::cout << "Trusted public key stored: " << publicKeyHex.substr(0, 50) << "..." << std::endl;
         } else if (!trustedKey.empty() && trustedKey != publicKeyHex) {
             if (secret_it != req.headers.end() && !secret_it->second.empty() && secret_it->second == nodeController->getSharedSecret()) {
-                std::cout << "Public key mismatch, but shared secret matched: " << secret_it->second << std::endl;
+                LOG_WARN << "Public key does not match trusted key, accepted by shared secret: " << req.url;
             } else {
-                std::cout << "verifySignature: Public key does not match trusted key. Received: " << publicKeyHex.substr(0, 50) << "..., Trusted: " << trustedKey.substr(0, 50) << "..." << std::endl;
+                LOG_WARN << "Public key does not match trusted key: " << req.url;
                 res.code = 401;
                 res.write(crow::json::wvalue{{"error", "Public key does not match trusted key"}}.dump());
                 res.end();
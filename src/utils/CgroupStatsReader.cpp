@@ -0,0 +1,230 @@
+#include "CgroupStatsReader.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Reads a small pseudo-file into buf (NUL-terminated). Returns bytes read or -1.
+ssize_t readSmallFile(const std::string& path, char* buf, size_t size) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t total = 0;
+    while (static_cast<size_t>(total) < size - 1) {
+        ssize_t n = read(fd, buf + total, size - 1 - total);
+        if (n <= 0) break;
+        total += n;
+    }
+    close(fd);
+    buf[total] = '\0';
+    return total;
+}
+
+bool readUint(const std::string& path, uint64_t& value) {
+    char buf[64];
+    if (readSmallFile(path, buf, sizeof(buf)) <= 0) {
+        return false;
+    }
+    value = std::strtoull(buf, nullptr, 10);
+    return true;
+}
+
+// Walks "key value\n" lines, calling fn(key, keyLen, value) for each.
+template <typename Fn>
+void forEachKeyValue(const char* buf, Fn fn) {
+    const char* p = buf;
+    while (*p) {
+        const char* keyEnd = std::strchr(p, ' ');
+        const char* lineEnd = std::strchr(p, '\n');
+        if (!lineEnd) lineEnd = p + std::strlen(p);
+        if (keyEnd && keyEnd < lineEnd) {
+            fn(p, static_cast<size_t>(keyEnd - p), std::strtoull(keyEnd + 1, nullptr, 10));
+        }
+        p = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+}
+
+bool keyIs(const char* key, size_t len, const char* expected) {
+    return std::strlen(expected) == len && std::memcmp(key, expected, len) == 0;
+}
+
+bool isDirectory(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+} // namespace
+
+CgroupStatsReader::CgroupStatsReader() : root_("/sys/fs/cgroup"), hostMemory_(0) {
+    struct stat info;
+    available_ = stat((root_ + "/cgroup.controllers").c_str(), &info) == 0;
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0) {
+        hostMemory_ = static_cast<uint64_t>(pages) * static_cast<uint64_t>(pageSize);
+    }
+}
+
+std::string CgroupStatsReader::resolvePath(const std::string& containerId, int pid) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = paths_.find(containerId);
+        if (it != paths_.end()) {
+            return it->second;
+        }
+    }
+
+    std::string path;
+    // The init process knows its own cgroup whatever the cgroup driver is.
+    if (pid > 0) {
+        char buf[512];
+        if (readSmallFile("/proc/" + std::to_string(pid) + "/cgroup", buf, sizeof(buf)) > 0 &&
+            std::strncmp(buf, "0::", 3) == 0) {
+            std::string relative(buf + 3);
+            relative.erase(relative.find_last_not_of("\n") + 1);
+            if (isDirectory(root_ + relative)) {
+                path = root_ + relative;
+            }
+        }
+    }
+    if (path.empty()) {
+        const std::string candidates[] = {
+            root_ + "/system.slice/docker-" + containerId + ".scope", // systemd driver
+            root_ + "/docker/" + containerId,                          // cgroupfs driver
+        };
+        for (const auto& candidate : candidates) {
+            if (isDirectory(candidate)) {
+                path = candidate;
+                break;
+            }
+        }
+    }
+
+    if (!path.empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        paths_[containerId] = path;
+    }
+    return path;
+}
+
+bool CgroupStatsReader::sample(const std::string& path, Sample& out) const {
+    char buf[4096];
+
+    if (readSmallFile(path + "/cpu.stat", buf, sizeof(buf)) <= 0) {
+        return false;
+    }
+    forEachKeyValue(buf, [&](const char* key, size_t len, uint64_t value) {
+        if (keyIs(key, len, "usage_usec")) out.cpuUsageUsec = value;
+        else if (keyIs(key, len, "user_usec")) out.cpuUserUsec = value;
+        else if (keyIs(key, len, "system_usec")) out.cpuSystemUsec = value;
+        else if (keyIs(key, len, "nr_throttled")) out.cpuNrThrottled = value;
+        else if (keyIs(key, len, "throttled_usec")) out.cpuThrottledUsec = value;
+    });
+    out.takenAt = std::chrono::steady_clock::now();
+
+    readUint(path + "/memory.current", out.memoryCurrent);
+    out.memoryMax = hostMemory_;
+    if (readSmallFile(path + "/memory.max", buf, sizeof(buf)) > 0 && std::strncmp(buf, "max", 3) != 0) {
+        out.memoryMax = std::strtoull(buf, nullptr, 10);
+    }
+    if (readSmallFile(path + "/memory.stat", buf, sizeof(buf)) > 0) {
+        forEachKeyValue(buf, [&](const char* key, size_t len, uint64_t value) {
+            if (keyIs(key, len, "anon")) out.memoryAnon = value;
+            else if (keyIs(key, len, "file")) out.memoryFile = value;
+            else if (keyIs(key, len, "inactive_file")) out.memoryInactiveFile = value;
+        });
+    }
+
+    // One line per device: "8:0 rbytes=.. wbytes=.. rios=.. wios=.. dbytes=.. dios=.."
+    if (readSmallFile(path + "/io.stat", buf, sizeof(buf)) > 0) {
+        const char* p = buf;
+        while ((p = std::strchr(p, '=')) != nullptr) {
+            const char* keyStart = p;
+            while (keyStart > buf && keyStart[-1] != ' ') --keyStart;
+            size_t len = static_cast<size_t>(p - keyStart);
+            uint64_t value = std::strtoull(p + 1, nullptr, 10);
+            if (keyIs(keyStart, len, "rbytes")) out.ioReadBytes += value;
+            else if (keyIs(keyStart, len, "wbytes")) out.ioWriteBytes += value;
+            else if (keyIs(keyStart, len, "rios")) out.ioReadOps += value;
+            else if (keyIs(keyStart, len, "wios")) out.ioWriteOps += value;
+            ++p;
+        }
+    }
+
+    readUint(path + "/pids.current", out.pidsCurrent);
+    return true;
+}
+
+bool CgroupStatsReader::read(const std::string& containerId, int pid, Json::Value& stats, const std::string& consumer) {
+    if (!available_) {
+        return false;
+    }
+    std::string path = resolvePath(containerId, pid);
+    if (path.empty()) {
+        return false;
+    }
+
+    Sample current;
+    if (!sample(path, current)) {
+        // The container went away or was recreated under the same name.
+        forget(containerId);
+        return false;
+    }
+
+    double cpuPercent = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto key = std::make_pair(containerId, consumer);
+        auto prev = previous_.find(key);
+        if (prev != previous_.end()) {
+            auto wallUsec = std::chrono::duration_cast<std::chrono::microseconds>(current.takenAt - prev->second.takenAt).count();
+            if (wallUsec > 0 && current.cpuUsageUsec >= prev->second.cpuUsageUsec) {
+                // 100% == one full core, matching `docker stats`.
+                cpuPercent = 100.0 * static_cast<double>(current.cpuUsageUsec - prev->second.cpuUsageUsec) / static_cast<double>(wallUsec);
+            }
+        }
+        previous_[key] = current;
+    }
+
+    uint64_t used = current.memoryCurrent > current.memoryInactiveFile ? current.memoryCurrent - current.memoryInactiveFile
+                                                                       : current.memoryCurrent;
+    stats["cpu_percent"] = cpuPercent;
+    stats["cpu_usage_usec"] = static_cast<Json::UInt64>(current.cpuUsageUsec);
+    stats["cpu_user_usec"] = static_cast<Json::UInt64>(current.cpuUserUsec);
+    stats["cpu_system_usec"] = static_cast<Json::UInt64>(current.cpuSystemUsec);
+    stats["cpu_nr_throttled"] = static_cast<Json::UInt64>(current.cpuNrThrottled);
+    stats["cpu_throttled_usec"] = static_cast<Json::UInt64>(current.cpuThrottledUsec);
+    stats["memory_usage"] = static_cast<Json::Int64>(used);
+    stats["memory_limit"] = static_cast<Json::Int64>(current.memoryMax);
+    stats["memory_rss"] = static_cast<Json::UInt64>(current.memoryAnon);
+    stats["memory_cache"] = static_cast<Json::UInt64>(current.memoryFile);
+    stats["io_read_bytes"] = static_cast<Json::UInt64>(current.ioReadBytes);
+    stats["io_write_bytes"] = static_cast<Json::UInt64>(current.ioWriteBytes);
+    stats["io_read_ops"] = static_cast<Json::UInt64>(current.ioReadOps);
+    stats["io_write_ops"] = static_cast<Json::UInt64>(current.ioWriteOps);
+    stats["pids_current"] = static_cast<Json::UInt64>(current.pidsCurrent);
+    return true;
+}
+
+void CgroupStatsReader::forget(const std::string& containerId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    paths_.erase(containerId);
+    for (auto it = previous_.lower_bound({containerId, ""}); it != previous_.end() && it->first.first == containerId;) {
+        it = previous_.erase(it);
+    }
+}
+
+void CgroupStatsReader::retain(const std::set<std::string>& liveIds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = paths_.begin(); it != paths_.end();) {
+        it = liveIds.count(it->first) ? std::next(it) : paths_.erase(it);
+    }
+    for (auto it = previous_.begin(); it != previous_.end();) {
+        it = liveIds.count(it->first.first) ? std::next(it) : previous_.erase(it);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef CGROUP_STATS_READER_H
+#define CGROUP_STATS_READER_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <json/json.h>
+
+// Reads container resource usage straight from the cgroup v2 hierarchy
+// under /sys/fs/cgroup. A sample is a handful of small file reads, so it
+// costs microseconds instead of the ~2s of `docker stats --no-stream`.
+class CgroupStatsReader {
+public:
+    struct Sample {
+        uint64_t cpuUsageUsec = 0;
+        uint64_t cpuUserUsec = 0;
+        uint64_t cpuSystemUsec = 0;
+        uint64_t cpuNrThrottled = 0;
+        uint64_t cpuThrottledUsec = 0;
+        uint64_t memoryCurrent = 0;
+        uint64_t memoryMax = 0;          // host memory when the cgroup is unlimited
+        uint64_t memoryAnon = 0;
+        uint64_t memoryFile = 0;
+        uint64_t memoryInactiveFile = 0;
+        uint64_t ioReadBytes = 0;
+        uint64_t ioWriteBytes = 0;
+        uint64_t ioReadOps = 0;
+        uint64_t ioWriteOps = 0;
+        uint64_t pidsCurrent = 0;
+        std::chrono::steady_clock::time_point takenAt;
+    };
+
+    CgroupStatsReader();
+
+    // False when cgroup v2 is not mounted (v1 hosts use the Engine API instead).
+    bool available() const { return available_; }
+
+    // Samples the container's cgroup. pid is the container's init PID if known
+    // (0 otherwise) and is used to locate the cgroup regardless of the driver.
+    // Fills stats with the same keys as DockerController::getContainerStats;
+    // cpu_percent is computed against the previous sample of this container
+    // taken for the same consumer, so each caller (the metrics collector, an
+    // API request) sees CPU over its own interval, and is 0 on the first one.
+    bool read(const std::string& containerId, int pid, Json::Value& stats, const std::string& consumer);
+
+    // Drops cached path and previous samples, e.g. after the container is removed.
+    void forget(const std::string& containerId);
+    // Drops everything cached for containers not in liveIds.
+    void retain(const std::set<std::string>& liveIds);
+
+private:
+    std::string resolvePath(const std::string& containerId, int pid);
+    bool sample(const std::string& path, Sample& out) const;
+
+    std::string root_;
+    bool available_;
+    uint64_t hostMemory_;
+
+    std::mutex mutex_;
+    std::map<std::string, std::string> paths_;
+    std::map<std::pair<std::string, std::string>, Sample> previous_; // (container, consumer)
+};
+
+#endif // CGROUP_STATS_READER_H
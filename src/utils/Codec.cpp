@@ -0,0 +1,309 @@
+#include "Codec.h"
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CODEC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Sextet for each base64 character, -1 for anything else ('=' included;
+// padding is handled separately).
+struct Base64Table {
+    int8_t value[256];
+    Base64Table() {
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int8_t& v : value) v = -1;
+        for (int i = 0; i < 64; ++i) value[static_cast<unsigned char>(alphabet[i])] = static_cast<int8_t>(i);
+    }
+};
+
+struct HexTable {
+    int8_t value[256];
+    HexTable() {
+        for (int8_t& v : value) v = -1;
+        for (int i = 0; i < 10; ++i) value['0' + i] = static_cast<int8_t>(i);
+        for (int i = 0; i < 6; ++i) value['a' + i] = value['A' + i] = static_cast<int8_t>(10 + i);
+    }
+};
+
+const Base64Table kBase64;
+const HexTable kHex;
+
+// Whole quanta without padding. Returns false on any invalid character.
+bool base64Scalar(const unsigned char* in, size_t size, unsigned char* out) {
+    for (size_t i = 0; i < size; i += 4, out += 3) {
+        int32_t a = kBase64.value[in[i]], b = kBase64.value[in[i + 1]];
+        int32_t c = kBase64.value[in[i + 2]], d = kBase64.value[in[i + 3]];
+        if ((a | b | c | d) < 0) {
+            return false;
+        }
+        uint32_t triple = static_cast<uint32_t>(a) << 18 | static_cast<uint32_t>(b) << 12 | static_cast<uint32_t>(c) << 6 | d;
+        out[0] = static_cast<unsigned char>(triple >> 16);
+        out[1] = static_cast<unsigned char>(triple >> 8);
+        out[2] = static_cast<unsigned char>(triple);
+    }
+    return true;
+}
+
+bool hexScalar(const unsigned char* in, size_t size, unsigned char* out) {
+    for (size_t i = 0; i < size; i += 2) {
+        int high = kHex.value[in[i]], low = kHex.value[in[i + 1]];
+        if ((high | low) < 0) {
+            return false;
+        }
+        *out++ = static_cast<unsigned char>(high << 4 | low);
+    }
+    return true;
+}
+
+#ifdef CODEC_X86
+
+// base64: classify and translate 16 (32) characters at once with nibble
+// lookups, then pack sextets into bytes with multiply-adds (after Muła and
+// Lemire, "Faster Base64 Encoding and Decoding using AVX2 Instructions").
+// lut_lo/lut_hi give each low/high nibble a bit set; a character is valid
+// when its two sets do not intersect. lut_roll is the offset from ASCII to
+// sextet, indexed by high nibble ('/' shares its nibble with '+' and is
+// told apart by the compare).
+
+__attribute__((target("sse4.1")))
+size_t base64Sse41(const unsigned char* in, size_t size, unsigned char* out, bool& ok) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2F);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t done = 0;
+    ok = true;
+    // Each block stores 16 bytes of which 12 are output; the caller leaves room.
+    for (; done + 16 <= size; done += 16, out += 12) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask2F);
+        __m128i lo = _mm_shuffle_epi8(lutLo, _mm_and_si128(chars, mask2F));
+        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        if (!_mm_testz_si128(lo, hi)) {
+            ok = false;
+            return done;
+        }
+        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(chars, mask2F), hiNibbles));
+        __m128i sextets = _mm_add_epi8(chars, roll);
+        __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+        __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(words, pack));
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+size_t base64Avx2(const unsigned char* in, size_t size, unsigned char* out, bool& ok) {
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2F);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    size_t done = 0;
+    ok = true;
+    // Each block stores 32 bytes of which 24 are output; the caller leaves room.
+    for (; done + 32 <= size; done += 32, out += 24) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+        __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(chars, 4), mask2F);
+        __m256i lo = _mm256_shuffle_epi8(lutLo, _mm256_and_si256(chars, mask2F));
+        __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            ok = false;
+            return done;
+        }
+        __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(chars, mask2F), hiNibbles));
+        __m256i sextets = _mm256_add_epi8(chars, roll);
+        __m256i pairs = _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+        __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(words, pack), lanes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+    }
+    return done;
+}
+
+// hex: a character is a digit or, once folded to lower case, a-f; the
+// nibble pairs are then joined with one multiply-add (high * 16 + low) and
+// narrowed to bytes.
+
+__attribute__((target("sse4.1")))
+size_t hexSse41(const unsigned char* in, size_t size, unsigned char* out, bool& ok) {
+    size_t done = 0;
+    ok = true;
+    for (; done + 16 <= size; done += 16, out += 8) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) {
+            ok = false;
+            return done;
+        }
+        __m128i nibbles = _mm_blendv_epi8(_mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)), _mm_sub_epi8(chars, _mm_set1_epi8('0')), digit);
+        __m128i bytes = _mm_maddubs_epi16(nibbles, _mm_set1_epi16(0x0110));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(bytes, bytes));
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+size_t hexAvx2(const unsigned char* in, size_t size, unsigned char* out, bool& ok) {
+    size_t done = 0;
+    ok = true;
+    for (; done + 32 <= size; done += 32, out += 16) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+        __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                          _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+        if (_mm256_movemask_epi8(_mm256_or_si256(digit, letter)) != -1) {
+            ok = false;
+            return done;
+        }
+        __m256i nibbles = _mm256_blendv_epi8(_mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10)),
+                                             _mm256_sub_epi8(chars, _mm256_set1_epi8('0')), digit);
+        __m256i bytes = _mm256_maddubs_epi16(nibbles, _mm256_set1_epi16(0x0110));
+        // packus works per 128-bit lane: bytes 0-7 and 16-23 hold the output.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(bytes, bytes), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+    }
+    return done;
+}
+
+#endif // CODEC_X86
+
+Codec::Isa detect() {
+#ifdef CODEC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Codec::Isa::Avx2;
+    if (__builtin_cpu_supports("sse4.1")) return Codec::Isa::Sse41;
+#endif
+    return Codec::Isa::Scalar;
+}
+
+// What the CPU can run, never more than asked for.
+Codec::Isa usable(Codec::Isa wanted) {
+    Codec::Isa best = Codec::best();
+    return static_cast<int>(wanted) > static_cast<int>(best) ? best : wanted;
+}
+
+} // namespace
+
+Codec::Isa Codec::best() {
+    static const Isa isa = detect();
+    return isa;
+}
+
+const char* Codec::isaName(Isa isa) {
+    switch (isa) {
+        case Isa::Avx2: return "avx2";
+        case Isa::Sse41: return "sse4.1";
+        default: return "scalar";
+    }
+}
+
+bool Codec::base64Decode(const std::string& in, std::vector<char>& out) {
+    return base64Decode(in, out, best());
+}
+
+bool Codec::base64Decode(const std::string& in, std::vector<char>& out, Isa isa) {
+    out.clear();
+    size_t size = in.size();
+    if (size == 0) {
+        return true;
+    }
+    if (size % 4 != 0) {
+        return false;
+    }
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in.data());
+    size_t padding = src[size - 1] != '=' ? 0 : src[size - 2] != '=' ? 1 : 2;
+    size_t decodedSize = size / 4 * 3 - padding;
+    out.resize(decodedSize + 32); // vector stores overrun by up to 8 bytes
+    unsigned char* dst = reinterpret_cast<unsigned char*>(out.data());
+
+    // Everything but the last quantum, which may carry padding.
+    size_t body = size - 4;
+    size_t done = 0;
+    bool ok = true;
+    isa = usable(isa);
+#ifdef CODEC_X86
+    if (isa == Isa::Avx2) {
+        done = base64Avx2(src, body, dst, ok);
+    }
+    if (ok && isa != Isa::Scalar) {
+        done += base64Sse41(src + done, body - done, dst + done / 4 * 3, ok);
+    }
+#endif
+    if (!ok || !base64Scalar(src + done, body - done, dst + done / 4 * 3)) {
+        out.clear();
+        return false;
+    }
+
+    const unsigned char* last = src + body;
+    unsigned char* tail = dst + body / 4 * 3;
+    int32_t a = kBase64.value[last[0]], b = kBase64.value[last[1]];
+    int32_t c = padding >= 2 ? 0 : kBase64.value[last[2]];
+    int32_t d = padding >= 1 ? 0 : kBase64.value[last[3]];
+    // Bits the padding drops must be zero, so every input has one encoding.
+    bool canonical = padding == 0 || (padding == 1 && (c & 0x03) == 0) || (padding == 2 && (b & 0x0F) == 0);
+    if ((a | b | c | d) < 0 || !canonical) {
+        out.clear();
+        return false;
+    }
+    uint32_t triple = static_cast<uint32_t>(a) << 18 | static_cast<uint32_t>(b) << 12 | static_cast<uint32_t>(c) << 6 | d;
+    tail[0] = static_cast<unsigned char>(triple >> 16);
+    if (padding < 2) tail[1] = static_cast<unsigned char>(triple >> 8);
+    if (padding < 1) tail[2] = static_cast<unsigned char>(triple);
+    out.resize(decodedSize);
+    return true;
+}
+
+bool Codec::hexDecode(const std::string& in, std::vector<char>& out) {
+    return hexDecode(in, out, best());
+}
+
+bool Codec::hexDecode(const std::string& in, std::vector<char>& out, Isa isa) {
+    out.clear();
+    if (in.size() % 2 != 0) {
+        return false;
+    }
+    out.resize(in.size() / 2);
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(in.data());
+    unsigned char* dst = reinterpret_cast<unsigned char*>(out.data());
+    size_t done = 0;
+    bool ok = true;
+    isa = usable(isa);
+#ifdef CODEC_X86
+    if (isa == Isa::Avx2) {
+        done = hexAvx2(src, in.size(), dst, ok);
+    }
+    if (ok && isa != Isa::Scalar) {
+        done += hexSse41(src + done, in.size() - done, dst + done / 2, ok);
+    }
+#endif
+    if (!ok || !hexScalar(src + done, in.size() - done, dst + done / 2)) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+std::string Codec::hexEncode(const void* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    std::string out(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 0x0F];
+    }
+    return out;
+}
@@ -0,0 +1,36 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Strict base64 and hex decoding for signatures and keys in request headers.
+//
+// base64 is the RFC 4648 standard alphabet with padding: the length must be
+// a multiple of four, '=' may only end the input, and the bits padding
+// discards must be zero. hex takes an even number of digits in either case.
+// Anything else (whitespace included) fails the decode; nothing is logged,
+// callers report failures once in their own terms.
+//
+// On x86 the bulk of the input goes through SSE4.1 or AVX2, whichever the
+// CPU has (checked once at runtime, no special build flags); the tail and
+// other architectures use a table-driven scalar loop.
+class Codec {
+public:
+    enum class Isa { Scalar, Sse41, Avx2 };
+
+    static bool base64Decode(const std::string& in, std::vector<char>& out);
+    static bool hexDecode(const std::string& in, std::vector<char>& out);
+    static std::string hexEncode(const void* data, size_t size);
+
+    // Same, with a given implementation; one the CPU lacks falls back to the
+    // best available. For benchmarks and cross-checking.
+    static bool base64Decode(const std::string& in, std::vector<char>& out, Isa isa);
+    static bool hexDecode(const std::string& in, std::vector<char>& out, Isa isa);
+
+    static Isa best();
+    static const char* isaName(Isa isa);
+};
+
+#endif // CODEC_H
@@ -0,0 +1,267 @@
+#include "CommandRunner.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kReadChunk = 64 * 1024;
+constexpr int kCancelPollMs = 100;      // how often a cancel flag is checked
+constexpr int kTermGraceMs = 2000;      // SIGTERM -> SIGKILL
+
+std::string basename(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// environ with `extra` KEY=value entries replacing or adding to it.
+std::vector<std::string> mergedEnvironment(const std::vector<std::string> &extra) {
+    std::vector<std::string> env;
+    for (char **entry = environ; entry && *entry; ++entry) {
+        std::string current(*entry);
+        std::string key = current.substr(0, current.find('='));
+        bool overridden = false;
+        for (const auto &override : extra) {
+            if (override.compare(0, key.size() + 1, key + "=") == 0) {
+                overridden = true;
+                break;
+            }
+        }
+        if (!overridden) env.push_back(std::move(current));
+    }
+    env.insert(env.end(), extra.begin(), extra.end());
+    return env;
+}
+
+std::vector<char *> pointers(const std::vector<std::string> &strings) {
+    std::vector<char *> out;
+    out.reserve(strings.size() + 1);
+    for (const auto &s : strings) out.push_back(const_cast<char *>(s.c_str()));
+    out.push_back(nullptr);
+    return out;
+}
+
+// Appends what is readable on fd to buf; returns false at EOF or on error.
+bool drain(int fd, std::string &buf, size_t limit, bool &truncated) {
+    char scratch[kReadChunk];
+    for (;;) {
+        ssize_t n;
+        if (buf.size() < limit) {
+            size_t used = buf.size();
+            size_t chunk = std::min(kReadChunk, limit - used);
+            buf.resize(used + chunk);
+            n = read(fd, &buf[used], chunk);
+            buf.resize(used + (n > 0 ? static_cast<size_t>(n) : 0));
+        } else {
+            n = read(fd, scratch, sizeof(scratch));
+            if (n > 0) truncated = true;
+        }
+        if (n > 0) continue;
+        if (n < 0 && (errno == EINTR)) continue;
+        if (n < 0 && errno == EAGAIN) return true;
+        return false;
+    }
+}
+
+} // namespace
+
+CommandRunner::ProgramStats::ProgramStats()
+    : spawnSeconds({0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25}),
+      runSeconds({0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300}) {}
+
+CommandRunner::CommandRunner(ProcessSupervisor &supervisor) : supervisor_(supervisor) {}
+
+CommandRunner::ProgramStats &CommandRunner::stats(const std::string &program) {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    std::unique_ptr<ProgramStats> &entry = stats_[program];
+    if (!entry) entry.reset(new ProgramStats());
+    return *entry;
+}
+
+CommandResult CommandRunner::run(const std::vector<std::string> &argv, const CommandOptions &options) {
+    CommandResult result;
+    if (argv.empty()) {
+        result.error = "Empty command";
+        return result;
+    }
+    ProgramStats &programStats = stats(basename(argv[0]));
+    ++programStats.runsTotal;
+
+    auto startedAt = std::chrono::steady_clock::now();
+    auto deadline = options.timeout.count() > 0 ? startedAt + options.timeout : std::chrono::steady_clock::time_point::max();
+
+    int outPipe[2], errPipe[2], inPipe[2] = {-1, -1};
+    if (pipe2(outPipe, O_CLOEXEC) != 0) {
+        result.error = std::string("pipe: ") + std::strerror(errno);
+        ++programStats.spawnFailuresTotal;
+        return result;
+    }
+    if (pipe2(errPipe, O_CLOEXEC) != 0 || pipe2(inPipe, O_CLOEXEC) != 0) {
+        result.error = std::string("pipe: ") + std::strerror(errno);
+        for (int fd : {outPipe[0], outPipe[1], errPipe[0], errPipe[1], inPipe[0], inPipe[1]}) {
+            if (fd >= 0) close(fd);
+        }
+        ++programStats.spawnFailuresTotal;
+        return result;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, inPipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, errPipe[1], STDERR_FILENO);
+
+    // The child starts with no blocked signals and default SIGPIPE, whatever
+    // the calling thread has set up.
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty, defaults;
+    sigemptyset(&empty);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    std::vector<char *> args = pointers(argv);
+    std::vector<std::string> envStrings;
+    std::vector<char *> env;
+    if (!options.env.empty()) {
+        envStrings = mergedEnvironment(options.env);
+        env = pointers(envStrings);
+    }
+
+    pid_t pid = 0;
+    int rc = posix_spawnp(&pid, argv[0].c_str(), &actions, &attr, args.data(), env.empty() ? environ : env.data());
+    auto spawnedAt = std::chrono::steady_clock::now();
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(inPipe[0]);
+    close(outPipe[1]);
+    close(errPipe[1]);
+    if (rc != 0) {
+        result.error = "Failed to run " + argv[0] + ": " + std::strerror(rc);
+        close(inPipe[1]);
+        close(outPipe[0]);
+        close(errPipe[0]);
+        ++programStats.spawnFailuresTotal;
+        return result;
+    }
+    result.started = true;
+    programStats.spawnSeconds.observe(std::chrono::duration<double>(spawnedAt - startedAt).count());
+    supervisor_.adopt(pid, argv.size() > 1 ? argv[0] + " " + argv[1] : argv[0], options.tag);
+
+    for (int fd : {inPipe[1], outPipe[0], errPipe[0]}) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    int inFd = inPipe[1];
+    size_t inputOffset = 0;
+    if (options.input.empty()) {
+        close(inFd);
+        inFd = -1;
+    }
+
+    // A child that exits without reading its input must not take the agent
+    // down with SIGPIPE; block it on this thread and discard it afterwards.
+    sigset_t pipeSet, previousMask;
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSet, &previousMask);
+
+    bool outOpen = true, errOpen = true;
+    auto stopChild = [&](bool &flag) {
+        flag = true;
+        kill(pid, SIGTERM);
+        ChildProcess ignored;
+        if (!supervisor_.wait(pid, ignored, kTermGraceMs)) {
+            kill(pid, SIGKILL);
+        }
+    };
+
+    while (outOpen || errOpen || inFd >= 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            stopChild(result.timedOut);
+            break;
+        }
+        if (options.cancel && options.cancel->load()) {
+            stopChild(result.cancelled);
+            break;
+        }
+        int waitMs = options.cancel ? kCancelPollMs : -1;
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+            waitMs = waitMs < 0 ? static_cast<int>(left) : std::min(waitMs, static_cast<int>(left));
+        }
+
+        pollfd fds[3];
+        nfds_t count = 0;
+        if (outOpen) fds[count++] = {outPipe[0], POLLIN, 0};
+        if (errOpen) fds[count++] = {errPipe[0], POLLIN, 0};
+        if (inFd >= 0) fds[count++] = {inFd, POLLOUT, 0};
+        int ready = poll(fds, count, waitMs);
+        if (ready < 0 && errno != EINTR) {
+            result.error = std::string("poll: ") + std::strerror(errno);
+            break;
+        }
+        for (nfds_t i = 0; ready > 0 && i < count; ++i) {
+            if (!fds[i].revents) continue;
+            if (fds[i].fd == outPipe[0]) {
+                outOpen = drain(outPipe[0], result.out, options.maxOutputBytes, result.truncated);
+            } else if (fds[i].fd == errPipe[0]) {
+                errOpen = drain(errPipe[0], result.err, options.maxOutputBytes, result.truncated);
+            } else {
+                ssize_t n = write(inFd, options.input.data() + inputOffset, options.input.size() - inputOffset);
+                if (n > 0) inputOffset += static_cast<size_t>(n);
+                if ((n < 0 && errno != EAGAIN && errno != EINTR) || inputOffset == options.input.size()) {
+                    close(inFd);
+                    inFd = -1;
+                }
+            }
+        }
+    }
+    if (inFd >= 0) close(inFd);
+    close(outPipe[0]);
+    close(errPipe[0]);
+
+    // Both pipes closed does not mean the child is gone; keep honouring the deadline.
+    ChildProcess child;
+    while (!supervisor_.wait(pid, child, kCancelPollMs)) {
+        if (!result.timedOut && !result.cancelled) {
+            if (std::chrono::steady_clock::now() >= deadline) {
+                stopChild(result.timedOut);
+            } else if (options.cancel && options.cancel->load()) {
+                stopChild(result.cancelled);
+            }
+        }
+    }
+    result.exitCode = child.exitCode;
+    result.signal = child.signal;
+
+    timespec zero = {0, 0};
+    while (sigtimedwait(&pipeSet, nullptr, &zero) > 0) {
+    }
+    pthread_sigmask(SIG_SETMASK, &previousMask, nullptr);
+
+    if (result.timedOut) ++programStats.timeoutsTotal;
+    programStats.runSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count());
+    return result;
+}
+
+void CommandRunner::exportMetrics(MetricsRegistry &registry) const {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    for (const auto &entry : stats_) {
+        MetricsRegistry::Labels labels = {{"program", entry.first}};
+        const ProgramStats &s = *entry.second;
+        registry.counter("persys_command_runs_total", "External commands started, by program", labels, static_cast<double>(s.runsTotal.load()));
+        registry.counter("persys_command_spawn_failures_total", "External commands that could not be spawned", labels, static_cast<double>(s.spawnFailuresTotal.load()));
+        registry.counter("persys_command_timeouts_total", "External commands killed at their deadline", labels, static_cast<double>(s.timeoutsTotal.load()));
+        registry.histogram("persys_command_spawn_seconds", "posix_spawn latency: fork (vfork) plus exec of the child", labels, s.spawnSeconds);
+        registry.histogram("persys_command_duration_seconds", "Wall time of external commands from spawn to reap", labels, s.runSeconds);
+    }
+}
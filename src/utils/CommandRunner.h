@@ -0,0 +1,72 @@
+#ifndef COMMAND_RUNNER_H
+#define COMMAND_RUNNER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "MetricsRegistry.h"
+#include "ProcessSupervisor.h"
+
+struct CommandOptions {
+    std::chrono::milliseconds timeout{0};     // deadline for the whole run, 0 for none
+    const std::atomic<bool> *cancel = nullptr; // set to true to kill the child early
+    std::string input;                        // written to stdin, which is then closed
+    std::vector<std::string> env;             // extra KEY=value entries on top of ours
+    std::string tag;                          // workload the child works for, see ProcessSupervisor
+    size_t maxOutputBytes = 64 << 20;         // per stream; the rest is drained and dropped
+};
+
+struct CommandResult {
+    bool started = false;   // false when the program could not be spawned
+    bool timedOut = false;
+    bool cancelled = false;
+    bool truncated = false; // a stream hit maxOutputBytes
+    int exitCode = -1;
+    int signal = 0;
+    std::string out;
+    std::string err;
+    std::string error;      // why the spawn failed
+
+    bool ok() const { return started && !timedOut && !cancelled && signal == 0 && exitCode == 0; }
+    // stdout followed by stderr, for callers that used to read `2>&1`.
+    std::string combined() const { return out + err; }
+};
+
+// Runs programs from an argv vector with no shell in between: posix_spawnp,
+// separate stdout/stderr pipes drained through poll into growable buffers,
+// optional stdin input, and a per-call deadline or cancellation flag.
+// Children are handed to the ProcessSupervisor, which reaps them.
+class CommandRunner {
+public:
+    explicit CommandRunner(ProcessSupervisor &supervisor);
+
+    CommandResult run(const std::vector<std::string> &argv, const CommandOptions &options = CommandOptions());
+
+    ProcessSupervisor &supervisor() { return supervisor_; }
+    void exportMetrics(MetricsRegistry &registry) const;
+
+private:
+    struct ProgramStats {
+        ProgramStats();
+        // posix_spawn uses CLONE_VFORK, so it returns once the child has
+        // exec'd: this is fork + exec as the caller experiences it.
+        MetricsRegistry::Histogram spawnSeconds;
+        MetricsRegistry::Histogram runSeconds;
+        std::atomic<uint64_t> runsTotal{0};
+        std::atomic<uint64_t> spawnFailuresTotal{0};
+        std::atomic<uint64_t> timeoutsTotal{0};
+    };
+
+    ProgramStats &stats(const std::string &program);
+
+    ProcessSupervisor &supervisor_;
+    mutable std::mutex statsMutex_;
+    std::map<std::string, std::unique_ptr<ProgramStats>> stats_; // by program basename
+};
+
+#endif // COMMAND_RUNNER_H
@@ -0,0 +1,442 @@
+#include "DockerEngineClient.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t kReadChunk = 64 * 1024;
+const std::string kWriteFailed = "Failed to write request to Docker daemon: ";
+
+std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+int remainingMs(std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return left > 0 ? static_cast<int>(left) : 0;
+}
+
+} // namespace
+
+Json::Value DockerEngineClient::Response::json() const {
+    Json::Value value;
+    Json::CharReaderBuilder builder;
+    std::string errs;
+    std::istringstream s(body);
+    if (!Json::parseFromStream(builder, s, &value, &errs)) {
+        return Json::Value();
+    }
+    return value;
+}
+
+std::string DockerEngineClient::Response::errorMessage() const {
+    if (status == 0 || !error.empty()) {
+        return "Error: " + (error.empty() ? std::string("Docker daemon unreachable") : error);
+    }
+    Json::Value parsed = json();
+    std::string message = parsed.isObject() && parsed["message"].isString() ? parsed["message"].asString() : body;
+    return "Error response from daemon: " + message;
+}
+
+DockerEngineClient::DockerEngineClient(const std::string& socketPath, size_t maxIdleConnections)
+    : socketPath_(socketPath), maxIdle_(maxIdleConnections), cliMode_(false) {
+    const char* mode = std::getenv("DOCKER_API_MODE");
+    if (mode && std::string(mode) == "cli") {
+        cliMode_ = true;
+        LOG_WARN << "DOCKER_API_MODE=cli, Docker operations will use the docker CLI";
+    } else if (socketPath_.empty()) {
+        cliMode_ = true;
+        LOG_WARN << "DOCKER_HOST is not a unix socket, Docker operations will use the docker CLI";
+    }
+}
+
+DockerEngineClient::~DockerEngineClient() {
+    cancelStreams();
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    for (Connection* conn : idle_) {
+        close(conn->fd);
+        delete conn;
+    }
+    idle_.clear();
+}
+
+std::string DockerEngineClient::defaultSocketPath() {
+    const char* host = std::getenv("DOCKER_HOST");
+    if (!host || std::string(host).empty()) {
+        return "/var/run/docker.sock";
+    }
+    std::string value(host);
+    const std::string prefix = "unix://";
+    if (value.compare(0, prefix.size(), prefix) == 0) {
+        return value.substr(prefix.size());
+    }
+    return "";
+}
+
+std::string DockerEngineClient::urlEncode(const std::string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(value.size() * 3);
+    for (unsigned char c : value) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0x0F];
+        }
+    }
+    return out;
+}
+
+bool DockerEngineClient::useApi() {
+    if (cliMode_) {
+        return false;
+    }
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    bool lastOk = lastPingOk_.load();
+    int64_t last = lastPingMs_.load();
+    int64_t maxAgeMs = lastOk ? 60000 : 10000;
+    if (last != 0 && now - last < maxAgeMs) {
+        return lastOk;
+    }
+    // One caller re-pings; everyone else keeps the last answer meanwhile
+    // instead of queueing behind a daemon that may take 2s to reply.
+    if (pingInFlight_.exchange(true)) {
+        return lastOk;
+    }
+    bool ok = get("/_ping", 2000).status == 200;
+    if (ok != lastOk || last == 0) {
+        LOG_WARN << (ok ? "Docker Engine API reachable at " : "Docker Engine API unreachable at ")
+                 << socketPath_ << (ok ? "" : ", falling back to docker CLI");
+    }
+    lastPingOk_.store(ok);
+    lastPingMs_.store(now);
+    pingInFlight_.store(false);
+    return ok;
+}
+
+DockerEngineClient::Connection* DockerEngineClient::connectSocket() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socketPath_.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    Connection* conn = new Connection();
+    conn->fd = fd;
+    return conn;
+}
+
+DockerEngineClient::Connection* DockerEngineClient::acquire(bool& reused) {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (!idle_.empty()) {
+            Connection* conn = idle_.back();
+            idle_.pop_back();
+            reused = true;
+            return conn;
+        }
+    }
+    reused = false;
+    return connectSocket();
+}
+
+void DockerEngineClient::release(Connection* conn, bool keepAlive) {
+    if (keepAlive && conn->buffer.empty()) {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (idle_.size() < maxIdle_) {
+            idle_.push_back(conn);
+            return;
+        }
+    }
+    close(conn->fd);
+    delete conn;
+}
+
+DockerEngineClient::Response DockerEngineClient::get(const std::string& path, int timeoutMs) {
+    return request("GET", path, "", timeoutMs);
+}
+
+DockerEngineClient::Response DockerEngineClient::post(const std::string& path, const std::string& body, int timeoutMs,
+                                                      const std::vector<std::string>& extraHeaders) {
+    return request("POST", path, body, timeoutMs, extraHeaders);
+}
+
+DockerEngineClient::Response DockerEngineClient::del(const std::string& path, int timeoutMs) {
+    return request("DELETE", path, "", timeoutMs);
+}
+
+DockerEngineClient::Response DockerEngineClient::request(const std::string& method, const std::string& path,
+                                                         const std::string& body, int timeoutMs,
+                                                         const std::vector<std::string>& extraHeaders) {
+    // A pooled connection may have been closed by the daemon while idle. If
+    // it fails without a response, retry on a fresh one, but only when the
+    // daemon cannot have acted on it: the write itself failed, or the method
+    // is idempotent. A POST that may have started a container is not resent.
+    bool idempotent = method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE";
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reused = false;
+        Connection* conn = acquire(reused);
+        if (!conn) {
+            Response failed;
+            failed.error = "Failed to connect to " + socketPath_ + ": " + std::strerror(errno);
+            return failed;
+        }
+        bool keepAlive = false;
+        Response res = perform(conn, method, path, body, timeoutMs, extraHeaders, nullptr, keepAlive);
+        release(conn, keepAlive);
+        bool unsent = res.error.compare(0, kWriteFailed.size(), kWriteFailed) == 0;
+        if (res.status == 0 && reused && attempt == 0 &&
+            (unsent || (idempotent && res.error.find("Timed out") == std::string::npos))) {
+            continue;
+        }
+        return res;
+    }
+    return Response();
+}
+
+DockerEngineClient::Response DockerEngineClient::stream(const std::string& method, const std::string& path,
+                                                        const std::string& body, const ChunkCallback& onData,
+                                                        int idleTimeoutMs, const std::vector<std::string>& extraHeaders,
+                                                        const std::atomic<bool>* running) {
+    Connection* conn = connectSocket();
+    if (!conn) {
+        Response failed;
+        failed.error = "Failed to connect to " + socketPath_ + ": " + std::strerror(errno);
+        return failed;
+    }
+    {
+        std::lock_guard<std::mutex> lock(streamsMutex_);
+        // Checked under the lock so a cancelStreams() that ran before we
+        // registered cannot be missed.
+        if (running && !running->load()) {
+            release(conn, false);
+            Response cancelled;
+            cancelled.error = "Stream cancelled";
+            return cancelled;
+        }
+        streamFds_.emplace_back(conn->fd, running);
+    }
+    bool keepAlive = false;
+    Response res = perform(conn, method, path, body, idleTimeoutMs, extraHeaders, &onData, keepAlive);
+    {
+        std::lock_guard<std::mutex> lock(streamsMutex_);
+        streamFds_.erase(std::remove_if(streamFds_.begin(), streamFds_.end(),
+                                        [&](const std::pair<int, const std::atomic<bool>*>& entry) {
+                                            return entry.first == conn->fd;
+                                        }),
+                         streamFds_.end());
+    }
+    release(conn, false);
+    return res;
+}
+
+void DockerEngineClient::cancelStreams(const std::atomic<bool>* running) {
+    std::lock_guard<std::mutex> lock(streamsMutex_);
+    for (const auto& entry : streamFds_) {
+        if (!running || entry.second == running) {
+            shutdown(entry.first, SHUT_RDWR);
+        }
+    }
+}
+
+DockerEngineClient::Response DockerEngineClient::perform(Connection* conn, const std::string& method,
+                                                         const std::string& path, const std::string& body,
+                                                         int timeoutMs, const std::vector<std::string>& extraHeaders,
+                                                         const ChunkCallback* onData, bool& keepAlive) {
+    Response res;
+    keepAlive = false;
+
+    // Buffered requests use timeoutMs as an overall deadline, streams as an
+    // idle timeout between reads.
+    bool streaming = onData != nullptr;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    auto waitMs = [&]() -> int {
+        if (streaming) {
+            return timeoutMs > 0 ? timeoutMs : -1;
+        }
+        return remainingMs(deadline);
+    };
+
+    std::string req;
+    req.reserve(256 + body.size());
+    req += method + " " + path + " HTTP/1.1\r\n";
+    req += "Host: docker\r\nUser-Agent: persys-agent\r\n";
+    for (const auto& header : extraHeaders) {
+        req += header + "\r\n";
+    }
+    if (!body.empty() || method == "POST") {
+        req += "Content-Type: application/json\r\n";
+        req += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    req += "\r\n";
+    req += body;
+
+    size_t sent = 0;
+    while (sent < req.size()) {
+        struct pollfd pfd = {conn->fd, POLLOUT, 0};
+        if (poll(&pfd, 1, waitMs()) <= 0) {
+            res.error = "Timed out writing request to Docker daemon";
+            return res;
+        }
+        ssize_t n = send(conn->fd, req.data() + sent, req.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            res.error = kWriteFailed + std::strerror(errno);
+            return res;
+        }
+        sent += static_cast<size_t>(n);
+    }
+
+    std::string& buf = conn->buffer;
+    bool eof = false;
+    // Appends whatever the socket has to buf; false on timeout, error or EOF.
+    auto readMore = [&]() -> bool {
+        struct pollfd pfd = {conn->fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, waitMs());
+        if (ready <= 0) {
+            res.error = ready == 0 ? "Timed out waiting for Docker daemon" : std::strerror(errno);
+            return false;
+        }
+        size_t old = buf.size();
+        buf.resize(old + kReadChunk);
+        ssize_t n = recv(conn->fd, &buf[old], kReadChunk, 0);
+        buf.resize(old + (n > 0 ? static_cast<size_t>(n) : 0));
+        if (n == 0) {
+            eof = true;
+            return false;
+        }
+        if (n < 0) {
+            res.error = std::strerror(errno);
+            return false;
+        }
+        return true;
+    };
+
+    size_t headerEnd;
+    while ((headerEnd = buf.find("\r\n\r\n")) == std::string::npos) {
+        if (!readMore()) {
+            if (res.error.empty()) {
+                res.error = "Docker daemon closed the connection";
+            }
+            return res;
+        }
+    }
+
+    std::istringstream headerStream(buf.substr(0, headerEnd));
+    buf.erase(0, headerEnd + 4);
+    std::string statusLine;
+    std::getline(headerStream, statusLine);
+    size_t sp = statusLine.find(' ');
+    if (sp == std::string::npos) {
+        res.error = "Malformed status line from Docker daemon";
+        return res;
+    }
+    int status = std::atoi(statusLine.c_str() + sp + 1);
+    std::string line;
+    while (std::getline(headerStream, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        res.headers[toLower(line.substr(0, colon))] = value;
+    }
+
+    // Error bodies are always buffered so stream() callers can report them.
+    bool toCallback = onData && status < 300;
+    auto deliver = [&](const char* data, size_t len) -> bool {
+        if (len == 0) return true;
+        if (toCallback) {
+            return (*onData)(data, len);
+        }
+        res.body.append(data, len);
+        return true;
+    };
+
+    bool serverKeepAlive = toLower(res.headers["connection"]) != "close";
+    bool complete = false;
+    bool stopped = false;
+
+    if (method == "HEAD" || status == 204 || status == 304 || (status >= 100 && status < 200)) {
+        complete = true;
+    } else if (toLower(res.headers["transfer-encoding"]).find("chunked") != std::string::npos) {
+        while (!complete && !stopped) {
+            size_t lineEnd;
+            while ((lineEnd = buf.find("\r\n")) == std::string::npos) {
+                if (!readMore()) goto done;
+            }
+            size_t chunkSize = std::strtoul(buf.c_str(), nullptr, 16);
+            buf.erase(0, lineEnd + 2);
+            if (chunkSize == 0) {
+                // Skip optional trailers up to the terminating empty line.
+                while (true) {
+                    while ((lineEnd = buf.find("\r\n")) == std::string::npos) {
+                        if (!readMore()) goto done;
+                    }
+                    buf.erase(0, lineEnd + 2);
+                    if (lineEnd == 0) break;
+                }
+                complete = true;
+                break;
+            }
+            while (buf.size() < chunkSize + 2) {
+                if (!readMore()) goto done;
+            }
+            stopped = !deliver(buf.data(), chunkSize);
+            buf.erase(0, chunkSize + 2);
+        }
+    } else if (res.headers.count("content-length")) {
+        size_t remaining = std::strtoull(res.headers["content-length"].c_str(), nullptr, 10);
+        if (!toCallback) {
+            res.body.reserve(remaining);
+        }
+        while (remaining > 0 && !stopped) {
+            if (buf.empty() && !readMore()) goto done;
+            size_t take = std::min(remaining, buf.size());
+            stopped = !deliver(buf.data(), take);
+            buf.erase(0, take);
+            remaining -= take;
+        }
+        complete = remaining == 0;
+    } else {
+        // No framing: the body runs until the daemon closes the connection.
+        serverKeepAlive = false;
+        while (!stopped) {
+            if (!buf.empty()) {
+                stopped = !deliver(buf.data(), buf.size());
+                buf.clear();
+            }
+            if (stopped || !readMore()) break;
+        }
+        complete = eof;
+        if (eof) res.error.clear();
+    }
+
+done:
+    res.status = status;
+    if (complete) {
+        res.error.clear();
+    } else if (!stopped && res.error.empty()) {
+        res.error = "Docker daemon closed the connection mid-response";
+    }
+    keepAlive = complete && serverKeepAlive && !streaming;
+    return res;
+}
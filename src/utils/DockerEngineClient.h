@@ -0,0 +1,102 @@
+#ifndef DOCKER_ENGINE_CLIENT_H
+#define DOCKER_ENGINE_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <json/json.h>
+
+// Minimal HTTP/1.1 client for the Docker Engine API over its unix socket.
+// Connections are kept alive and pooled so that a burst of API calls does
+// not pay a connect() per request, let alone a fork of the docker CLI.
+class DockerEngineClient {
+public:
+    struct Response {
+        int status = 0;                             // HTTP status, 0 on transport failure
+        std::map<std::string, std::string> headers; // lower-cased header names
+        std::string body;
+        std::string error;                          // transport error, empty if the request completed
+
+        // A 2xx whose body was cut short (timeout, EOF) is not ok: error is set.
+        bool ok() const { return error.empty() && status >= 200 && status < 300; }
+        // Parses the body as JSON; returns a null value if it is not JSON.
+        Json::Value json() const;
+        // CLI-style error text ("Error response from daemon: ...") for failed calls.
+        std::string errorMessage() const;
+    };
+
+    // Receives decoded body bytes as they arrive; return false to stop reading.
+    using ChunkCallback = std::function<bool(const char* data, size_t len)>;
+
+    explicit DockerEngineClient(const std::string& socketPath = defaultSocketPath(), size_t maxIdleConnections = 8);
+    ~DockerEngineClient();
+
+    DockerEngineClient(const DockerEngineClient&) = delete;
+    DockerEngineClient& operator=(const DockerEngineClient&) = delete;
+
+    // True when DOCKER_API_MODE is not "cli" and the daemon answered /_ping
+    // recently. Callers fall back to the docker CLI when this is false.
+    bool useApi();
+
+    Response get(const std::string& path, int timeoutMs = kDefaultTimeoutMs);
+    Response post(const std::string& path, const std::string& body = "", int timeoutMs = kDefaultTimeoutMs,
+                  const std::vector<std::string>& extraHeaders = {});
+    Response del(const std::string& path, int timeoutMs = kDefaultTimeoutMs);
+    Response request(const std::string& method, const std::string& path, const std::string& body,
+                     int timeoutMs, const std::vector<std::string>& extraHeaders = {});
+
+    // Issues a request and hands the body to onData incrementally instead of
+    // buffering it. Used for /events, log and pull progress streams. The
+    // connection is never returned to the pool. idleTimeoutMs <= 0 waits forever.
+    // A stream given a `running` flag returns at once if the flag is false and
+    // can be aborted on its own with cancelStreams(running).
+    Response stream(const std::string& method, const std::string& path, const std::string& body,
+                    const ChunkCallback& onData, int idleTimeoutMs,
+                    const std::vector<std::string>& extraHeaders = {},
+                    const std::atomic<bool>* running = nullptr);
+
+    // Lets another thread abort in-flight stream() calls: those started with
+    // this `running` flag, or every one when it is null (used on shutdown).
+    // Clear the flag first so a stream that has not connected yet sees it.
+    void cancelStreams(const std::atomic<bool>* running = nullptr);
+
+    static std::string defaultSocketPath();
+    static std::string urlEncode(const std::string& value);
+
+    static constexpr int kDefaultTimeoutMs = 30000;
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string buffer; // bytes read past the end of the previous response
+    };
+
+    Connection* acquire(bool& reused);
+    void release(Connection* conn, bool keepAlive);
+    Connection* connectSocket();
+    Response perform(Connection* conn, const std::string& method, const std::string& path,
+                     const std::string& body, int timeoutMs, const std::vector<std::string>& extraHeaders,
+                     const ChunkCallback* onData, bool& keepAlive);
+
+    std::string socketPath_;
+    size_t maxIdle_;
+    bool cliMode_;
+
+    std::mutex poolMutex_;
+    std::vector<Connection*> idle_;
+
+    std::mutex streamsMutex_;
+    std::vector<std::pair<int, const std::atomic<bool>*>> streamFds_; // fd, owner's running flag
+
+    std::atomic<bool> lastPingOk_{false};
+    std::atomic<int64_t> lastPingMs_{0}; // steady clock, 0 before the first ping
+    std::atomic<bool> pingInFlight_{false};
+};
+
+#endif // DOCKER_ENGINE_CLIENT_H
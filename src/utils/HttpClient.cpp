@@ -0,0 +1,122 @@
+#include "HttpClient.h"
+#include <mutex>
+
+namespace {
+
+// One lock per kind of shared data; curl tells us which it needs.
+std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+void lockShare(CURL*, curl_lock_data data, curl_lock_access, void*) {
+    shareLocks[data].lock();
+}
+
+void unlockShare(CURL*, curl_lock_data data, void*) {
+    shareLocks[data].unlock();
+}
+
+// Process-wide cache of DNS answers and TLS sessions, so a handle that has
+// to reconnect skips the lookup and resumes the TLS session.
+CURLSH* sharedCache() {
+    static CURLSH* share = [] {
+        CURLSH* s = curl_share_init();
+        if (s) {
+            curl_share_setopt(s, CURLSHOPT_LOCKFUNC, lockShare);
+            curl_share_setopt(s, CURLSHOPT_UNLOCKFUNC, unlockShare);
+            curl_share_setopt(s, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(s, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
+        return s;
+    }();
+    return share;
+}
+
+size_t appendBody(char* data, size_t size, size_t count, void* userdata) {
+    static_cast<std::string*>(userdata)->append(data, size * count);
+    return size * count;
+}
+
+} // namespace
+
+HttpClient::HttpClient(const std::string& baseUrl, long connectTimeoutMs)
+    : baseUrl_(baseUrl), connectTimeoutMs_(connectTimeoutMs), curl_(curl_easy_init()) {
+    while (!baseUrl_.empty() && baseUrl_.back() == '/') {
+        baseUrl_.pop_back();
+    }
+}
+
+HttpClient::~HttpClient() {
+    if (curl_) curl_easy_cleanup(curl_);
+}
+
+HttpClient::Response HttpClient::get(const std::string& path, long timeoutMs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (curl_) {
+        curl_easy_setopt(curl_, CURLOPT_HTTPGET, 1L);
+    }
+    return perform(path, timeoutMs, {});
+}
+
+HttpClient::Response HttpClient::post(const std::string& path, const std::string& body, long timeoutMs,
+                                      const std::vector<std::string>& headers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (curl_) {
+        curl_easy_setopt(curl_, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, body.data());
+        curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(body.size()));
+    }
+    return perform(path, timeoutMs, headers);
+}
+
+// Must be called with mutex_ held.
+HttpClient::Response HttpClient::perform(const std::string& path, long timeoutMs, const std::vector<std::string>& headers) {
+    Response response;
+    if (!curl_) {
+        response.error = "Failed to initialize curl";
+        return response;
+    }
+
+    struct curl_slist* headerList = nullptr;
+    for (const auto& header : headers) {
+        headerList = curl_slist_append(headerList, header.c_str());
+    }
+    std::string url = baseUrl_ + path;
+    char errorBuffer[CURL_ERROR_SIZE] = {0};
+
+    curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headerList);
+    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, appendBody);
+    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response.body);
+    curl_easy_setopt(curl_, CURLOPT_ERRORBUFFER, errorBuffer);
+    curl_easy_setopt(curl_, CURLOPT_TIMEOUT_MS, timeoutMs);
+    curl_easy_setopt(curl_, CURLOPT_CONNECTTIMEOUT_MS, connectTimeoutMs_);
+    curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L); // no SIGALRM for DNS timeouts in a threaded process
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPIDLE, 60L);
+    curl_easy_setopt(curl_, CURLOPT_TCP_KEEPINTVL, 30L);
+    curl_easy_setopt(curl_, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+    if (CURLSH* share = sharedCache()) {
+        curl_easy_setopt(curl_, CURLOPT_SHARE, share);
+    }
+
+    CURLcode rc = curl_easy_perform(curl_);
+    // The slist and buffers die with this call; do not leave curl pointing at them.
+    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, nullptr);
+    curl_easy_setopt(curl_, CURLOPT_ERRORBUFFER, nullptr);
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, nullptr);
+    curl_slist_free_all(headerList);
+
+    curl_off_t totalMicros = 0;
+    long connects = 0;
+    curl_easy_getinfo(curl_, CURLINFO_TOTAL_TIME_T, &totalMicros);
+    curl_easy_getinfo(curl_, CURLINFO_NUM_CONNECTS, &connects);
+    response.seconds = static_cast<double>(totalMicros) / 1e6;
+    response.newConnection = connects > 0;
+    connectionsOpened_ += static_cast<uint64_t>(connects);
+
+    if (rc != CURLE_OK) {
+        response.error = errorBuffer[0] ? errorBuffer : curl_easy_strerror(rc);
+        return response;
+    }
+    curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &response.status);
+    return response;
+}
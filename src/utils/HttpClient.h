@@ -0,0 +1,51 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+
+// HTTP client for talking to the central server. Each instance keeps one
+// libcurl easy handle, so consecutive requests reuse the open (TLS)
+// connection, and all instances share a DNS and TLS session cache. Requests
+// on one instance are serialized; use one instance per caller thread.
+// curl_global_init() must have been called before the first instance is made.
+class HttpClient {
+public:
+    struct Response {
+        long status = 0;            // HTTP status, 0 on transport failure
+        std::string body;
+        std::string error;          // transport error, empty if a response arrived
+        double seconds = 0;         // total round-trip time
+        bool newConnection = false; // false when a kept-alive connection was reused
+
+        bool ok() const { return error.empty() && status >= 200 && status < 300; }
+    };
+
+    explicit HttpClient(const std::string& baseUrl, long connectTimeoutMs = 5000);
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    Response get(const std::string& path, long timeoutMs);
+    Response post(const std::string& path, const std::string& body, long timeoutMs,
+                  const std::vector<std::string>& headers = {"Content-Type: application/json"});
+
+    const std::string& baseUrl() const { return baseUrl_; }
+    uint64_t connectionsOpened() const { return connectionsOpened_.load(); }
+
+private:
+    Response perform(const std::string& path, long timeoutMs, const std::vector<std::string>& headers);
+
+    std::string baseUrl_;
+    long connectTimeoutMs_;
+    std::mutex mutex_;
+    CURL* curl_;
+    std::atomic<uint64_t> connectionsOpened_{0};
+};
+
+#endif // HTTP_CLIENT_H
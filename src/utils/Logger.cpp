@@ -0,0 +1,343 @@
+#include "Logger.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// Accepts 0 where zero means "off"; everything else must be positive.
+bool envNumber(const char* name, long minimum, long& out, std::vector<std::string>& warnings) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return false;
+    }
+    char* end = nullptr;
+    long parsed = std::strtol(value, &end, 10);
+    if (*end != '\0' || parsed < minimum) {
+        warnings.push_back(std::string("Invalid ") + name + ": " + value + ", using default: " + std::to_string(out));
+        return false;
+    }
+    out = parsed;
+    return true;
+}
+
+int currentTid() {
+    thread_local int tid = static_cast<int>(syscall(SYS_gettid));
+    return tid;
+}
+
+const char* baseName(const char* path) {
+    const char* slash = std::strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+void appendJsonString(std::string& out, const std::string& value) {
+    static const char kHex[] = "0123456789abcdef";
+    out += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out += "\\u00";
+                out += kHex[c >> 4];
+                out += kHex[c & 0xf];
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+    out += '"';
+}
+
+} // namespace
+
+// Registers the calling thread's ring on first use and orphans it when the
+// thread exits; the writer frees it once it is drained.
+struct ThreadRing {
+    std::shared_ptr<Logger::Ring> ring;
+    ~ThreadRing() {
+        if (ring) ring->orphaned.store(true, std::memory_order_release);
+    }
+};
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : rate_(new RateSlot[kRateSlots]) {
+    std::vector<std::string> warnings;
+
+    if (const char* level = std::getenv("LOG_LEVEL")) {
+        Level parsed;
+        if (parseLevel(level, parsed)) {
+            setLevel(parsed);
+        } else {
+            warnings.push_back(std::string("Invalid LOG_LEVEL: ") + level + ", using default: info");
+        }
+    }
+    if (const char* format = std::getenv("LOG_FORMAT")) {
+        if (std::strcmp(format, "text") == 0) {
+            json_ = false;
+        } else if (std::strcmp(format, "json") != 0) {
+            warnings.push_back(std::string("Invalid LOG_FORMAT: ") + format + ", using default: json");
+        }
+    }
+
+    long capacity = static_cast<long>(capacity_);
+    if (envNumber("LOG_BUFFER_RECORDS", 16, capacity, warnings)) capacity_ = static_cast<size_t>(capacity);
+    long flushMs = flushInterval_.count();
+    if (envNumber("LOG_FLUSH_MS", 1, flushMs, warnings)) flushInterval_ = std::chrono::milliseconds(flushMs);
+    long burst = burst_;
+    if (envNumber("LOG_RATE_LIMIT_BURST", 0, burst, warnings)) burst_ = static_cast<uint32_t>(burst);
+    long windowSeconds = rateWindowMs_ / 1000;
+    if (envNumber("LOG_RATE_LIMIT_INTERVAL_SECONDS", 1, windowSeconds, warnings)) rateWindowMs_ = windowSeconds * 1000;
+
+    for (auto& warning : warnings) {
+        Record record;
+        record.time = std::chrono::system_clock::now();
+        record.level = Level::Warn;
+        record.file = __FILE__;
+        record.line = __LINE__;
+        record.tid = currentTid();
+        record.message = std::move(warning);
+        writeNow(std::move(record));
+    }
+}
+
+Logger::~Logger() {
+    stop();
+}
+
+void Logger::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&Logger::loop, this);
+}
+
+void Logger::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) thread_.join();
+    // Whatever was queued while the writer was exiting
+    std::string out;
+    if (drain(out) > 0) {
+        writeOut(out);
+    }
+}
+
+const char* Logger::levelName(Level level) {
+    switch (level) {
+    case Level::Debug: return "debug";
+    case Level::Info: return "info";
+    case Level::Warn: return "warn";
+    case Level::Error: return "error";
+    }
+    return "info";
+}
+
+bool Logger::parseLevel(const std::string& text, Level& level) {
+    std::string lower(text);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (lower == "debug") level = Level::Debug;
+    else if (lower == "info") level = Level::Info;
+    else if (lower == "warn" || lower == "warning") level = Level::Warn;
+    else if (lower == "error") level = Level::Error;
+    else return false;
+    return true;
+}
+
+void Logger::write(Level level, const char* file, int line, std::string message) {
+    uint64_t suppressed = 0;
+    if (level != Level::Error && !admit(file, line, message, suppressed)) {
+        return;
+    }
+
+    Record record;
+    record.time = std::chrono::system_clock::now();
+    record.level = level;
+    record.file = file;
+    record.line = line;
+    record.tid = currentTid();
+    record.suppressed = suppressed;
+    record.message = std::move(message);
+
+    if (!running_.load(std::memory_order_acquire)) {
+        writeNow(std::move(record));
+        return;
+    }
+
+    Ring* r = ring();
+    uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    uint64_t head = r->head.load(std::memory_order_acquire);
+    if (tail - head >= r->slots.size()) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        wake_.notify_one();
+        return;
+    }
+    r->slots[tail % r->slots.size()] = std::move(record);
+    r->tail.store(tail + 1, std::memory_order_release);
+
+    if (level == Level::Error || tail + 1 - head >= r->slots.size() / 2) {
+        wake_.notify_one();
+    }
+}
+
+Logger::Ring* Logger::ring() {
+    thread_local ThreadRing local;
+    if (!local.ring) {
+        local.ring = std::make_shared<Ring>(capacity_);
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings_.push_back(local.ring);
+    }
+    return local.ring.get();
+}
+
+bool Logger::admit(const char* file, int line, const std::string& message, uint64_t& suppressed) {
+    if (burst_ == 0) {
+        return true;
+    }
+    // Same statement and same text: a per-workload line differs in its text,
+    // so one workload's repeats never crowd out another's.
+    uint64_t site = reinterpret_cast<uintptr_t>(file) * 31 + static_cast<uint64_t>(line);
+    site = (site * 0x9E3779B97F4A7C15ULL ^ std::hash<std::string>()(message)) | 1;
+    RateSlot& slot = rate_[(site >> 1) % kRateSlots];
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    if (slot.site.load(std::memory_order_relaxed) != site) {
+        slot.site.store(site, std::memory_order_relaxed);
+        slot.windowStart.store(now, std::memory_order_relaxed);
+        slot.count.store(0, std::memory_order_relaxed);
+        slot.suppressed.store(0, std::memory_order_relaxed);
+    } else if (now - slot.windowStart.load(std::memory_order_relaxed) >= rateWindowMs_) {
+        slot.windowStart.store(now, std::memory_order_relaxed);
+        slot.count.store(0, std::memory_order_relaxed);
+    }
+
+    if (slot.count.fetch_add(1, std::memory_order_relaxed) < burst_) {
+        suppressed = slot.suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void Logger::loop() {
+    std::string out;
+    while (running_.load()) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wake_.wait_for(lock, flushInterval_);
+        }
+        out.clear();
+        if (drain(out) > 0) {
+            writeOut(out);
+        }
+    }
+}
+
+size_t Logger::drain(std::string& out) {
+    std::vector<Record> records;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        for (auto it = rings_.begin(); it != rings_.end();) {
+            Ring& r = **it;
+            bool orphaned = r.orphaned.load(std::memory_order_acquire);
+            uint64_t head = r.head.load(std::memory_order_relaxed);
+            uint64_t tail = r.tail.load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                records.push_back(std::move(r.slots[head % r.slots.size()]));
+            }
+            r.head.store(head, std::memory_order_release);
+            it = orphaned ? rings_.erase(it) : it + 1;
+        }
+    }
+
+    // Rings are per thread; interleave them back into time order.
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) { return a.time < b.time; });
+    for (const Record& record : records) {
+        format(record, out);
+        written_[static_cast<int>(record.level)].fetch_add(1, std::memory_order_relaxed);
+    }
+    return records.size();
+}
+
+void Logger::format(const Record& record, std::string& out) const {
+    auto since = record.time.time_since_epoch();
+    std::time_t seconds = std::chrono::duration_cast<std::chrono::seconds>(since).count();
+    long micros = static_cast<long>(std::chrono::duration_cast<std::chrono::microseconds>(since).count() % 1000000);
+    std::tm utc{};
+    gmtime_r(&seconds, &utc);
+    char time[64];
+    std::snprintf(time, sizeof(time), "%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ", utc.tm_year + 1900, utc.tm_mon + 1,
+                  utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, micros);
+
+    std::string caller = std::string(baseName(record.file)) + ":" + std::to_string(record.line);
+    if (json_) {
+        out += "{\"time\":\"";
+        out += time;
+        out += "\",\"level\":\"";
+        out += levelName(record.level);
+        out += "\",\"msg\":";
+        appendJsonString(out, record.message);
+        out += ",\"caller\":\"" + caller + "\",\"tid\":" + std::to_string(record.tid);
+        if (record.suppressed > 0) {
+            out += ",\"suppressed\":" + std::to_string(record.suppressed);
+        }
+        out += "}\n";
+    } else {
+        char level[8];
+        std::snprintf(level, sizeof(level), "%-5s", levelName(record.level));
+        out += std::string(time) + " " + level + " " + caller + " " + record.message;
+        if (record.suppressed > 0) {
+            out += " (" + std::to_string(record.suppressed) + " similar suppressed)";
+        }
+        out += '\n';
+    }
+}
+
+void Logger::writeOut(const std::string& text) {
+    std::lock_guard<std::mutex> lock(outMutex_);
+    size_t offset = 0;
+    while (offset < text.size()) {
+        ssize_t n = ::write(STDERR_FILENO, text.data() + offset, text.size() - offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        offset += static_cast<size_t>(n);
+    }
+}
+
+void Logger::writeNow(Record record) {
+    std::string out;
+    format(record, out);
+    written_[static_cast<int>(record.level)].fetch_add(1, std::memory_order_relaxed);
+    writeOut(out);
+}
+
+void Logger::exportMetrics(MetricsRegistry& registry) const {
+    for (Level level : {Level::Debug, Level::Info, Level::Warn, Level::Error}) {
+        registry.counter("persys_log_records_total", "Log records written, by level", {{"level", levelName(level)}},
+                         static_cast<double>(written_[static_cast<int>(level)].load(std::memory_order_relaxed)));
+    }
+    registry.counter("persys_log_records_dropped_total", "Log records dropped because the logging thread's buffer was full", {},
+                     static_cast<double>(dropped_.load(std::memory_order_relaxed)));
+    registry.counter("persys_log_records_suppressed_total", "Log records suppressed by the per-call-site rate limit", {},
+                     static_cast<double>(suppressed_.load(std::memory_order_relaxed)));
+}
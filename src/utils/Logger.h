@@ -0,0 +1,143 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MetricsRegistry.h"
+
+// Leveled logger that keeps console I/O off the calling thread. Each thread
+// that logs gets its own single-producer ring of LOG_BUFFER_RECORDS records;
+// a background writer drains all rings every LOG_FLUSH_MS (sooner when a
+// ring is half full or an error is logged) and writes them to stderr as JSON
+// lines for journald, or as plain text with LOG_FORMAT=text. A full ring
+// drops the record and counts it instead of blocking. A message repeated
+// from the same call site is written LOG_RATE_LIMIT_BURST times per
+// LOG_RATE_LIMIT_INTERVAL_SECONDS; the repeats beyond that are counted and
+// reported on the next copy that gets through. Errors are never limited.
+//
+// Before start() and after stop() records are written synchronously, so
+// startup and shutdown messages are never lost.
+class Logger {
+public:
+    enum class Level { Debug = 0, Info = 1, Warn = 2, Error = 3 };
+
+    static Logger& instance();
+
+    void start();
+    void stop();
+
+    bool enabled(Level level) const { return static_cast<int>(level) >= minLevel_.load(std::memory_order_relaxed); }
+    void setLevel(Level level) { minLevel_.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+    // file must be a string literal (__FILE__); it is kept by pointer.
+    void write(Level level, const char* file, int line, std::string message);
+
+    void exportMetrics(MetricsRegistry& registry) const;
+
+    static const char* levelName(Level level);
+    static bool parseLevel(const std::string& text, Level& level);
+
+private:
+    struct Record {
+        std::chrono::system_clock::time_point time;
+        Level level = Level::Info;
+        const char* file = nullptr;
+        int line = 0;
+        int tid = 0;
+        uint64_t suppressed = 0; // identical records from the same call site dropped by the rate limit
+        std::string message;
+    };
+
+    // Single producer (the owning thread), single consumer (the writer).
+    struct Ring {
+        explicit Ring(size_t capacity) : slots(capacity) {}
+        std::vector<Record> slots;
+        std::atomic<uint64_t> head{0};  // next slot the writer reads
+        std::atomic<uint64_t> tail{0};  // next slot the producer fills
+        std::atomic<bool> orphaned{false}; // owning thread has exited
+    };
+    friend struct ThreadRing;
+
+    // One per hashed call site and message; two keys sharing a slot keep
+    // resetting it, so a collision can only let more through, never less.
+    struct RateSlot {
+        std::atomic<uint64_t> site{0};
+        std::atomic<int64_t> windowStart{0}; // steady clock, ms
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint64_t> suppressed{0};
+    };
+
+    Logger();
+    ~Logger();
+
+    Ring* ring();
+    bool admit(const char* file, int line, const std::string& message, uint64_t& suppressed);
+    void loop();
+    size_t drain(std::string& out);
+    void format(const Record& record, std::string& out) const;
+    void writeOut(const std::string& text);
+    void writeNow(Record record);
+
+    bool json_ = true;
+    size_t capacity_ = 1024;
+    std::chrono::milliseconds flushInterval_{50};
+    uint32_t burst_ = 20;
+    int64_t rateWindowMs_ = 10000;
+    std::atomic<int> minLevel_{static_cast<int>(Level::Info)};
+
+    static constexpr size_t kRateSlots = 1024;
+    std::unique_ptr<RateSlot[]> rate_;
+
+    std::mutex ringsMutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+
+    std::mutex outMutex_;  // stderr, for the writer and synchronous writes
+    std::atomic<bool> running_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> written_[4] = {};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+// Builds one record with stream syntax and hands it to the logger when the
+// statement ends. Use through the LOG_* macros, which skip formatting
+// entirely for disabled levels.
+class LogLine {
+public:
+    LogLine(Logger::Level level, const char* file, int line) : level_(level), file_(file), line_(line) {}
+    ~LogLine() { Logger::instance().write(level_, file_, line_, stream_.str()); }
+
+    template <typename T>
+    LogLine& operator<<(const T& value) {
+        stream_ << value;
+        return *this;
+    }
+
+private:
+    Logger::Level level_;
+    const char* file_;
+    int line_;
+    std::ostringstream stream_;
+};
+
+#define PERSYS_LOG(level) \
+    if (!Logger::instance().enabled(level)) {} else LogLine(level, __FILE__, __LINE__)
+
+#define LOG_DEBUG PERSYS_LOG(Logger::Level::Debug)
+#define LOG_INFO PERSYS_LOG(Logger::Level::Info)
+#define LOG_WARN PERSYS_LOG(Logger::Level::Warn)
+#define LOG_ERROR PERSYS_LOG(Logger::Level::Error)
+
+#endif // LOGGER_H
@@ -0,0 +1,161 @@
+#include "MetricsRegistry.h"
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+void appendEscaped(std::string& out, const std::string& value, bool escapeQuotes) {
+    for (char c : value) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '\n') out += "\\n";
+        else if (c == '"' && escapeQuotes) out += "\\\"";
+        else out += c;
+    }
+}
+
+void appendValue(std::string& out, double value) {
+    if (std::isnan(value)) {
+        out += "NaN";
+    } else if (std::isinf(value)) {
+        out += value > 0 ? "+Inf" : "-Inf";
+    } else if (value == std::floor(value) && std::fabs(value) < 9007199254740992.0) {
+        // Byte and event counts stay exact instead of going through %g
+        out += std::to_string(static_cast<long long>(value));
+    } else {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.10g", value);
+        out += buf;
+    }
+}
+
+std::string renderLabels(const MetricsRegistry::Labels& labels) {
+    std::string rendered;
+    if (!labels.empty()) {
+        rendered += '{';
+        for (size_t i = 0; i < labels.size(); ++i) {
+            if (i > 0) rendered += ',';
+            rendered += labels[i].first;
+            rendered += "=\"";
+            appendEscaped(rendered, labels[i].second, true);
+            rendered += '"';
+        }
+        rendered += '}';
+    }
+    return rendered;
+}
+
+} // namespace
+
+MetricsRegistry::Histogram::Histogram(std::vector<double> bounds)
+    : bounds_(std::move(bounds)), buckets_(new std::atomic<uint64_t>[bounds_.size() + 1]) {
+    for (size_t i = 0; i <= bounds_.size(); ++i) {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MetricsRegistry::Histogram::observe(double value) {
+    size_t i = 0;
+    while (i < bounds_.size() && value > bounds_[i]) ++i;
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    double current = sum_.load(std::memory_order_relaxed);
+    while (!sum_.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+}
+
+void MetricsRegistry::counter(const std::string& name, const std::string& help, const Labels& labels, double value) {
+    family(Type::Counter, name, help).samples.push_back(Sample{"", renderLabels(labels), value});
+}
+
+void MetricsRegistry::gauge(const std::string& name, const std::string& help, const Labels& labels, double value) {
+    family(Type::Gauge, name, help).samples.push_back(Sample{"", renderLabels(labels), value});
+}
+
+void MetricsRegistry::histogram(const std::string& name, const std::string& help, const Labels& labels,
+                                const Histogram& histogram) {
+    Family& target = family(Type::Histogram, name, help);
+    Labels withBound = labels;
+    withBound.emplace_back("le", "");
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= histogram.bounds().size(); ++i) {
+        cumulative += histogram.bucketCount(i);
+        if (i < histogram.bounds().size()) {
+            std::string bound;
+            appendValue(bound, histogram.bounds()[i]);
+            if (bound.find_first_of(".eIN") == std::string::npos) {
+                bound += ".0"; // OpenMetrics wants canonical floats in le
+            }
+            withBound.back().second = bound;
+        } else {
+            withBound.back().second = "+Inf";
+        }
+        target.samples.push_back(Sample{"_bucket", renderLabels(withBound), static_cast<double>(cumulative)});
+    }
+    std::string rendered = renderLabels(labels);
+    target.samples.push_back(Sample{"_sum", rendered, histogram.sum()});
+    target.samples.push_back(Sample{"_count", rendered, static_cast<double>(cumulative)});
+}
+
+MetricsRegistry::Family& MetricsRegistry::family(Type type, const std::string& name, const std::string& help) {
+    auto it = index_.find(name);
+    if (it == index_.end()) {
+        if (type == Type::Counter && (name.size() < 6 || name.compare(name.size() - 6, 6, "_total") != 0)) {
+            throw std::invalid_argument("Counter metric name must end in _total: " + name);
+        }
+        it = index_.emplace(name, families_.size()).first;
+        families_.push_back(Family{name, help, type, {}});
+    }
+    Family& found = families_[it->second];
+    if (found.type != type) {
+        throw std::invalid_argument("Metric " + name + " registered with conflicting types");
+    }
+    return found;
+}
+
+std::string MetricsRegistry::render(Format format) const {
+    std::string out;
+    size_t estimate = 0;
+    for (const auto& family : families_) {
+        estimate += family.help.size() + 3 * family.name.size() + 32 +
+                    family.samples.size() * (family.name.size() + 96);
+    }
+    out.reserve(estimate + 8);
+
+    for (const auto& family : families_) {
+        const char* type = family.type == Type::Counter ? "counter" : family.type == Type::Histogram ? "histogram" : "gauge";
+        std::string familyName = family.name;
+        if (format == Format::OpenMetrics && family.type == Type::Counter) {
+            familyName.resize(familyName.size() - 6);
+        }
+        out += "# HELP ";
+        out += familyName;
+        out += ' ';
+        appendEscaped(out, family.help, format == Format::OpenMetrics);
+        out += "\n# TYPE ";
+        out += familyName;
+        out += ' ';
+        out += type;
+        out += '\n';
+        for (const auto& sample : family.samples) {
+            out += family.name;
+            out += sample.suffix;
+            out += sample.labels;
+            out += ' ';
+            appendValue(out, sample.value);
+            out += '\n';
+        }
+    }
+    if (format == Format::OpenMetrics) {
+        out += "# EOF\n";
+    }
+    return out;
+}
+
+const char* MetricsRegistry::contentType(Format format) {
+    return format == Format::OpenMetrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8"
+                                         : "text/plain; version=0.0.4; charset=utf-8";
+}
+
+MetricsRegistry::Format MetricsRegistry::negotiate(const std::string& accept) {
+    return accept.find("application/openmetrics-text") != std::string::npos ? Format::OpenMetrics : Format::Prometheus;
+}
@@ -0,0 +1,71 @@
+#ifndef METRICS_REGISTRY_H
+#define METRICS_REGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Collects metric samples grouped into families and renders them as
+// Prometheus text (0.0.4) or OpenMetrics 1.0. Each family's HELP/TYPE
+// header is written once, followed by all of its samples.
+class MetricsRegistry {
+public:
+    enum class Type { Counter, Gauge, Histogram };
+    enum class Format { Prometheus, OpenMetrics };
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    // Fixed-bucket histogram that hot paths can observe into without locking;
+    // modules own one and hand it to histogram() when metrics are collected.
+    class Histogram {
+    public:
+        explicit Histogram(std::vector<double> bounds);
+
+        void observe(double value);
+
+        const std::vector<double>& bounds() const { return bounds_; }
+        uint64_t bucketCount(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+        double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<double> bounds_;                      // upper bounds, ascending; +Inf is implicit
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets_; // per bucket, not cumulative
+        std::atomic<double> sum_{0};
+    };
+
+    // Counter names must end in "_total"; OpenMetrics strips the suffix from
+    // the family name as the spec requires.
+    void counter(const std::string& name, const std::string& help, const Labels& labels, double value);
+    void gauge(const std::string& name, const std::string& help, const Labels& labels, double value);
+    void histogram(const std::string& name, const std::string& help, const Labels& labels, const Histogram& histogram);
+
+    std::string render(Format format) const;
+    bool empty() const { return families_.empty(); }
+
+    static const char* contentType(Format format);
+    // Picks OpenMetrics only when the scraper asks for it in Accept.
+    static Format negotiate(const std::string& accept);
+
+private:
+    struct Sample {
+        const char* suffix;  // "", "_bucket", "_sum" or "_count"
+        std::string labels;  // rendered label set
+        double value;
+    };
+    struct Family {
+        std::string name;
+        std::string help;
+        Type type;
+        std::vector<Sample> samples;
+    };
+
+    Family& family(Type type, const std::string& name, const std::string& help);
+
+    std::vector<Family> families_;          // registration order
+    std::map<std::string, size_t> index_;   // name -> families_ position
+};
+
+#endif // METRICS_REGISTRY_H
@@ -0,0 +1,123 @@
+#include "NetDevReader.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool NetDevReader::read(int pid, std::vector<Interface>& interfaces) {
+    if (pid <= 0) {
+        return false;
+    }
+    std::string path = "/proc/" + std::to_string(pid) + "/net/dev";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // A handful of interfaces is ~150 bytes each; grow only for unusual hosts.
+    std::string content(8192, '\0');
+    size_t used = 0;
+    while (true) {
+        if (used == content.size()) content.resize(content.size() * 2);
+        ssize_t n = ::read(fd, &content[used], content.size() - used);
+        if (n <= 0) break;
+        used += static_cast<size_t>(n);
+    }
+    close(fd);
+    content.resize(used);
+
+    interfaces.clear();
+    size_t lineStart = 0;
+    int lineNo = 0;
+    while (lineStart < content.size()) {
+        size_t lineEnd = content.find('\n', lineStart);
+        if (lineEnd == std::string::npos) lineEnd = content.size();
+        // The first two lines are column headers.
+        if (++lineNo > 2) {
+            size_t colon = content.find(':', lineStart);
+            if (colon != std::string::npos && colon < lineEnd) {
+                size_t nameStart = content.find_first_not_of(' ', lineStart);
+                Interface iface;
+                iface.name = content.substr(nameStart, colon - nameStart);
+                // rx: bytes packets errs drop fifo frame compressed multicast
+                // tx: bytes packets errs drop fifo colls carrier compressed
+                uint64_t fields[16] = {0};
+                const char* p = content.c_str() + colon + 1;
+                for (int i = 0; i < 16; ++i) {
+                    char* end;
+                    fields[i] = std::strtoull(p, &end, 10);
+                    if (end == p) break;
+                    p = end;
+                }
+                iface.rxBytes = fields[0];
+                iface.rxPackets = fields[1];
+                iface.rxErrors = fields[2];
+                iface.rxDropped = fields[3];
+                iface.txBytes = fields[8];
+                iface.txPackets = fields[9];
+                iface.txErrors = fields[10];
+                iface.txDropped = fields[11];
+                interfaces.push_back(iface);
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+    return true;
+}
+
+uint64_t NetDevReader::namespaceOf(int pid) {
+    std::string path = pid > 0 ? "/proc/" + std::to_string(pid) + "/ns/net" : "/proc/self/ns/net";
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_ino);
+}
+
+bool NetDevReader::inHostNamespace(int pid) {
+    // Neither changes while the agent runs.
+    static const uint64_t self = namespaceOf(0);
+    static const uint64_t hostInit = namespaceOf(1);
+    uint64_t ns = namespaceOf(pid);
+    return ns != 0 && (ns == self || ns == hostInit);
+}
+
+bool NetDevReader::addToStats(int pid, Json::Value& stats) {
+    uint64_t ns = namespaceOf(pid);
+    if (ns == 0) {
+        return false;
+    }
+    stats["network_namespace"] = static_cast<Json::UInt64>(ns);
+    if (inHostNamespace(pid)) {
+        stats["network_host"] = true;
+        stats["net_rx_bytes"] = 0;
+        stats["net_tx_bytes"] = 0;
+        stats["networks"] = Json::Value(Json::objectValue);
+        return true;
+    }
+
+    std::vector<Interface> interfaces;
+    if (!read(pid, interfaces)) {
+        return false;
+    }
+    uint64_t rx = 0, tx = 0;
+    Json::Value networks(Json::objectValue);
+    for (const auto& iface : interfaces) {
+        if (iface.name == "lo") continue;
+        rx += iface.rxBytes;
+        tx += iface.txBytes;
+        Json::Value& n = networks[iface.name];
+        n["rx_bytes"] = static_cast<Json::UInt64>(iface.rxBytes);
+        n["rx_packets"] = static_cast<Json::UInt64>(iface.rxPackets);
+        n["rx_errors"] = static_cast<Json::UInt64>(iface.rxErrors);
+        n["rx_dropped"] = static_cast<Json::UInt64>(iface.rxDropped);
+        n["tx_bytes"] = static_cast<Json::UInt64>(iface.txBytes);
+        n["tx_packets"] = static_cast<Json::UInt64>(iface.txPackets);
+        n["tx_errors"] = static_cast<Json::UInt64>(iface.txErrors);
+        n["tx_dropped"] = static_cast<Json::UInt64>(iface.txDropped);
+    }
+    stats["net_rx_bytes"] = static_cast<Json::UInt64>(rx);
+    stats["net_tx_bytes"] = static_cast<Json::UInt64>(tx);
+    stats["networks"] = networks;
+    return true;
+}
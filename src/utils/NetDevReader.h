@@ -0,0 +1,48 @@
+#ifndef NET_DEV_READER_H
+#define NET_DEV_READER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <json/json.h>
+
+// Reads per-interface counters from /proc/<pid>/net/dev, i.e. from inside
+// the network namespace of that process. For a container's init PID this
+// gives exact byte/packet counts without going through the daemon.
+class NetDevReader {
+public:
+    struct Interface {
+        std::string name;
+        uint64_t rxBytes = 0;
+        uint64_t rxPackets = 0;
+        uint64_t rxErrors = 0;
+        uint64_t rxDropped = 0;
+        uint64_t txBytes = 0;
+        uint64_t txPackets = 0;
+        uint64_t txErrors = 0;
+        uint64_t txDropped = 0;
+    };
+
+    // Parses the interfaces of pid's network namespace. Returns false if the
+    // process is gone or the file cannot be read.
+    static bool read(int pid, std::vector<Interface>& interfaces);
+
+    // Inode of pid's network namespace, 0 if it cannot be read. Processes
+    // that share a namespace share the inode.
+    static uint64_t namespaceOf(int pid);
+
+    // True if pid is in the agent's own network namespace or, when the host
+    // PID namespace is visible, in that of host init: its /proc/<pid>/net/dev
+    // then describes the node (or the agent), not the container.
+    static bool inHostNamespace(int pid);
+
+    // Adds net_rx_bytes/net_tx_bytes totals (loopback excluded), a
+    // per-interface "networks" object and "network_namespace" to a container
+    // stats value. Containers in the host namespace get "network_host": true
+    // and no counters, since they have none of their own. Containers that
+    // share a namespace (--network container:<id>) report the same counters;
+    // consumers summing them must dedupe on network_namespace.
+    static bool addToStats(int pid, Json::Value& stats);
+};
+
+#endif // NET_DEV_READER_H
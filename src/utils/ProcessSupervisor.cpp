@@ -0,0 +1,297 @@
+#include "ProcessSupervisor.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434 // same number on every architecture
+#endif
+
+namespace {
+
+constexpr size_t kExitsKept = 256;
+constexpr int kFallbackPollMs = 100;
+constexpr uint64_t kWakeKey = 0; // epoll key of the wake eventfd; PIDs are never 0
+
+int pidfdOpen(pid_t pid) {
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+}
+
+} // namespace
+
+ProcessSupervisor::ProcessSupervisor()
+    : lifetimeSeconds_({0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, 300, 1200}) {
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd_ >= 0 && wakeFd_ >= 0) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = kWakeKey;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+    } else {
+        LOG_WARN << "Process supervisor: epoll setup failed: " << std::strerror(errno);
+    }
+}
+
+ProcessSupervisor::~ProcessSupervisor() {
+    stop();
+    for (auto &entry : children_) {
+        if (entry.second.pidfd >= 0) close(entry.second.pidfd);
+    }
+    if (wakeFd_ >= 0) close(wakeFd_);
+    if (epollFd_ >= 0) close(epollFd_);
+}
+
+void ProcessSupervisor::start() {
+    if (epollFd_ < 0 || running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&ProcessSupervisor::loop, this);
+}
+
+void ProcessSupervisor::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake();
+    if (thread_.joinable()) thread_.join();
+    // Anyone still waiting falls back to reaping on their own thread.
+    std::lock_guard<std::mutex> lock(mutex_);
+    exited_.notify_all();
+}
+
+void ProcessSupervisor::wake() {
+    if (wakeFd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void ProcessSupervisor::adopt(pid_t pid, const std::string &command, const std::string &tag) {
+    Entry entry;
+    entry.info.pid = pid;
+    entry.info.command = command;
+    entry.info.tag = tag;
+    entry.info.startedAt = std::chrono::system_clock::now();
+    // A pidfd opened on a child that already exited is readable straight away,
+    // so adopting after the exit is not a race.
+    entry.pidfd = pidfdOpen(pid);
+    if (entry.pidfd >= 0 && epollFd_ >= 0) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = static_cast<uint64_t>(pid);
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, entry.pidfd, &event) != 0) {
+            close(entry.pidfd);
+            entry.pidfd = -1;
+        }
+    }
+
+    bool polled = entry.pidfd < 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        children_[pid] = std::move(entry);
+        ++adoptedTotal_;
+    }
+    if (polled) {
+        wake(); // switch the loop to its polling timeout
+    }
+}
+
+// Must be called with mutex_ held. Returns true once the child is gone from children_.
+bool ProcessSupervisor::reap(pid_t pid) {
+    auto it = children_.find(pid);
+    if (it == children_.end()) {
+        return true;
+    }
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(pid, &status, WNOHANG);
+    } while (result < 0 && errno == EINTR);
+    if (result == pid) {
+        recordExit(it, status, true);
+        return true;
+    }
+    if (result < 0) {
+        // ECHILD: reaped by someone else, so the exit status is lost.
+        recordExit(it, 0, false);
+        return true;
+    }
+    return false;
+}
+
+void ProcessSupervisor::recordExit(std::map<pid_t, Entry>::iterator it, int status, bool reaped) {
+    ChildProcess info = std::move(it->second.info);
+    if (it->second.pidfd >= 0) {
+        close(it->second.pidfd); // also drops it from the epoll set
+    }
+    children_.erase(it);
+
+    info.exited = true;
+    info.exitedAt = std::chrono::system_clock::now();
+    if (reaped && WIFEXITED(status)) {
+        info.exitCode = WEXITSTATUS(status);
+    } else if (reaped && WIFSIGNALED(status)) {
+        info.signal = WTERMSIG(status);
+    }
+    if (info.signal != 0) {
+        ++signaledTotal_;
+    } else if (info.exitCode == 0) {
+        ++succeededTotal_;
+    } else {
+        ++failedTotal_;
+    }
+    lifetimeSeconds_.observe(std::chrono::duration<double>(info.exitedAt - info.startedAt).count());
+
+    exits_.push_back(std::move(info));
+    if (exits_.size() > kExitsKept) {
+        exits_.pop_front();
+    }
+    exited_.notify_all();
+}
+
+void ProcessSupervisor::loop() {
+    epoll_event events[32];
+    while (running_) {
+        int timeoutMs = -1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto &entry : children_) {
+                if (entry.second.pidfd < 0) {
+                    timeoutMs = kFallbackPollMs;
+                    break;
+                }
+            }
+        }
+
+        int count = epoll_wait(epollFd_, events, 32, timeoutMs);
+        if (count < 0) {
+            if (errno != EINTR) {
+                LOG_WARN << "Process supervisor: epoll_wait failed: " << std::strerror(errno);
+                std::this_thread::sleep_for(std::chrono::milliseconds(kFallbackPollMs));
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.u64 == kWakeKey) {
+                uint64_t drained;
+                ssize_t ignored = read(wakeFd_, &drained, sizeof(drained));
+                (void)ignored;
+            } else {
+                reap(static_cast<pid_t>(events[i].data.u64));
+            }
+        }
+        std::vector<pid_t> polled;
+        for (const auto &entry : children_) {
+            if (entry.second.pidfd < 0) polled.push_back(entry.first);
+        }
+        for (pid_t pid : polled) {
+            reap(pid);
+        }
+    }
+}
+
+bool ProcessSupervisor::wait(pid_t pid, ChildProcess &out, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!children_.count(pid)) {
+        return findLocked(pid, out) && out.exited;
+    }
+
+    if (!running_) {
+        // No loop to do it for us; the caller waits in waitpid instead.
+        // Only the caller knows this PID, so nobody else reaps it meanwhile.
+        // waitpid has no timeout, so a bounded wait polls it with short
+        // sleeps until the deadline rather than returning at once.
+        lock.unlock();
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+        int status = 0;
+        pid_t result;
+        for (;;) {
+            result = timeoutMs < 0 ? waitpid(pid, &status, 0) : waitpid(pid, &status, WNOHANG);
+            if (result < 0 && errno == EINTR) continue;
+            auto now = std::chrono::steady_clock::now();
+            if (result != 0 || now >= deadline) break;
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                deadline - now, std::chrono::milliseconds(10)));
+        }
+        lock.lock();
+        auto it = children_.find(pid);
+        if (it != children_.end()) {
+            if (result == 0) {
+                return false; // still running and the caller will not block
+            }
+            recordExit(it, status, result == pid);
+        }
+    } else {
+        auto gone = [this, pid] { return !children_.count(pid); };
+        if (timeoutMs < 0) {
+            exited_.wait(lock, [&] { return gone() || !running_; });
+        } else if (!exited_.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&] { return gone() || !running_; })) {
+            return false;
+        }
+        if (!gone()) {
+            lock.unlock();
+            return wait(pid, out, timeoutMs); // stopped while waiting
+        }
+    }
+
+    return findLocked(pid, out);
+}
+
+bool ProcessSupervisor::find(pid_t pid, ChildProcess &out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return findLocked(pid, out);
+}
+
+// Must be called with mutex_ held.
+bool ProcessSupervisor::findLocked(pid_t pid, ChildProcess &out) const {
+    auto it = children_.find(pid);
+    if (it != children_.end()) {
+        out = it->second.info;
+        return true;
+    }
+    for (auto exit = exits_.rbegin(); exit != exits_.rend(); ++exit) {
+        if (exit->pid == pid) {
+            out = *exit;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<ChildProcess> ProcessSupervisor::running() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ChildProcess> out;
+    out.reserve(children_.size());
+    for (const auto &entry : children_) {
+        out.push_back(entry.second.info);
+    }
+    std::sort(out.begin(), out.end(), [](const ChildProcess &a, const ChildProcess &b) {
+        return a.startedAt < b.startedAt;
+    });
+    return out;
+}
+
+std::vector<ChildProcess> ProcessSupervisor::recentExits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::vector<ChildProcess>(exits_.begin(), exits_.end());
+}
+
+void ProcessSupervisor::exportMetrics(MetricsRegistry &registry) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    registry.gauge("persys_child_processes_running", "Child processes spawned by the agent that have not exited", {}, static_cast<double>(children_.size()));
+    registry.counter("persys_child_processes_spawned_total", "Child processes handed to the supervisor", {}, static_cast<double>(adoptedTotal_));
+    registry.counter("persys_child_processes_exited_total", "Child processes reaped, by outcome", {{"outcome", "success"}}, static_cast<double>(succeededTotal_));
+    registry.counter("persys_child_processes_exited_total", "Child processes reaped, by outcome", {{"outcome", "failure"}}, static_cast<double>(failedTotal_));
+    registry.counter("persys_child_processes_exited_total", "Child processes reaped, by outcome", {{"outcome", "signal"}}, static_cast<double>(signaledTotal_));
+    registry.histogram("persys_child_process_duration_seconds", "Lifetime of child processes from spawn to exit", {}, lifetimeSeconds_);
+}
@@ -0,0 +1,83 @@
+#ifndef PROCESS_SUPERVISOR_H
+#define PROCESS_SUPERVISOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+#include "MetricsRegistry.h"
+
+struct ChildProcess {
+    pid_t pid = 0;
+    std::string command;   // what was run, e.g. "docker run"
+    std::string tag;       // workload/container the child works for, may be empty
+    std::chrono::system_clock::time_point startedAt;
+    std::chrono::system_clock::time_point exitedAt;
+    bool exited = false;
+    int exitCode = -1;     // exit status, -1 when killed by a signal or reaped elsewhere
+    int signal = 0;        // terminating signal, 0 for a normal exit
+};
+
+// Owns every child the agent spawns. Each adopted PID gets a pidfd in an
+// epoll set, so exits are reaped and timestamped the moment they happen and
+// "what is in flight" is a table lookup rather than a `ps` scan. On kernels
+// without pidfd_open (< 5.3) the loop falls back to polling waitpid(WNOHANG)
+// on the adopted PIDs only.
+class ProcessSupervisor {
+public:
+    ProcessSupervisor();
+    ~ProcessSupervisor();
+
+    void start();
+    void stop();
+
+    // Hands a freshly spawned child over for reaping. Nothing else may wait on it.
+    void adopt(pid_t pid, const std::string &command, const std::string &tag = "");
+    // Blocks until the child has exited; timeoutMs < 0 waits forever.
+    // Returns false on timeout or for a PID that was never adopted.
+    bool wait(pid_t pid, ChildProcess &out, int timeoutMs = -1);
+    bool find(pid_t pid, ChildProcess &out) const;
+    // Children still running, oldest first.
+    std::vector<ChildProcess> running() const;
+    // Recently exited children, oldest first.
+    std::vector<ChildProcess> recentExits() const;
+
+    void exportMetrics(MetricsRegistry &registry) const;
+
+private:
+    struct Entry {
+        ChildProcess info;
+        int pidfd = -1; // -1 when pidfd_open is unavailable
+    };
+
+    void loop();
+    void wake();
+    // Must be called with mutex_ held.
+    bool reap(pid_t pid);
+    bool findLocked(pid_t pid, ChildProcess &out) const;
+    void recordExit(std::map<pid_t, Entry>::iterator it, int status, bool reaped);
+
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable exited_;
+    std::map<pid_t, Entry> children_;
+    std::deque<ChildProcess> exits_;
+    uint64_t adoptedTotal_ = 0;
+    uint64_t succeededTotal_ = 0;
+    uint64_t failedTotal_ = 0;
+    uint64_t signaledTotal_ = 0;
+    MetricsRegistry::Histogram lifetimeSeconds_;
+};
+
+#endif // PROCESS_SUPERVISOR_H